@@ -18,24 +18,35 @@
 */
 
 #include "stdio.h"
+#include "stdlib.h"
+#include "errno.h"
 //#include "string.h"
+#include <algorithm>
 #include <string>
+#include <vector>
 #include "assert.h"
 
 #include "dnghost.h"
 #include "dngimagewriter.h"
+#include "dngpreviewextractor.h"
+#include "dngtiffwalker.h"
 
+#include "dng_area_task.h"
 #include "dng_camera_profile.h"
 #include "dng_color_space.h"
 #include "dng_file_stream.h"
 #include "dng_image.h"
 #include "dng_info.h"
 #include "dng_memory_stream.h"
+#include "dng_mutex.h"
 #include "dng_opcodes.h"
 #include "dng_opcode_list.h"
 #include "dng_parse_utils.h"
 #include "dng_string.h"
 #include "dng_render.h"
+#include "dng_tag_codes.h"
+#include "dng_tag_types.h"
+#include "dng_tag_values.h"
 #include "dng_xmp_sdk.h"
 
 #include "zlib.h"
@@ -44,8 +55,454 @@
 #ifdef WIN32
 #define snprintf _snprintf
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
+// dng_file_stream that counts the reads it issues to the file system.
+class CountingFileStream : public dng_file_stream
+{
+public:
+    CountingFileStream(const char* fileName, uint32 maxBufferSize)
+        : dng_file_stream(fileName), m_Reads(0), m_Bytes(0)
+    {
+        SetMaxBufferSize(maxBufferSize);
+    }
+
+    uint32 Reads() const { return m_Reads; }
+    uint64 Bytes() const { return m_Bytes; }
+
+protected:
+    virtual void DoRead(void *data, uint32 count, uint64 offset)
+    {
+        m_Reads++;
+        m_Bytes += count;
+        dng_file_stream::DoRead(data, count, offset);
+    }
+
+private:
+    uint32 m_Reads;
+    uint64 m_Bytes;
+};
+
+// Evict the file from the page cache, so the next open reads from storage.
+static bool dropFromCache(const char* fileName)
+{
+#if defined(POSIX_FADV_DONTNEED)
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return dropped;
+#else
+    (void) fileName;
+    return false;
+#endif
+}
+
+// Parses a whole decimal option value. Values below minValue and anything
+// that is not a number are rejected, values above maxValue are clamped.
+static bool parseOptionValue(const char* text, uint32 minValue, uint32 maxValue, uint32& value)
+{
+    char* end = NULL;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+
+    if (end == text || *end != 0 || errno == ERANGE || parsed < (long) minValue)
+        return false;
+
+    value = parsed > (long) maxValue ? maxValue : (uint32) parsed;
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------
+// Catalogue mode: walks the TIFF structure directly and reads only the IFD
+// entries needed for the record. XMP, profiles, opcode lists, private data,
+// the embedded original and the image data are never read; their sizes
+// come from the entry counts.
+
+static const uint32 kMaxCatalogueString = 256;
+
+static uint64 entryBytes(const DngTiffEntry* entry)
+{
+    return entry ? (uint64) TagTypeSize(entry->type) * entry->count : 0;
+}
+
+static std::string jsonString(const std::string& value)
+{
+    std::string result("\"");
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        unsigned char c = value[i];
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            result += escaped;
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+static std::string entryString(dng_stream& stream, const DngTiffEntry* entry)
+{
+    if (entry == NULL || entry->count == 0)
+        return std::string();
+
+    char buffer[kMaxCatalogueString];
+    uint32 length = Min_uint32(entry->count, kMaxCatalogueString);
+
+    stream.SetReadPosition(entry->valueOffset);
+    stream.Get(buffer, length);
+
+    uint32 end = 0;
+    while (end < length && buffer[end] != 0)
+        end++;
+
+    return std::string(buffer, end);
+}
+
+static void appendField(std::string& record, const char* name, const std::string& value)
+{
+    if (!value.empty())
+        record += std::string(",\"") + name + "\":" + jsonString(value);
+}
+
+static void appendField(std::string& record, const char* name, uint64 value)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), ",\"%s\":%llu", name, (unsigned long long) value);
+    record += buffer;
+}
+
+static std::string catalogueIfd(dng_stream& stream, const DngTiffIfd& entries, uint32 index)
+{
+    std::string record;
+    appendField(record, "index", index);
+    appendField(record, "subfile", entries.Value(stream, tcNewSubFileType));
+    appendField(record, "width", entries.Value(stream, tcImageWidth));
+    appendField(record, "height", entries.Value(stream, tcImageLength));
+    appendField(record, "bits", entries.Value(stream, tcBitsPerSample));
+    appendField(record, "samples", Max_uint32(entries.Value(stream, tcSamplesPerPixel), 1));
+    appendField(record, "compression", entries.Value(stream, tcCompression));
+    appendField(record, "photometric", entries.Value(stream, tcPhotometricInterpretation));
+
+    const DngTiffEntry* tiles = entries.Find(tcTileOffsets);
+    if (tiles == NULL)
+        tiles = entries.Find(tcStripOffsets);
+    appendField(record, "tiles", tiles ? tiles->count : 0);
+
+    uint64 opcodeBytes = entryBytes(entries.Find(tcOpcodeList1)) +
+                         entryBytes(entries.Find(tcOpcodeList2)) +
+                         entryBytes(entries.Find(tcOpcodeList3));
+    if (opcodeBytes)
+        appendField(record, "opcode_bytes", opcodeBytes);
+
+    record[0] = '{';
+    return record + "}";
+}
+
+static std::string catalogueFile(const char* fileName)
+{
+    std::string record("{\"file\":" + jsonString(fileName));
+
+    try
+    {
+        dng_file_stream stream(fileName);
+
+        // The same walk, and so the same IFD indices, as DngPreviewExtractor.
+        DngTiffWalker walker(stream);
+        walker.Start();
+
+        std::string ifds;
+        DngTiffIfd ifd0;
+        DngTiffIfd entries;
+        uint32 index;
+        int32 mainIndex = -1;
+
+        while (walker.Next(entries, index))
+        {
+            if (index == 0)
+                ifd0 = entries;
+
+            // A missing NewSubFileType reads as 0, which is sfMainImage, so
+            // EXIF and private IFDs would match without the Find.
+            if (mainIndex < 0 && entries.Find(tcNewSubFileType) &&
+                entries.Value(stream, tcNewSubFileType) == sfMainImage)
+                mainIndex = index;
+
+            ifds += (ifds.empty() ? "" : ",") + catalogueIfd(stream, entries, index);
+        }
+
+        appendField(record, "size", stream.Length());
+
+        const DngTiffEntry* version = ifd0.Find(tcDNGVersion);
+        if (version && version->count == 4)
+        {
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u",
+                     DngTiffIfd::Value(stream, version, 0), DngTiffIfd::Value(stream, version, 1),
+                     DngTiffIfd::Value(stream, version, 2), DngTiffIfd::Value(stream, version, 3));
+            appendField(record, "dng_version", std::string(buffer));
+        }
+
+        appendField(record, "make", entryString(stream, ifd0.Find(tcMake)));
+        appendField(record, "model", entryString(stream, ifd0.Find(tcModel)));
+        appendField(record, "unique_camera_model", entryString(stream, ifd0.Find(tcUniqueCameraModel)));
+        appendField(record, "datetime", entryString(stream, ifd0.Find(tcDateTime)));
+
+        const DngTiffEntry* exifIfd = ifd0.Find(tcExifIFD);
+        if (exifIfd)
+        {
+            DngTiffIfd exif;
+            exif.Read(stream, DngTiffIfd::Value(stream, exifIfd));
+            appendField(record, "datetime_original", entryString(stream, exif.Find(tcDateTimeOriginal)));
+            appendField(record, "makernote_bytes", entryBytes(exif.Find(tcMakerNote)));
+        }
+
+        appendField(record, "original_raw_file_name", entryString(stream, ifd0.Find(tcOriginalRawFileName)));
+        appendField(record, "original_raw_data_bytes", entryBytes(ifd0.Find(tcOriginalRawFileData)));
+        appendField(record, "private_data_bytes", entryBytes(ifd0.Find(tcDNGPrivateData)));
+        appendField(record, "xmp_bytes", entryBytes(ifd0.Find(tcXMP)));
+        appendField(record, "profiles", (ifd0.Find(tcColorMatrix1) ? 1 : 0) +
+                    (ifd0.Find(tcExtraCameraProfiles) ? ifd0.Find(tcExtraCameraProfiles)->count : 0));
+
+        if (mainIndex >= 0)
+            appendField(record, "main_ifd", (uint64) mainIndex);
+
+        record += ",\"ifds\":[" + ifds + "]";
+    }
+    catch (const dng_exception& e)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "dng error %d", (int) e.ErrorCode());
+        appendField(record, "error", std::string(buffer));
+    }
+    catch (...)
+    {
+        appendField(record, "error", std::string("unknown error"));
+    }
+
+    return record + "}\n";
+}
+
+// -----------------------------------------------------------------------------------------
+// Preview mode: copies the JPEG preview of each file to <file>-preview.jpeg
+// without parsing the negative or decoding anything.
+
+static std::string extractPreview(const char* fileName, uint32 targetSize)
+{
+    std::string record("{\"file\":" + jsonString(fileName));
+
+    try
+    {
+        dng_file_stream stream(fileName);
+
+        DngPreviewExtractor extractor(stream);
+        extractor.Parse();
+
+        const DngJpegPreview* preview = extractor.Select(targetSize);
+        if (preview == NULL)
+        {
+            appendField(record, "error", std::string("no JPEG preview"));
+            return record + "}\n";
+        }
+
+        std::string outName = std::string(fileName) + "-preview.jpeg";
+        {
+            dng_file_stream outStream(outName.c_str(), true);
+            extractor.Extract(*preview, outStream);
+            outStream.Flush();
+        }
+
+        appendField(record, "preview", outName);
+        appendField(record, "ifd", preview->ifdIndex);
+        appendField(record, "subfile", preview->subFileType);
+        appendField(record, "width", preview->width);
+        appendField(record, "height", preview->height);
+        appendField(record, "bytes", preview->length);
+    }
+    catch (const dng_exception& e)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "dng error %d", (int) e.ErrorCode());
+        appendField(record, "error", std::string(buffer));
+    }
+    catch (...)
+    {
+        appendField(record, "error", std::string("unknown error"));
+    }
+
+    return record + "}\n";
+}
+
+// Handles a list of files on the host's threads, printing one line per
+// file. Each thread takes the next file from a shared index, so slow files
+// do not hold up a whole batch.
+class FileListTask : public dng_area_task
+{
+public:
+    FileListTask(const std::vector<std::string>& files, uint32 threads)
+        : m_Files(files), m_Next(0), m_Mutex("FileListTask")
+    {
+        fMaxThreads = threads;
+        fMinTaskArea = 1;
+        fMaxTileSize = dng_point(1, 1);
+    }
+
+    virtual void Process(uint32 /* threadIndex */,
+                         const dng_rect& /* tile */,
+                         dng_abort_sniffer* /* sniffer */)
+    {
+        for (;;)
+        {
+            size_t index;
+            {
+                dng_lock_mutex lock(&m_Mutex);
+                index = m_Next++;
+            }
+
+            if (index >= m_Files.size())
+                break;
+
+            std::string record = ProcessFile(m_Files[index].c_str());
+
+            dng_lock_mutex lock(&m_Mutex);
+            fputs(record.c_str(), stdout);
+        }
+    }
+
+protected:
+    virtual std::string ProcessFile(const char* fileName) = 0;
+
+private:
+    const std::vector<std::string>& m_Files;
+    size_t m_Next;
+    dng_mutex m_Mutex;
+};
+
+class CatalogueTask : public FileListTask
+{
+public:
+    CatalogueTask(const std::vector<std::string>& files, uint32 threads)
+        : FileListTask(files, threads)
+    {
+    }
+
+protected:
+    virtual std::string ProcessFile(const char* fileName)
+    {
+        return catalogueFile(fileName);
+    }
+};
+
+class PreviewTask : public FileListTask
+{
+public:
+    PreviewTask(const std::vector<std::string>& files, uint32 threads, uint32 targetSize)
+        : FileListTask(files, threads), m_TargetSize(targetSize)
+    {
+    }
+
+protected:
+    virtual std::string ProcessFile(const char* fileName)
+    {
+        return extractPreview(fileName, m_TargetSize);
+    }
+
+private:
+    uint32 m_TargetSize;
+};
+
+static int processFiles(FileListTask& task, uint32 fileCount, uint32 threads, const char* verb)
+{
+    DngHost host;
+
+    real64 start = TickTimeInSeconds();
+    host.PerformAreaTask(task, dng_rect(Max_uint32(threads, 1), 1));
+    real64 time = TickTimeInSeconds() - start;
+
+    fflush(stdout);
+    fprintf(stderr, "%s %u files in %.2f s (%.0f files/s)\n",
+            verb, fileCount, time, time > 0.0 ? fileCount / time : 0.0);
+
+    return 0;
+}
+
+// Open the file with a fixed and with an adaptive read buffer and report
+// the reads issued and the time taken for parsing and for reading the raw
+// image, from a cold page cache where possible.
+static int benchmarkOpen(const char* fileName)
+{
+    const int runs = 3;
+    const struct
+    {
+        const char* name;
+        uint32 maxBufferSize;
+    } configs[] =
+    {
+        { "fixed 4K", dng_stream::kDefaultBufferSize },
+        { "adaptive", dng_stream::kHugeBufferSize }
+    };
+
+    bool cold = dropFromCache(fileName);
+    printf("%s page cache\n", cold ? "cold" : "warm (cannot drop)");
+    printf("%-10s %12s %10s %10s %12s %10s %10s\n",
+           "buffer", "parse reads", "bytes", "ms", "raw reads", "bytes", "ms");
+
+    for (uint32 c = 0; c < sizeof(configs) / sizeof(configs[0]); c++)
+    {
+        for (int run = 0; run < runs; run++)
+        {
+            dropFromCache(fileName);
+
+            DngHost host;
+            CountingFileStream stream(fileName, configs[c].maxBufferSize);
+
+            real64 start = TickTimeInSeconds();
+
+            dng_info info;
+            info.Parse(host, stream);
+            info.PostParse(host);
+
+            if (!info.IsValidDNG())
+                return dng_error_bad_format;
+
+            AutoPtr<dng_negative> negative(host.Make_dng_negative());
+            negative->Parse(host, stream, info);
+            negative->PostParse(host, stream, info);
+
+            real64 parseTime = TickTimeInSeconds() - start;
+            uint32 parseReads = stream.Reads();
+            uint64 parseBytes = stream.Bytes();
+
+            start = TickTimeInSeconds();
+            negative->ReadStage1Image(host, stream, info);
+            real64 rawTime = TickTimeInSeconds() - start;
+
+            printf("%-10s %12u %10llu %10.2f %12u %10llu %10.2f\n",
+                   configs[c].name,
+                   parseReads, (unsigned long long) parseBytes, parseTime * 1000.0,
+                   stream.Reads() - parseReads,
+                   (unsigned long long) (stream.Bytes() - parseBytes),
+                   rawTime * 1000.0);
+        }
+    }
+
+    return 0;
+}
+
 int main(int argc, const char* argv [])
 {
     if(argc == 1)
@@ -54,10 +511,19 @@ int main(int argc, const char* argv [])
                 "\n"
                 "dnganalyze - DNG file analyzer tool\n"
                 "Usage: %s [options] <dngfile>\n"
+                "       %s -catalogue [-j <threads>] <dngfile>... | -\n"
+                "       %s -preview [-size <n>] [-j <threads>] <dngfile>... | -\n"
                 "Valid options:\n"
+                "  -catalogue    print one JSON line per file from the IFD headers only,\n"
+                "                - reads the file names from stdin\n"
+                "  -preview      copy the largest JPEG preview to <dngfile>-preview.jpeg\n"
+                "                without decoding, one JSON line per file\n"
+                "  -size <n>     with -preview, the smallest preview whose longer side is >= n\n"
                 "  -o            extract embedded original\n"
-                "  -i            extract ifd images\n",
-                argv[0]);
+                "  -i            extract ifd images\n"
+                "  -iostats      benchmark reads and time for opening the file\n"
+                "  -j <threads>  number of files to catalogue or preview in parallel, 1 to 16\n",
+                argv[0], argv[0], argv[0]);
 
         return -1;
     }
@@ -65,7 +531,12 @@ int main(int argc, const char* argv [])
     int32 index;
     bool extractOriginal = false;
     bool extractIfd = false;
-    for (index = 1; index < argc && argv[index][0] == '-'; index++)
+    bool ioStats = false;
+    bool catalogue = false;
+    bool preview = false;
+    uint32 previewSize = 0;
+    uint32 threads = DngHost::ProcessorCount();
+    for (index = 1; index < argc && argv[index][0] == '-' && argv[index][1] != 0; index++)
     {
         std::string option = &argv[index][1];
 
@@ -78,6 +549,41 @@ int main(int argc, const char* argv [])
         {
             extractIfd = true;
         }
+
+        if (0 == strcmp(option.c_str(), "iostats"))
+        {
+            ioStats = true;
+        }
+
+        if (0 == strcmp(option.c_str(), "catalogue"))
+        {
+            catalogue = true;
+        }
+
+        if (0 == strcmp(option.c_str(), "preview"))
+        {
+            preview = true;
+        }
+
+        if (0 == strcmp(option.c_str(), "size") && index + 1 < argc)
+        {
+            // 0 picks the largest preview; no preview is anywhere near 2^20.
+            if (!parseOptionValue(argv[++index], 0, 1 << 20, previewSize))
+            {
+                fprintf(stderr, "*** Invalid preview size: %s\n", argv[index]);
+                return 1;
+            }
+        }
+
+        if (0 == strcmp(option.c_str(), "j") && index + 1 < argc)
+        {
+            // DngHost runs at most 16 threads per task.
+            if (!parseOptionValue(argv[++index], 1, 16, threads))
+            {
+                fprintf(stderr, "*** Invalid thread count: %s\n", argv[index]);
+                return 1;
+            }
+        }
     }
 
     if (index == argc)
@@ -86,10 +592,50 @@ int main(int argc, const char* argv [])
         return 1;
     }
 
+    if (catalogue || preview)
+    {
+        std::vector<std::string> files;
+        for (; index < argc; index++)
+        {
+            if (0 == strcmp(argv[index], "-"))
+            {
+                char line[4096];
+                while (fgets(line, sizeof(line), stdin))
+                {
+                    std::string name(line);
+                    while (!name.empty() && (name[name.size() - 1] == '\n' || name[name.size() - 1] == '\r'))
+                        name.resize(name.size() - 1);
+                    if (!name.empty())
+                        files.push_back(name);
+                }
+            }
+            else
+            {
+                files.push_back(argv[index]);
+            }
+        }
+
+        if (preview)
+        {
+            PreviewTask task(files, threads, previewSize);
+            return processFiles(task, (uint32) files.size(), threads, "extracted previews from");
+        }
+
+        CatalogueTask task(files, threads);
+        return processFiles(task, (uint32) files.size(), threads, "catalogued");
+    }
+
     const char* fileName = argv[index];
 
     dng_xmp_sdk::InitializeSDK();
 
+    if (ioStats)
+    {
+        int result = benchmarkOpen(fileName);
+        dng_xmp_sdk::TerminateSDK();
+        return result;
+    }
+
     dng_file_stream stream(fileName);
     DngHost host;
     host.SetKeepOriginalFile(true);
@@ -17,15 +17,25 @@
    Boston, MA 02110-1301, USA.
 */
 
+#include "dng_area_task.h"
+#include "dng_bottlenecks.h"
 #include "dng_file_stream.h"
 #include "dng_host.h"
 #include "dng_info.h"
+#include "dng_render.h"
+#include "dng_sdk_limits.h"
+#include "dng_simple_image.h"
+#include "dng_tag_values.h"
+#include "dng_utils.h"
 #include "dng_xmp_sdk.h"
 
 #include <cmath>
 #include <limits>
+#include <string>
+#include <vector>
 
 #include "dnghost.h"
+#include "dngimagewriter.h"
 
 bool AreSame(real64 a, real64 b)
 {
@@ -601,6 +611,614 @@ void compareNegative(const dng_negative& negative1, const dng_negative& negative
     }
 }
 
+// Compares the pixels of two images tile by tile on the host's threads.
+// 8 and 16 bit images are compared as 16 bit samples, 32 bit images as
+// they are. With equalOnly set, the first differing tile stops the work
+// of all threads.
+class PixelCompareTask : public dng_area_task
+{
+public:
+    PixelCompareTask(const dng_image& image1, const dng_image& image2,
+                     bool equalOnly, dng_image* heatmap)
+        : m_Image1(image1),
+          m_Image2(image2),
+          m_EqualOnly(equalOnly),
+          m_Heatmap(heatmap),
+          m_Planes(image1.Planes()),
+          m_PixelType(image1.PixelSize() == 4 ? image1.PixelType() : (uint32) ttShort),
+          m_Mismatch(false),
+          m_MaxDiff(0.0),
+          m_DiffCount(0),
+          m_SumSquares(0.0)
+    {
+        fMaxThreads = kMaxMPThreads;
+        fMaxTileSize = dng_point(256, 1024);
+    }
+
+    virtual void Start(uint32 threadCount,
+                       const dng_point& tileSize,
+                       dng_memory_allocator* allocator,
+                       dng_abort_sniffer* /* sniffer */)
+    {
+        uint32 pixels = tileSize.v * tileSize.h;
+
+        for (uint32 i = 0; i < threadCount; i++)
+        {
+            m_Buffer1[i].Reset(allocator->Allocate(pixels * m_Planes * TagTypeSize(m_PixelType)));
+            m_Buffer2[i].Reset(allocator->Allocate(pixels * m_Planes * TagTypeSize(m_PixelType)));
+
+            if (m_Heatmap)
+                m_HeatBuffer[i].Reset(allocator->Allocate(pixels * sizeof(uint16)));
+
+            m_Stats[i] = Stats();
+        }
+    }
+
+    virtual void Process(uint32 threadIndex,
+                         const dng_rect& tile,
+                         dng_abort_sniffer* /* sniffer */)
+    {
+        if (m_Mismatch)
+            return;
+
+        dng_pixel_buffer buffer1 = MakeBuffer(tile, m_Buffer1[threadIndex].Get(), m_PixelType);
+        dng_pixel_buffer buffer2 = MakeBuffer(tile, m_Buffer2[threadIndex].Get(), m_PixelType);
+
+        m_Image1.Get(buffer1);
+        m_Image2.Get(buffer2);
+
+        if (m_EqualOnly)
+        {
+            if (!buffer1.EqualArea(buffer2, tile, 0, m_Planes))
+                m_Mismatch = true;
+            return;
+        }
+
+        Stats& stats = m_Stats[threadIndex];
+
+        dng_pixel_buffer heat;
+        if (m_Heatmap)
+        {
+            heat = MakeBuffer(tile, m_HeatBuffer[threadIndex].Get(), ttShort);
+            heat.fPlanes = 1;
+            heat.fColStep = 1;
+            heat.fRowStep = tile.W();
+        }
+
+        if (m_PixelType == ttShort)
+        {
+            uint32 maxDiff = 0;
+            uint64 diffCount = 0;
+            uint64 sumSquares = 0;
+
+            DoDiffArea16(buffer1.ConstPixel_uint16(tile.t, tile.l),
+                         buffer2.ConstPixel_uint16(tile.t, tile.l),
+                         tile.H(), tile.W(), m_Planes,
+                         buffer1.fRowStep, buffer1.fColStep, buffer1.fPlaneStep,
+                         buffer2.fRowStep, buffer2.fColStep, buffer2.fPlaneStep,
+                         m_Heatmap ? heat.DirtyPixel_uint16(tile.t, tile.l) : NULL,
+                         heat.fRowStep,
+                         &maxDiff, &diffCount, &sumSquares);
+
+            stats.maxDiff = Max_real64(stats.maxDiff, maxDiff);
+            stats.diffCount += diffCount;
+            stats.sumSquares += (real64) sumSquares;
+        }
+        else
+        {
+            for (int32 row = tile.t; row < tile.b; row++)
+            {
+                for (int32 col = tile.l; col < tile.r; col++)
+                {
+                    real64 pixelMax = 0.0;
+
+                    for (uint32 plane = 0; plane < m_Planes; plane++)
+                    {
+                        real64 diff = m_PixelType == ttFloat
+                                      ? std::fabs((real64) *buffer1.ConstPixel_real32(row, col, plane) -
+                                                  (real64) *buffer2.ConstPixel_real32(row, col, plane))
+                                      : std::fabs((real64) *buffer1.ConstPixel_uint32(row, col, plane) -
+                                                  (real64) *buffer2.ConstPixel_uint32(row, col, plane));
+
+                        pixelMax = Max_real64(pixelMax, diff);
+                        stats.diffCount += diff != 0.0;
+                        stats.sumSquares += diff * diff;
+                    }
+
+                    stats.maxDiff = Max_real64(stats.maxDiff, pixelMax);
+
+                    if (m_Heatmap)
+                    {
+                        real64 scaled = m_PixelType == ttFloat ? pixelMax * 65535.0 : pixelMax;
+                        *heat.DirtyPixel_uint16(row, col) = (uint16) Min_real64(scaled, 65535.0);
+                    }
+                }
+            }
+        }
+
+        if (m_Heatmap)
+            m_Heatmap->Put(heat);
+    }
+
+    virtual void Finish(uint32 threadCount)
+    {
+        for (uint32 i = 0; i < threadCount; i++)
+        {
+            m_MaxDiff = Max_real64(m_MaxDiff, m_Stats[i].maxDiff);
+            m_DiffCount += m_Stats[i].diffCount;
+            m_SumSquares += m_Stats[i].sumSquares;
+
+            m_Buffer1[i].Reset();
+            m_Buffer2[i].Reset();
+            m_HeatBuffer[i].Reset();
+        }
+
+        if (m_Mismatch)
+            m_DiffCount = std::max<uint64>(m_DiffCount, 1);
+    }
+
+    bool Identical() const { return m_DiffCount == 0; }
+    real64 MaxDiff() const { return m_MaxDiff; }
+    uint64 DiffCount() const { return m_DiffCount; }
+    real64 SumSquares() const { return m_SumSquares; }
+
+private:
+    struct Stats
+    {
+        Stats() : maxDiff(0.0), diffCount(0), sumSquares(0.0) {}
+
+        real64 maxDiff;
+        uint64 diffCount;
+        real64 sumSquares;
+    };
+
+    dng_pixel_buffer MakeBuffer(const dng_rect& tile, dng_memory_block* block, uint32 pixelType) const
+    {
+        dng_pixel_buffer buffer;
+        buffer.fArea = tile;
+        buffer.fPlane = 0;
+        buffer.fPlanes = m_Planes;
+        buffer.fColStep = m_Planes;
+        buffer.fRowStep = tile.W() * m_Planes;
+        buffer.fPlaneStep = 1;
+        buffer.fPixelType = pixelType;
+        buffer.fPixelSize = TagTypeSize(pixelType);
+        buffer.fData = block->Buffer();
+        return buffer;
+    }
+
+    const dng_image& m_Image1;
+    const dng_image& m_Image2;
+    bool m_EqualOnly;
+    dng_image* m_Heatmap;
+    uint32 m_Planes;
+    uint32 m_PixelType;
+
+    AutoPtr<dng_memory_block> m_Buffer1[kMaxMPThreads];
+    AutoPtr<dng_memory_block> m_Buffer2[kMaxMPThreads];
+    AutoPtr<dng_memory_block> m_HeatBuffer[kMaxMPThreads];
+    Stats m_Stats[kMaxMPThreads];
+
+    volatile bool m_Mismatch;
+
+    real64 m_MaxDiff;
+    uint64 m_DiffCount;
+    real64 m_SumSquares;
+};
+
+// 64 bit non-cryptographic hash with the same construction and constants
+// as xxHash64: four independent multiply-rotate lanes over 32 byte
+// stripes, merged and avalanched at the end.
+static const uint64 kPrime1 = 11400714785074694791ULL;
+static const uint64 kPrime2 = 14029467366897019727ULL;
+static const uint64 kPrime3 = 1609587929392839161ULL;
+static const uint64 kPrime4 = 9650029242287828579ULL;
+static const uint64 kPrime5 = 2870177450012600261ULL;
+
+static inline uint64 rotl64(uint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64 read64(const uint8* p)
+{
+    uint64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32 read32(const uint8* p)
+{
+    uint32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64 hashRound(uint64 acc, uint64 input)
+{
+    acc += input * kPrime2;
+    acc = rotl64(acc, 31);
+    return acc * kPrime1;
+}
+
+static inline uint64 hashMerge(uint64 acc, uint64 lane)
+{
+    acc ^= hashRound(0, lane);
+    return acc * kPrime1 + kPrime4;
+}
+
+uint64 hashBytes(const void* data, uint32 count, uint64 seed)
+{
+    const uint8* p = (const uint8*) data;
+    const uint8* end = p + count;
+    uint64 h;
+
+    if (count >= 32)
+    {
+        uint64 v1 = seed + kPrime1 + kPrime2;
+        uint64 v2 = seed + kPrime2;
+        uint64 v3 = seed;
+        uint64 v4 = seed - kPrime1;
+
+        for (; p + 32 <= end; p += 32)
+        {
+            v1 = hashRound(v1, read64(p));
+            v2 = hashRound(v2, read64(p + 8));
+            v3 = hashRound(v3, read64(p + 16));
+            v4 = hashRound(v4, read64(p + 24));
+        }
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = hashMerge(h, v1);
+        h = hashMerge(h, v2);
+        h = hashMerge(h, v3);
+        h = hashMerge(h, v4);
+    }
+    else
+    {
+        h = seed + kPrime5;
+    }
+
+    h += count;
+
+    for (; p + 8 <= end; p += 8)
+        h = rotl64(h ^ hashRound(0, read64(p)), 27) * kPrime1 + kPrime4;
+
+    if (p + 4 <= end)
+    {
+        h = rotl64(h ^ (read32(p) * kPrime1), 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+        h = rotl64(h ^ (*p * kPrime5), 11) * kPrime1;
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+// Offsets and byte counts of the tiles or strips of an IFD.
+void tileLayout(dng_stream& stream, const dng_ifd& ifd,
+                std::vector<uint64>& offsets, std::vector<uint32>& byteCounts)
+{
+    uint32 count = ifd.fTileOffsetsCount;
+
+    if (ifd.fTileByteCountsCount != count)
+        ThrowBadFormat();
+
+    offsets.resize(count);
+    byteCounts.resize(count);
+
+    if (count <= dng_ifd::kMaxTileInfo)
+    {
+        for (uint32 i = 0; i < count; i++)
+        {
+            offsets[i] = ifd.fTileOffset[i];
+            byteCounts[i] = ifd.fTileByteCount[i];
+        }
+    }
+    else
+    {
+        stream.SetReadPosition(ifd.fTileOffsetsOffset);
+        for (uint32 i = 0; i < count; i++)
+            offsets[i] = stream.TagValue_uint32(ifd.fTileOffsetsType);
+
+        stream.SetReadPosition(ifd.fTileByteCountsOffset);
+        for (uint32 i = 0; i < count; i++)
+            byteCounts[i] = stream.TagValue_uint32(ifd.fTileByteCountsType);
+    }
+}
+
+// True if equal compressed tiles in both IFDs decode to the same pixels.
+bool sameTileEncoding(const dng_info& info1, const dng_ifd& ifd1,
+                      const dng_info& info2, const dng_ifd& ifd2)
+{
+    if (ifd1.fImageWidth != ifd2.fImageWidth ||
+            ifd1.fImageLength != ifd2.fImageLength ||
+            ifd1.fTileWidth != ifd2.fTileWidth ||
+            ifd1.fTileLength != ifd2.fTileLength ||
+            ifd1.fCompression != ifd2.fCompression ||
+            ifd1.fPredictor != ifd2.fPredictor ||
+            ifd1.fSamplesPerPixel != ifd2.fSamplesPerPixel ||
+            ifd1.fPlanarConfiguration != ifd2.fPlanarConfiguration ||
+            ifd1.fRowInterleaveFactor != ifd2.fRowInterleaveFactor ||
+            ifd1.fSubTileBlockRows != ifd2.fSubTileBlockRows ||
+            ifd1.fSubTileBlockCols != ifd2.fSubTileBlockCols ||
+            ifd1.fTileOffsetsCount != ifd2.fTileOffsetsCount)
+        return false;
+
+    // Uncompressed and deflated samples are stored in the file byte order.
+    if (info1.fBigEndian != info2.fBigEndian && ifd1.fCompression != ccJPEG)
+        return false;
+
+    for (uint32 i = 0; i < ifd1.fSamplesPerPixel; i++)
+    {
+        if (ifd1.fBitsPerSample[i] != ifd2.fBitsPerSample[i] ||
+                ifd1.fSampleFormat[i] != ifd2.fSampleFormat[i])
+            return false;
+    }
+
+    return true;
+}
+
+// Hashes the compressed bytes of each tile of both files on the host's
+// threads. Each thread reads through its own pair of streams. Tiles are
+// hashed in chunks, each chunk seeded with the hash so far, so large
+// strips need no more than a chunk of memory. The first differing tile
+// stops the other threads.
+class TileHashTask : public dng_area_task
+{
+public:
+    enum
+    {
+        kChunkSize = 1024 * 1024
+    };
+
+    TileHashTask(const char* fileName1, const std::vector<uint64>& offsets1,
+                 const char* fileName2, const std::vector<uint64>& offsets2,
+                 const std::vector<uint32>& byteCounts)
+        : m_FileName1(fileName1),
+          m_FileName2(fileName2),
+          m_Offsets1(offsets1),
+          m_Offsets2(offsets2),
+          m_ByteCounts(byteCounts),
+          m_Hashes1(byteCounts.size(), 0),
+          m_Hashes2(byteCounts.size(), 0),
+          m_Mismatch(false)
+    {
+        fMaxThreads = kMaxMPThreads;
+        fMinTaskArea = 1;
+        fMaxTileSize = dng_point(1, 1);
+    }
+
+    virtual void Start(uint32 threadCount,
+                       const dng_point& /* tileSize */,
+                       dng_memory_allocator* allocator,
+                       dng_abort_sniffer* /* sniffer */)
+    {
+        for (uint32 i = 0; i < threadCount; i++)
+        {
+            m_Stream1[i].Reset(new dng_file_stream(m_FileName1));
+            m_Stream2[i].Reset(new dng_file_stream(m_FileName2));
+            m_Buffer[i].Reset(allocator->Allocate(kChunkSize));
+        }
+    }
+
+    virtual void Process(uint32 threadIndex,
+                         const dng_rect& tile,
+                         dng_abort_sniffer* /* sniffer */)
+    {
+        for (int32 index = tile.t; index < tile.b && !m_Mismatch; index++)
+        {
+            m_Hashes1[index] = HashTile(*m_Stream1[threadIndex].Get(), m_Offsets1[index], m_ByteCounts[index], threadIndex);
+            m_Hashes2[index] = HashTile(*m_Stream2[threadIndex].Get(), m_Offsets2[index], m_ByteCounts[index], threadIndex);
+
+            if (m_Hashes1[index] != m_Hashes2[index])
+                m_Mismatch = true;
+        }
+    }
+
+    virtual void Finish(uint32 threadCount)
+    {
+        for (uint32 i = 0; i < threadCount; i++)
+        {
+            m_Stream1[i].Reset();
+            m_Stream2[i].Reset();
+            m_Buffer[i].Reset();
+        }
+    }
+
+    bool Identical() const { return !m_Mismatch; }
+
+    uint64 Bytes() const
+    {
+        uint64 bytes = 0;
+        for (size_t i = 0; i < m_ByteCounts.size(); i++)
+            bytes += m_ByteCounts[i];
+        return 2 * bytes;
+    }
+
+    // Hash over the tile hashes, identifying the raw data of a file.
+    uint64 FileHash(uint32 file) const
+    {
+        const std::vector<uint64>& hashes = file == 0 ? m_Hashes1 : m_Hashes2;
+        return hashBytes(&hashes[0], (uint32) (hashes.size() * sizeof(uint64)), 0);
+    }
+
+private:
+    uint64 HashTile(dng_stream& stream, uint64 offset, uint32 byteCount, uint32 threadIndex)
+    {
+        uint8* buffer = m_Buffer[threadIndex]->Buffer_uint8();
+        uint64 hash = 0;
+
+        stream.SetReadPosition(offset);
+
+        while (byteCount)
+        {
+            uint32 count = Min_uint32(byteCount, kChunkSize);
+            stream.Get(buffer, count);
+            hash = hashBytes(buffer, count, hash);
+            byteCount -= count;
+        }
+
+        return hash;
+    }
+
+    const char* m_FileName1;
+    const char* m_FileName2;
+    const std::vector<uint64>& m_Offsets1;
+    const std::vector<uint64>& m_Offsets2;
+    const std::vector<uint32>& m_ByteCounts;
+    std::vector<uint64> m_Hashes1;
+    std::vector<uint64> m_Hashes2;
+
+    AutoPtr<dng_stream> m_Stream1[kMaxMPThreads];
+    AutoPtr<dng_stream> m_Stream2[kMaxMPThreads];
+    AutoPtr<dng_memory_block> m_Buffer[kMaxMPThreads];
+
+    volatile bool m_Mismatch;
+};
+
+// Tries to show that the raw images are identical without decoding them:
+// first by hashing the compressed tiles, then by the stored raw image
+// digests. Returns what proved it, or NULL if the images must be decoded.
+const char* rawIdenticalWithoutDecoding(DngHost& host,
+                                        const char* fileName1, dng_stream& stream1,
+                                        const dng_info& info1, const dng_negative& negative1,
+                                        const char* fileName2, dng_stream& stream2,
+                                        const dng_info& info2, const dng_negative& negative2)
+{
+    const dng_ifd& ifd1 = *info1.fIFD[info1.fMainIndex].Get();
+    const dng_ifd& ifd2 = *info2.fIFD[info2.fMainIndex].Get();
+
+    if (sameTileEncoding(info1, ifd1, info2, ifd2))
+    {
+        std::vector<uint64> offsets1, offsets2;
+        std::vector<uint32> byteCounts1, byteCounts2;
+        tileLayout(stream1, ifd1, offsets1, byteCounts1);
+        tileLayout(stream2, ifd2, offsets2, byteCounts2);
+
+        // Different compressed sizes already mean different tiles.
+        if (byteCounts1 == byteCounts2)
+        {
+            real64 start = TickTimeInSeconds();
+
+            TileHashTask task(fileName1, offsets1, fileName2, offsets2, byteCounts1);
+            host.PerformAreaTask(task, dng_rect((int32) byteCounts1.size(), 1));
+
+            real64 time = TickTimeInSeconds() - start;
+
+            if (task.Identical())
+            {
+                fprintf(stderr, "hashed %u tiles in %.1f ms (%.0f MB/s)\n",
+                        (uint32) byteCounts1.size(), time * 1000.0,
+                        time > 0.0 ? task.Bytes() / time / 1.0e6 : 0.0);
+                printf("    TileHash: %016llx\n", (unsigned long long) task.FileHash(0));
+                return "compressed tiles";
+            }
+        }
+    }
+
+    if (negative1.RawImageDigest().IsValid() &&
+            negative1.RawImageDigest() == negative2.RawImageDigest())
+        return "RawImageDigest";
+
+    return NULL;
+}
+
+enum PixelStage
+{
+    kStageNone,
+    kStageRaw,
+    kStage2,
+    kStage3,
+    kStageRender
+};
+
+// Decodes the image to compare for the requested stage. Rendered images
+// are owned by the caller through rendered.
+const dng_image* buildStageImage(DngHost& host, dng_stream& stream, dng_info& info,
+                                 dng_negative& negative, PixelStage stage,
+                                 AutoPtr<dng_image>& rendered)
+{
+    negative.ReadStage1Image(host, stream, info);
+
+    if (stage == kStageRaw)
+        return negative.Stage1Image();
+
+    negative.BuildStage2Image(host);
+
+    if (stage == kStage2)
+        return negative.Stage2Image();
+
+    negative.BuildStage3Image(host);
+
+    if (stage == kStage3)
+        return negative.Stage3Image();
+
+    dng_render render(host, negative);
+    rendered.Reset(render.Render());
+    return rendered.Get();
+}
+
+// Scales the 16 bit difference map so the largest difference is white and
+// writes it as an 8 bit grayscale TIFF.
+void writeHeatmap(DngHost& host, const dng_image& heatmap, real64 maxDiff, const char* fileName)
+{
+    const dng_rect& bounds = heatmap.Bounds();
+    dng_simple_image heat8(bounds, 1, ttByte, host.Allocator());
+
+    uint32 maxValue = (uint32) Min_real64(Max_real64(maxDiff, 1.0), 65535.0);
+    const uint32 stripRows = 64;
+
+    AutoPtr<dng_memory_block> src(host.Allocate(bounds.W() * stripRows * sizeof(uint16)));
+    AutoPtr<dng_memory_block> dst(host.Allocate(bounds.W() * stripRows));
+
+    for (int32 top = bounds.t; top < bounds.b; top += stripRows)
+    {
+        dng_rect strip(top, bounds.l, Min_int32(top + stripRows, bounds.b), bounds.r);
+
+        dng_pixel_buffer srcBuffer;
+        srcBuffer.fArea = strip;
+        srcBuffer.fPlane = 0;
+        srcBuffer.fPlanes = 1;
+        srcBuffer.fColStep = 1;
+        srcBuffer.fRowStep = strip.W();
+        srcBuffer.fPlaneStep = 1;
+        srcBuffer.fPixelType = ttShort;
+        srcBuffer.fPixelSize = 2;
+        srcBuffer.fData = src->Buffer();
+
+        dng_pixel_buffer dstBuffer(srcBuffer);
+        dstBuffer.fPixelType = ttByte;
+        dstBuffer.fPixelSize = 1;
+        dstBuffer.fData = dst->Buffer();
+
+        heatmap.Get(srcBuffer);
+
+        const uint16* sPtr = src->Buffer_uint16();
+        uint8* dPtr = dst->Buffer_uint8();
+        uint32 count = strip.W() * strip.H();
+
+        for (uint32 i = 0; i < count; i++)
+        {
+            uint32 diff = Min_uint32(sPtr[i], maxValue);
+            dPtr[i] = diff ? (uint8) (1 + (diff - 1) * 254 / Max_uint32(maxValue - 1, 1)) : 0;
+        }
+
+        heat8.Put(dstBuffer);
+    }
+
+    dng_file_stream stream(fileName, true);
+    DngImageWriter writer;
+    writer.WriteTIFF(host, stream, heat8, piBlackIsZero, ccUncompressed);
+}
+
 int main(int argc, const char* argv [])
 {
     if(argc == 1)
@@ -608,14 +1226,69 @@ int main(int argc, const char* argv [])
         fprintf(stderr,
                 "\n"
                 "dngcompare - DNG comparsion tool\n"
-                "Usage: %s [options] <dngfile1> <dngfile2>\n",
+                "Usage: %s [options] <dngfile1> <dngfile2>\n"
+                "Valid options:\n"
+                "  -pixels <stage>      also compare the pixels of raw, stage2, stage3 or render\n"
+                "  -equal               only test the pixels for equality, stop at the first difference;\n"
+                "                       raw data is first compared by compressed tile hashes and\n"
+                "                       RawImageDigest, and only decoded if those differ\n"
+                "  -heatmap <filename>  write the per pixel differences as a grayscale TIFF\n"
+                "The exit code is 1 if the pixels differ.\n",
                 argv[0]);
 
         return -1;
     }
 
-    const char* fileName1 = argv[1];
-    const char* fileName2 = argv[2];
+    int index;
+    PixelStage stage = kStageNone;
+    bool equalOnly = false;
+    const char* heatmapFileName = NULL;
+
+    for (index = 1; index < argc && argv[index][0] == '-'; index++)
+    {
+        std::string option = &argv[index][1];
+
+        if (0 == strcmp(option.c_str(), "pixels") && index + 1 < argc)
+        {
+            std::string name = argv[++index];
+
+            if (name == "raw")
+                stage = kStageRaw;
+            else if (name == "stage2")
+                stage = kStage2;
+            else if (name == "stage3")
+                stage = kStage3;
+            else if (name == "render")
+                stage = kStageRender;
+            else
+            {
+                fprintf(stderr, "unknown stage '%s'\n", name.c_str());
+                return 1;
+            }
+        }
+
+        if (0 == strcmp(option.c_str(), "equal"))
+        {
+            equalOnly = true;
+        }
+
+        if (0 == strcmp(option.c_str(), "heatmap") && index + 1 < argc)
+        {
+            heatmapFileName = argv[++index];
+        }
+    }
+
+    if ((equalOnly || heatmapFileName) && stage == kStageNone)
+        stage = kStageRaw;
+
+    if (index + 2 > argc)
+    {
+        fprintf(stderr, "two files must be specified\n");
+        return 1;
+    }
+
+    const char* fileName1 = argv[index];
+    const char* fileName2 = argv[index + 1];
 
     dng_xmp_sdk::InitializeSDK();
 
@@ -669,13 +1342,101 @@ int main(int argc, const char* argv [])
     compareExif(*exif1, *exif2);
 
     printf(" Main Ifd\n");
-    compareIfd(*info1.fIFD[info1.fMainIndex].Get(), *info2.fIFD[info1.fMainIndex].Get());
+    compareIfd(*info1.fIFD[info1.fMainIndex].Get(), *info2.fIFD[info2.fMainIndex].Get());
 
     printf(" Negative\n");
     compareNegative(*negative1, *negative2);
 
+    int result = 0;
+
+    if (stage != kStageNone)
+    {
+        static const char* stageNames[] = { "", "raw", "stage2", "stage3", "render" };
+        printf(" Pixels (%s)\n", stageNames[stage]);
+
+        const char* proof = NULL;
+        if (stage == kStageRaw && equalOnly)
+            proof = rawIdenticalWithoutDecoding(host1, fileName1, stream1, info1, *negative1,
+                                                fileName2, stream2, info2, *negative2);
+
+        if (proof)
+        {
+            printf("    Identical (%s)\n", proof);
+            dng_xmp_sdk::TerminateSDK();
+            return 0;
+        }
+
+        real64 start = TickTimeInSeconds();
+
+        AutoPtr<dng_image> rendered1;
+        AutoPtr<dng_image> rendered2;
+        const dng_image* image1 = buildStageImage(host1, stream1, info1, *negative1, stage, rendered1);
+        const dng_image* image2 = buildStageImage(host2, stream2, info2, *negative2, stage, rendered2);
+
+        real64 decodeTime = TickTimeInSeconds() - start;
+
+        if (image1->Bounds() != image2->Bounds() ||
+                image1->Planes() != image2->Planes() ||
+                image1->PixelSize() != image2->PixelSize())
+        {
+            printf("    Size: %d x %d x %d %d x %d x %d\n",
+                   image1->Width(), image1->Height(), image1->Planes(),
+                   image2->Width(), image2->Height(), image2->Planes());
+            result = 1;
+        }
+        else
+        {
+            AutoPtr<dng_image> heatmap;
+            if (heatmapFileName && !equalOnly)
+                heatmap.Reset(new dng_simple_image(image1->Bounds(), 1, ttShort, host1.Allocator()));
+
+            start = TickTimeInSeconds();
+
+            PixelCompareTask task(*image1, *image2, equalOnly, heatmap.Get());
+            host1.PerformAreaTask(task, image1->Bounds());
+
+            real64 compareTime = TickTimeInSeconds() - start;
+
+            if (task.Identical())
+            {
+                printf("    Identical\n");
+            }
+            else if (equalOnly)
+            {
+                printf("    Different\n");
+            }
+            else
+            {
+                // Peak value for PSNR: the white level for raw data, else
+                // the range of the pixel type.
+                real64 peak = 65535.0;
+                if (image1->PixelType() == ttFloat)
+                    peak = 1.0;
+                else if (stage == kStageRaw)
+                    peak = negative1->WhiteLevel(0);
+                else if (image1->PixelType() == ttByte)
+                    peak = 255.0;
+
+                uint64 samples = (uint64) image1->Width() * image1->Height() * image1->Planes();
+                real64 mse = task.SumSquares() / samples;
+
+                printf("    DifferentSamples: %llu of %llu\n",
+                       (unsigned long long) task.DiffCount(), (unsigned long long) samples);
+                printf("    MaxAbsDiff: %g\n", task.MaxDiff());
+                printf("    PSNR: %.2f dB\n", 10.0 * log10(peak * peak / mse));
+            }
+
+            if (heatmap.Get())
+                writeHeatmap(host1, *heatmap.Get(), task.MaxDiff(), heatmapFileName);
+
+            fprintf(stderr, "decode %.1f ms, compare %.1f ms\n", decodeTime * 1000.0, compareTime * 1000.0);
+
+            result = task.Identical() ? 0 : 1;
+        }
+    }
+
     dng_xmp_sdk::TerminateSDK();
 
-    return 0;
+    return result;
 }
 
@@ -23,6 +23,8 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 #include <string>
 #include <assert.h>
 
@@ -33,6 +35,7 @@
 #include "dng_color_space.h"
 #include "dng_exceptions.h"
 #include "dng_file_stream.h"
+#include "dngasyncfilestream.h"
 #include "dng_globals.h"
 #include "dng_host.h"
 #include "dng_ifd.h"
@@ -49,14 +52,17 @@
 #include "dng_tag_codes.h"
 #include "dng_tag_types.h"
 #include "dng_tag_values.h"
+#include "dng_utils.h"
 #include "dng_xmp.h"
 #include "dng_xmp_sdk.h"
 
 #include "zlib.h"
 #define CHUNK 65536
 
+#include "dngprofilecache.h"
 #include "exiv2meta.h"
 #include "librawimage.h"
+#include "sharedinputfile.h"
 
 #include "dnghost.h"
 #include "dngimagewriter.h"
@@ -66,6 +72,124 @@ using std::max;
 
 const char* version() { return DNGCONVERT_VERSION_STR; }
 
+// Steps to the value of the option at argv[index]. Returns NULL after
+// printing an error if the command line ends there.
+static const char* optionArgument(int argc, const char* argv [], int& index)
+{
+    if (index + 1 >= argc)
+    {
+        fprintf(stderr, "missing value for %s\n", argv[index]);
+        return NULL;
+    }
+
+    return argv[++index];
+}
+
+// Parses a whole decimal option value. Anything that is not a number in
+// [minValue, maxValue] is rejected with an error.
+static bool parseOptionValue(const char* option, const char* text,
+                             uint32 minValue, uint32 maxValue, uint32& value)
+{
+    if (text == NULL)
+        return false;
+
+    char* end = NULL;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+
+    if (end == text || *end != 0 || errno == ERANGE ||
+        parsed < (long) minValue || parsed > (long) maxValue)
+    {
+        fprintf(stderr, "invalid value for %s: %s, expected %u to %u\n",
+                option, text, minValue, maxValue);
+        return false;
+    }
+
+    value = (uint32) parsed;
+    return true;
+}
+
+// Writes the DNG to memory with a range of raw tile policies and prints
+// encode time, decode time and file size for each, so the tile geometry
+// can be tuned for the readers that will consume the files.
+static void benchmarkTilePolicies(DngHost& host, dng_memory_allocator& memalloc,
+                                  dng_negative& negative, const dng_image_preview& thumbnail,
+                                  const dng_preview_list& previewList)
+{
+    struct BenchPolicy
+    {
+        const char* name;
+        uint32 mode;
+        uint32 value;
+    };
+
+    static const BenchPolicy policies[] =
+    {
+        { "bytes 128K",    dng_raw_tile_policy::kBytesPerTile, 128 * 1024 },
+        { "bytes 512K",    dng_raw_tile_policy::kBytesPerTile, 512 * 1024 },
+        { "bytes 2M",      dng_raw_tile_policy::kBytesPerTile, 2048 * 1024 },
+        { "fixed 256",     dng_raw_tile_policy::kFixedSize,    256 },
+        { "fixed 512",     dng_raw_tile_policy::kFixedSize,    512 },
+        { "fixed 1024",    dng_raw_tile_policy::kFixedSize,    1024 },
+        { "per cpu 1",     dng_raw_tile_policy::kTilesPerCPU,  1 },
+        { "per cpu 2",     dng_raw_tile_policy::kTilesPerCPU,  2 },
+        { "per cpu 4",     dng_raw_tile_policy::kTilesPerCPU,  4 },
+        { "per cpu 8",     dng_raw_tile_policy::kTilesPerCPU,  8 },
+    };
+
+    uint32 cpuCount = DngHost::ProcessorCount();
+
+    fprintf(stderr, "%-12s %6s %11s %12s %10s %10s\n",
+            "policy", "tiles", "tile size", "file bytes", "encode ms", "decode ms");
+
+    for (uint32 i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+    {
+        dng_raw_tile_policy policy;
+        policy.fMode = policies[i].mode;
+        policy.fBytesPerTile = policies[i].value;
+        policy.fTileSize = dng_point(policies[i].value, policies[i].value);
+        policy.fTilesPerCPU = policies[i].value;
+        policy.fCPUCount = cpuCount;
+
+        // Don't let a digest cached by the previous write skew the timing.
+        negative.ClearRawImageDigest();
+
+        dng_image_writer writer;
+        writer.SetRawTilePolicy(policy);
+
+        dng_memory_stream stream(memalloc);
+
+        real64 encodeStart = TickTimeInSeconds();
+        writer.WriteDNG(host, stream, negative, thumbnail, ccJPEG, &previewList);
+        real64 encodeTime = TickTimeInSeconds() - encodeStart;
+
+        real64 decodeStart = TickTimeInSeconds();
+        dng_info info;
+        stream.SetReadPosition(0);
+        info.Parse(host, stream);
+        info.PostParse(host);
+        AutoPtr<dng_negative> decoded(host.Make_dng_negative());
+        decoded->Parse(host, stream, info);
+        decoded->PostParse(host, stream, info);
+        decoded->ReadStage1Image(host, stream, info);
+        real64 decodeTime = TickTimeInSeconds() - decodeStart;
+
+        const dng_ifd& rawIFD = *info.fIFD[info.fMainIndex].Get();
+        char tileSize[32];
+        sprintf(tileSize, "%ux%u", rawIFD.fTileWidth, rawIFD.fTileLength);
+
+        fprintf(stderr, "%-12s %6u %11s %12llu %10.1f %10.1f\n",
+                policies[i].name,
+                rawIFD.TilesAcross() * rawIFD.TilesDown(),
+                tileSize,
+                (unsigned long long) stream.Length(),
+                encodeTime * 1000.0,
+                decodeTime * 1000.0);
+    }
+
+    negative.ClearRawImageDigest();
+}
+
 int main(int argc, const char* argv [])
 {  
     if(argc == 1)
@@ -75,11 +199,20 @@ int main(int argc, const char* argv [])
                 "dngconvert - DNG convertion tool\n"
                 "Usage: %s [options] <dngfile>\n"
                 "Valid options:\n"
+                "  -async               write the output file in the background\n"
                 "  -dcp <filename>      use adobe camera profile\n"
+                "  -deflate <level>     deflate compress the raw data (1-9), DNG 1.4\n"
                 "  -dpl <filename>      include dead pixel list\n"
                 "  -e                   embed original\n"
+                "  -fsync               sync the output file to disk before exiting (implies -async)\n"
                 "  -meta <filename>|-   read exif/xmp from this file, - to disable\n"
-                "  -o <filename>        specify output filename\n",
+                "  -o <filename>        specify output filename\n"
+                "  -packed              store the raw data uncompressed, packed to 10/12/14 bits\n"
+                "  -tile <w>x<h>        use fixed raw tile dimensions\n"
+                "  -tilebytes <n>       target uncompressed bytes per raw tile, at least 1024\n"
+                "  -tilespercpu <n>     target raw tile count per processor, 1 to 4096\n"
+                "  -tilebench           print encode/decode/size for several tile policies\n"
+                "  -v                   print input usage and output write throughput\n",
                 argv[0]);
 
         return -1;
@@ -92,6 +225,15 @@ int main(int argc, const char* argv [])
     const char* profilefilename = NULL;
     const char* exiffilename = NULL;
     bool embedOriginal = false;
+    bool verbose = false;
+    bool tileBenchmark = false;
+    uint32 rawCompression = ccJPEG;
+    uint32 deflateLevel = 6;
+    bool packRawBits = false;
+    bool asyncOutput = false;
+    bool syncOutput = false;
+    dng_raw_tile_policy tilePolicy;
+    tilePolicy.fCPUCount = DngHost::ProcessorCount();
 
     for (index = 1; index < argc && argv [index][0] == '-'; index++)
     {
@@ -99,27 +241,104 @@ int main(int argc, const char* argv [])
 
         if (0 == strcmp(option.c_str(), "o"))
         {
-            outfilename = argv[++index];
+            outfilename = optionArgument(argc, argv, index);
+            if (outfilename == NULL)
+                return 1;
         }
 
         if (0 == strcmp(option.c_str(), "dpl"))
         {
-            deadpixelfilename = argv[++index];
+            deadpixelfilename = optionArgument(argc, argv, index);
+            if (deadpixelfilename == NULL)
+                return 1;
         }
 
         if (0 == strcmp(option.c_str(), "dcp"))
         {
-            profilefilename = argv[++index];
+            profilefilename = optionArgument(argc, argv, index);
+            if (profilefilename == NULL)
+                return 1;
+        }
+
+        if (0 == strcmp(option.c_str(), "deflate"))
+        {
+            rawCompression = ccDeflate;
+            if (!parseOptionValue("-deflate", optionArgument(argc, argv, index),
+                                  1, 9, deflateLevel))
+                return 1;
+        }
+
+        if (0 == strcmp(option.c_str(), "packed"))
+        {
+            rawCompression = ccUncompressed;
+            packRawBits = true;
+        }
+
+        if (0 == strcmp(option.c_str(), "async"))
+        {
+            asyncOutput = true;
+        }
+
+        if (0 == strcmp(option.c_str(), "fsync"))
+        {
+            asyncOutput = true;
+            syncOutput = true;
         }
 
         if (0 == strcmp(option.c_str(), "e"))
         {
             embedOriginal = true;
         }
+
+        if (0 == strcmp(option.c_str(), "v"))
+        {
+            verbose = true;
+        }
+
+        if (0 == strcmp(option.c_str(), "tile"))
+        {
+            const char* value = optionArgument(argc, argv, index);
+            if (value == NULL)
+                return 1;
+
+            unsigned int width, height;
+            int end = 0;
+            if (sscanf(value, "%ux%u%n", &width, &height, &end) != 2 || value[end] != 0 ||
+                value[0] == '-' || width == 0 || height == 0)
+            {
+                fprintf(stderr, "invalid tile size, expected <width>x<height>\n");
+                return 1;
+            }
+            tilePolicy.fMode = dng_raw_tile_policy::kFixedSize;
+            tilePolicy.fTileSize = dng_point(height, width);
+        }
+
+        if (0 == strcmp(option.c_str(), "tilebytes"))
+        {
+            tilePolicy.fMode = dng_raw_tile_policy::kBytesPerTile;
+            if (!parseOptionValue("-tilebytes", optionArgument(argc, argv, index),
+                                  1024, 1024 * 1024 * 1024, tilePolicy.fBytesPerTile))
+                return 1;
+        }
+
+        if (0 == strcmp(option.c_str(), "tilespercpu"))
+        {
+            tilePolicy.fMode = dng_raw_tile_policy::kTilesPerCPU;
+            if (!parseOptionValue("-tilespercpu", optionArgument(argc, argv, index),
+                                  1, 4096, tilePolicy.fTilesPerCPU))
+                return 1;
+        }
+
+        if (0 == strcmp(option.c_str(), "tilebench"))
+        {
+            tileBenchmark = true;
+        }
         
         if (0 == strcmp(option.c_str(), "meta"))
         {
-            exiffilename = argv[++index];
+            exiffilename = optionArgument(argc, argv, index);
+            if (exiffilename == NULL)
+                return 1;
         }
     }
 
@@ -141,8 +360,17 @@ int main(int argc, const char* argv [])
     host.SetSaveLinearDNG(false);
     host.SetKeepOriginalFile(true);
 
-    AutoPtr<dng_image> image(new LibRawImage(filename, memalloc));
+    // Read the input once; LibRaw, Exiv2 and the embed path all work on
+    // views of the same bytes.
+    SharedInputFile input(filename, memalloc);
+
+    AutoPtr<dng_image> image;
+    {
+        AutoPtr<dng_stream> rawStream(input.MakeStream());
+        image.Reset(new LibRawImage(*rawStream, memalloc));
+    }
     LibRawImage* rawImage = static_cast<LibRawImage*>(image.Get());
+    uint64 librawBytesRead = rawImage->BytesRead();
 
     // -----------------------------------------------------------------------------------------
 
@@ -224,14 +452,14 @@ int main(int argc, const char* argv [])
 
     // -------------------------------------------------------------------------------
 
-    AutoPtr<dng_camera_profile> prof(new dng_camera_profile);
+    AutoPtr<dng_camera_profile> prof;
     if (profilefilename != NULL)
     {
-        dng_file_stream profStream(profilefilename);
-        prof->ParseExtended(profStream);
+        prof.Reset(DngProfileCache::Get().ProfileFromFile(profilefilename));
     }
-    else
+    if (!prof.Get())
     {
+        prof.Reset(new dng_camera_profile);
         dng_string profName;
         profName.Append(rawImage->MakeName().Get());
         profName.Append(" ");
@@ -318,12 +546,15 @@ int main(int argc, const char* argv [])
         exiffilename = filename;
     else
         readFromSidecar = true;
+    uint64 exiv2BytesRead = 0;
     // '-x -' disables exif reading
     if (strcmp(exiffilename, "-") != 0)
     {
-        dng_file_stream stream(exiffilename);
+        AutoPtr<dng_stream> stream(readFromSidecar ? new dng_file_stream(exiffilename) : input.MakeStream());
         Exiv2Meta exiv2Meta;
-        exiv2Meta.Parse(host, stream);
+        exiv2Meta.Parse(host, *stream);
+        if (!readFromSidecar)
+            exiv2BytesRead = exiv2Meta.BytesRead();
         exiv2Meta.PostParse(host);
 
         // Exif Data
@@ -376,10 +607,13 @@ int main(int argc, const char* argv [])
 
     // -----------------------------------------------------------------------------------------
 
+    uint64 embedBytesRead = 0;
     if (true == embedOriginal)
     {
-        dng_file_stream originalDataStream(filename);
+        AutoPtr<dng_stream> originalStream(input.MakeStream());
+        dng_stream& originalDataStream = *originalStream;
         originalDataStream.SetReadPosition(0);
+        embedBytesRead = originalDataStream.Length();
 
         uint32 forkLength = static_cast<uint32>(originalDataStream.Length());
         uint32 forkBlocks = static_cast<uint32>(floor((forkLength + 65535.0) / 65536.0));
@@ -482,17 +716,13 @@ int main(int argc, const char* argv [])
     jpegImage.Reset(jpeg_render.Render());
 
     DngImageWriter jpeg_writer;
-    AutoPtr<dng_memory_stream> dms(new dng_memory_stream(gDefaultDNGMemoryAllocator));
-    jpeg_writer.WriteJPEG(host, *dms, *jpegImage.Get(), 75, 1);
-    dms->SetReadPosition(0);
 
     AutoPtr<dng_jpeg_preview> jpeg_preview;
     jpeg_preview.Reset(new dng_jpeg_preview);
     jpeg_preview->fPhotometricInterpretation = piYCbCr;
     jpeg_preview->fPreviewSize               = jpegImage->Size();
     jpeg_preview->fYCbCrSubSampling          = dng_point(2, 2);
-    jpeg_preview->fCompressedData.Reset(host.Allocate(static_cast<uint32>(dms->Length())));
-    dms->Get(jpeg_preview->fCompressedData->Buffer_char(), static_cast<uint32>(dms->Length()));
+    jpeg_preview->fCompressedData.Reset(jpeg_writer.EncodeJPEG(host, *jpegImage.Get(), 75, 1));
     jpeg_preview->fInfo.fApplicationName.Set_ASCII("dngconvert");
     jpeg_preview->fInfo.fApplicationVersion.Set_ASCII(appVersion.Get());
     jpeg_preview->fInfo.fDateTime = dateTimeNow.Encode_ISO_8601();
@@ -500,7 +730,6 @@ int main(int argc, const char* argv [])
 
     AutoPtr<dng_preview> pp(dynamic_cast<dng_preview*>(jpeg_preview.Release()));
     previewList.Append(pp);
-    dms.Reset();
 
     // -----------------------------------------------------------------------------------------
 
@@ -513,7 +742,15 @@ int main(int argc, const char* argv [])
 
     // -----------------------------------------------------------------------------------------
 
+    if (tileBenchmark)
+    {
+        benchmarkTilePolicies(host, memalloc, *negative.Get(), thumbnail, previewList);
+    }
+
     dng_image_writer writer;
+    writer.SetRawTilePolicy(tilePolicy);
+    writer.SetDeflateLevel((int32) deflateLevel);
+    writer.SetPackRawBits(packRawBits);
 
     // output filename: replace raw file extension with .dng
     std::string lpszOutFileName(filename);
@@ -529,9 +766,55 @@ int main(int argc, const char* argv [])
         lpszOutFileName.append(".dng");
     }
 
-    dng_file_stream filestream(lpszOutFileName.c_str(), true);
+    AutoPtr<dng_stream> filestream;
+    DngAsyncFileStream* asyncStream = NULL;
 
-    writer.WriteDNG(host, filestream, *negative.Get(), thumbnail, ccJPEG, &previewList);
+    if (asyncOutput)
+    {
+        // Preallocate for the uncompressed raw data plus room for the
+        // previews and metadata; the file is trimmed on close.
+        const dng_image* rawImage = negative->Stage1Image();
+        uint64 estimatedSize = (uint64) rawImage->Bounds().W() * rawImage->Bounds().H() *
+                               rawImage->Planes() * rawImage->PixelSize() + 4 * 1024 * 1024;
+        if (rawCompression == ccJPEG)
+            estimatedSize /= 2;
+
+        asyncStream = new DngAsyncFileStream(lpszOutFileName.c_str(), estimatedSize, syncOutput);
+        filestream.Reset(asyncStream);
+    }
+    else
+    {
+        filestream.Reset(new dng_file_stream(lpszOutFileName.c_str(), true));
+    }
+
+    real64 writeStart = TickTimeInSeconds();
+
+    writer.WriteDNG(host, *filestream.Get(), *negative.Get(), thumbnail, rawCompression, &previewList);
+
+    filestream->Flush();
+    uint64 outputLength = filestream->Length();
+
+    if (asyncStream)
+        asyncStream->Close();
+
+    real64 writeTime = TickTimeInSeconds() - writeStart;
+
+    if (verbose)
+    {
+        fprintf(stderr, "output: %llu bytes written in %.1f ms (%.2f GB/s)\n",
+                (unsigned long long) outputLength,
+                writeTime * 1000.0,
+                writeTime > 0.0 ? outputLength / writeTime / 1.0e9 : 0.0);
+        if (asyncStream)
+            fprintf(stderr, "output: %.1f ms stalled on background writes, %.1f ms in fsync\n",
+                    asyncStream->StallTime() * 1000.0,
+                    asyncStream->SyncTime() * 1000.0);
+        fprintf(stderr, "input: %llu bytes read from storage, %llu served to LibRaw, %llu to Exiv2, %llu to embed\n",
+                (unsigned long long) input.BytesRead(),
+                (unsigned long long) librawBytesRead,
+                (unsigned long long) exiv2BytesRead,
+                (unsigned long long) embedBytesRead);
+    }
 
     dng_xmp_sdk::TerminateSDK();
 
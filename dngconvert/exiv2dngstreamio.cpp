@@ -41,7 +41,7 @@ using std::min;
 using std::max;
 
 Exiv2DngStreamIO::Exiv2DngStreamIO(dng_stream& stream, dng_memory_allocator &allocator)
-    : m_Allocator(allocator), m_MemBlock(0), m_Stream(stream)
+    : m_Allocator(allocator), m_MemBlock(0), m_Stream(stream), m_MappedData(NULL), m_BytesRead(0)
 {
 }
 
@@ -106,11 +106,13 @@ long Exiv2DngStreamIO::read(Exiv2::byte* buf, long rcount)
     uint64 oldPos = m_Stream.Position();
     uint64 bytes = min(static_cast<uint64>(rcount), m_Stream.Length() - oldPos);
     m_Stream.Get((void*)buf, static_cast<uint32>(bytes));
+    m_BytesRead += bytes;
     return (long)(m_Stream.Position() - oldPos);
 }
 
 int Exiv2DngStreamIO::getb()
 {
+    m_BytesRead++;
     return m_Stream.Get_uint8();
 }
 
@@ -155,14 +157,30 @@ int Exiv2DngStreamIO::seek(long offset, Position pos)
     return 0;
 }
 
-Exiv2::byte* Exiv2DngStreamIO::mmap(bool /*isWriteable*/)
+Exiv2::byte* Exiv2DngStreamIO::mmap(bool isWriteable)
 {
+    m_BytesRead += m_Stream.Length();
+
+    // A stream that already holds all of its data in memory can be handed
+    // out as is, as long as nobody will write to it.
+    if (!isWriteable && m_Stream.Data() != NULL)
+    {
+        m_MappedData = (const Exiv2::byte*)m_Stream.Data();
+        return const_cast<Exiv2::byte*>(m_MappedData);
+    }
+
     m_MemBlock = std::auto_ptr<dng_memory_block>(m_Stream.AsMemoryBlock(m_Allocator));
     return (Exiv2::byte*)m_MemBlock.get()->Buffer();
 }
 
 int Exiv2DngStreamIO::munmap()
 {
+    if (m_MappedData != NULL)
+    {
+        m_MappedData = NULL;
+        return 0;
+    }
+
     m_Stream.SetReadPosition(0);
     m_Stream.SetLength(0);
     m_Stream.Put(m_MemBlock.get()->Buffer(), m_MemBlock.get()->LogicalSize());
@@ -54,8 +54,16 @@ public:
 #endif
     virtual Exiv2::BasicIo::AutoPtr temporary() const;
 
+    // Bytes handed to Exiv2 so far, counting a mapping as the whole stream.
+    uint64 BytesRead() const
+    {
+        return m_BytesRead;
+    }
+
 protected:
     dng_memory_allocator &m_Allocator;
     std::auto_ptr<dng_memory_block> m_MemBlock;
     dng_stream& m_Stream;
+    const Exiv2::byte* m_MappedData;
+    uint64 m_BytesRead;
 };
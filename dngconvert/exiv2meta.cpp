@@ -183,7 +183,8 @@ Exiv2Meta::Exiv2Meta() :
     m_Exif(),
     m_XMP(),
     m_MakerNote(),
-    m_MakerNoteOffset(0)
+    m_MakerNoteOffset(0),
+    m_BytesRead(0)
 {
 
 }
@@ -199,7 +200,8 @@ void Exiv2Meta::Parse(dng_host &host, dng_stream &stream)
 
     try
     {
-        Exiv2::BasicIo::AutoPtr exiv2Stream(new Exiv2DngStreamIO(stream));
+        Exiv2DngStreamIO* io = new Exiv2DngStreamIO(stream);
+        Exiv2::BasicIo::AutoPtr exiv2Stream(io);
         Exiv2::Image::AutoPtr image = Exiv2::ImageFactory::open(exiv2Stream);
 
         if (!image.get())
@@ -209,6 +211,7 @@ void Exiv2Meta::Parse(dng_host &host, dng_stream &stream)
         }
 
         image->readMetadata();
+        m_BytesRead = io->BytesRead();
 
         // Image comments ---------------------------------
         std::string imageComments = image->comment();
@@ -75,10 +75,17 @@ public:
         return m_MakerNoteByteOrder;
     }
 
+    // Bytes Exiv2 read from the stream passed to Parse.
+    uint64 BytesRead() const
+    {
+        return m_BytesRead;
+    }
+
 private:
     AutoPtr<dng_exif> m_Exif;
     AutoPtr<dng_xmp> m_XMP;
     AutoPtr<dng_memory_block> m_MakerNote;
     uint32 m_MakerNoteOffset;
     dng_string m_MakerNoteByteOrder;
+    uint64 m_BytesRead;
 };
@@ -21,11 +21,13 @@
 
 #include "dng_exceptions.h"
 
+#include <string.h>
+
 using std::min;
 using std::max;
 
 LibRawDngDataStream::LibRawDngDataStream(dng_stream& stream)
-    : m_Stream(stream)
+    : m_Stream(stream), m_BytesRead(0)
 {
 }
 
@@ -47,6 +49,7 @@ int LibRawDngDataStream::read(void* ptr, size_t size, size_t nmemb)
     uint64 oldPos = m_Stream.Position();
     uint64 bytes = min(static_cast<uint64>(size*nmemb), m_Stream.Length() - oldPos);
     m_Stream.Get(ptr, static_cast<uint32>(bytes));
+    m_BytesRead += bytes;
     return int((m_Stream.Position() - oldPos + size - 1) / size);
 }
 
@@ -103,6 +106,25 @@ int LibRawDngDataStream::get_char()
     if (substream)
         return substream->get_char();
 */
+    uint64 pos = m_Stream.Position();
+
+    // Streams over memory are read directly, without dng_stream's
+    // per-byte bookkeeping.
+    const uint8* data = static_cast<const uint8*>(m_Stream.Data());
+    if (data != NULL)
+    {
+        if (pos >= m_Stream.Length())
+            return EOF;
+
+        m_Stream.SetReadPosition(pos + 1);
+        m_BytesRead++;
+        return data[pos];
+    }
+
+    if (pos >= m_Stream.Length())
+        return EOF;
+
+    m_BytesRead++;
     return m_Stream.Get_uint8();
 }
 
@@ -112,21 +134,46 @@ char* LibRawDngDataStream::gets(char* str, int size)
     if (substream)
         return substream->gets(str, size);
 */
-    memset(str, 0, size);
+    // Same contract as fgets: at most size - 1 bytes, up to and including
+    // the first newline, and NULL at end of stream.
+    if (size <= 0)
+        return NULL;
 
-    int32 index = 0;
+    uint64 pos = m_Stream.Position();
+    uint64 length = m_Stream.Length();
+
+    if (pos >= length)
+        return NULL;
 
-    while (true)
+    uint32 count = static_cast<uint32>(min(static_cast<uint64>(size - 1), length - pos));
+
+    const uint8* data = static_cast<const uint8*>(m_Stream.Data());
+    if (data != NULL)
     {
-        char c = (char)m_Stream.Get_uint8();
+        const void* newline = memchr(data + pos, '\n', count);
+        if (newline != NULL)
+            count = static_cast<uint32>(static_cast<const uint8*>(newline) - (data + pos)) + 1;
 
-        if (index + 1 < size)
+        memcpy(str, data + pos, count);
+        m_Stream.SetReadPosition(pos + count);
+    }
+    else
+    {
+        uint32 index = 0;
+        while (index < count)
+        {
+            char c = (char)m_Stream.Get_uint8();
             str[index++] = c;
 
-        if (c == '\n')
-            break;
+            if (c == '\n')
+                break;
+        }
+        count = index;
     }
 
+    str[count] = 0;
+    m_BytesRead += count;
+
     return str;
 }
 
@@ -46,6 +46,12 @@ public:
     virtual char* gets(char* str, int size);
     virtual int scanf_one(const char* fmt, void* val);
     virtual int eof();
+
+    // Bytes handed to LibRaw so far.
+    uint64 BytesRead() const
+    {
+        return m_BytesRead;
+    }
     
 #if (LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0,14))
     virtual void* make_jas_stream();
@@ -54,4 +60,5 @@ public:
 
 protected:
     dng_stream& m_Stream;
+    uint64 m_BytesRead;
 };
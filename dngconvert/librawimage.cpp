@@ -25,6 +25,8 @@
 
 #include "libraw/libraw.h"
 
+#include <math.h>
+
 using std::min;
 using std::max;
 
@@ -32,7 +34,8 @@ LibRawImage::LibRawImage(const char *filename, dng_memory_allocator &allocator)
     :	dng_image(dng_rect(0, 0), 0, ttShort),
       m_Allocator(allocator),
       m_Buffer(),
-      m_Memory()
+      m_Memory(),
+      m_BytesRead(0)
 {
     dng_file_stream stream(filename);
     Parse(stream);
@@ -42,61 +45,70 @@ LibRawImage::LibRawImage(dng_stream &stream, dng_memory_allocator &allocator)
     :	dng_image(dng_rect(0, 0), 0, ttShort),
       m_Allocator(allocator),
       m_Buffer(),
-      m_Memory()
+      m_Memory(),
+      m_BytesRead(0)
 {
     Parse(stream);
 }
 
-void LibRawImage::Parse(dng_stream &stream)
+// LibRaw with access to the internal parameters needed to work out the
+// developed image size from an already opened file.
+class LibRawProcessor : public LibRaw
 {
-    AutoPtr<LibRawDngDataStream> rawStream(new LibRawDngDataStream(stream));
-    AutoPtr<LibRaw> rawProcessor(new LibRaw());
-
-#if (LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0,14))
+public:
+    // The size the old adjust_sizes_info_only() pass reported, without
+    // having to open the file a second time for unpack(). Mirrors its Fuji
+    // and pixel aspect handling; shrink is always 0 with our parameters.
+    void FinalSize(uint32 &width, uint32 &height)
     {
-        rawProcessor->imgdata.params.user_flip = 0;
-    }
+#if (LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0,14))
+        // The state saved by open_datastream(), which is what
+        // adjust_sizes_info_only() starts from.
+        const libraw_image_sizes_t &sizes = imgdata.rawdata.sizes;
+        uint32 fujiWidth = imgdata.rawdata.ioparams.fuji_width;
+#else
+        const libraw_image_sizes_t &sizes = imgdata.sizes;
+        uint32 fujiWidth = libraw_internal_data.internal_output_params.fuji_width;
 #endif
 
-    int ret = rawProcessor->open_datastream(rawStream.Get());
-    if (ret != LIBRAW_SUCCESS)
-    {
-        printf("Cannot open stream: %s\n", libraw_strerror(ret));
-        rawProcessor->recycle();
-        return;
-    }
-
-    ret = rawProcessor->adjust_sizes_info_only();
-    if (ret != LIBRAW_SUCCESS)
-    {
-        printf("LibRaw: failed to run adjust_sizes_info_only: %s\n", libraw_strerror(ret));
-        rawProcessor->recycle();
-        return;
-    }
+        width = sizes.width;
+        height = sizes.height;
 
-    uint32 finalWidth = 0;
-    uint32 finalHeight = 0;
+        if (imgdata.params.use_fuji_rotate)
+        {
+            if (fujiWidth != 0)
+            {
+                fujiWidth = fujiWidth - 1;
+                width = (ushort)(fujiWidth / sqrt(0.5));
+                height = (ushort)((sizes.height - fujiWidth) / sqrt(0.5));
+            }
+            else
+            {
+                if (sizes.pixel_aspect < 0.995)
+                    height = (ushort)(height / sizes.pixel_aspect + 0.5);
+                if (sizes.pixel_aspect > 1.005)
+                    width = (ushort)(width * sizes.pixel_aspect + 0.5);
+            }
+        }
 
-#if (LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0,14))
-    finalWidth = rawProcessor->imgdata.sizes.iwidth;
-    finalHeight = rawProcessor->imgdata.sizes.iheight;
-#else
-    if ((rawProcessor->imgdata.sizes.flip == 5) || (rawProcessor->imgdata.sizes.flip == 6))
-    {
-        finalHeight = rawProcessor->imgdata.sizes.iwidth;
-        finalWidth = rawProcessor->imgdata.sizes.iheight;
-    }
-    else
-    {
-        finalHeight = rawProcessor->imgdata.sizes.iheight;
-        finalWidth = rawProcessor->imgdata.sizes.iwidth;
-    }
+#if !(LIBRAW_COMPILE_CHECK_VERSION_NOTLESS(0,14))
+        // Before 0.14 the first pass kept the file's orientation, and the
+        // size was swapped for portrait raws.
+        if ((sizes.flip == 5) || (sizes.flip == 6))
+        {
+            uint32 temp = width;
+            width = height;
+            height = temp;
+        }
 #endif
+    }
+};
 
-    rawProcessor->recycle();
+void LibRawImage::Parse(dng_stream &stream)
+{
+    AutoPtr<LibRawDngDataStream> rawStream(new LibRawDngDataStream(stream));
+    AutoPtr<LibRawProcessor> rawProcessor(new LibRawProcessor());
 
-    rawStream.Get()->seek(0, SEEK_SET);
-    
     rawProcessor->imgdata.params.output_bps = 16;
 //    rawProcessor->imgdata.params.document_mode = 2;
     rawProcessor->imgdata.params.shot_select = 0;
@@ -106,7 +118,7 @@ void LibRawImage::Parse(dng_stream &stream)
     }
 #endif
 
-    ret = rawProcessor->open_datastream(rawStream.Get());
+    int ret = rawProcessor->open_datastream(rawStream.Get());
     if (ret != LIBRAW_SUCCESS)
     {
         printf("Cannot open stream: %s\n", libraw_strerror(ret));
@@ -122,6 +134,10 @@ void LibRawImage::Parse(dng_stream &stream)
         return;
     }
 
+    uint32 finalWidth = 0;
+    uint32 finalHeight = 0;
+    rawProcessor->FinalSize(finalWidth, finalHeight);
+
     libraw_image_sizes_t *sizes = NULL;
     libraw_iparams_t *iparams = NULL;
     libraw_colordata_t *colors = NULL;
@@ -472,6 +488,8 @@ void LibRawImage::Parse(dng_stream &stream)
     }
     }
 
+    m_BytesRead = rawStream->BytesRead();
+
     rawProcessor->recycle();
 }
 
@@ -482,7 +500,8 @@ LibRawImage::LibRawImage(const dng_rect &bounds,
     : dng_image(bounds, planes, pixelType),
       m_Allocator(allocator),
       m_Buffer(),
-      m_Memory()
+      m_Memory(),
+      m_BytesRead(0)
 {
     uint32 pixelSize = TagTypeSize(pixelType);
 
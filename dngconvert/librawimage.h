@@ -59,6 +59,12 @@ public:
     uint32 Pattern() const;
     ColorKeyCode ColorKey(uint32 plane) const;
 
+    // Bytes LibRaw read from the input stream.
+    uint64 BytesRead() const
+    {
+        return m_BytesRead;
+    }
+
 protected:
     virtual void AcquireTileBuffer(dng_tile_buffer &buffer, const dng_rect &area, bool dirty) const;
 
@@ -86,4 +92,5 @@ protected:
     dng_orientation m_BaseOrientation;
     uint32 m_Pattern;
     ColorKeyCode m_CFAPlaneColor[4];
+    uint64 m_BytesRead;
 };
@@ -0,0 +1,91 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "sharedinputfile.h"
+
+#include "dng_file_stream.h"
+
+#if !qWinOS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SharedInputFile::SharedInputFile(const char* filename, dng_memory_allocator &allocator)
+    : m_FileName(filename), m_Data(NULL), m_Length(0), m_BytesRead(0), m_Memory(), m_Mapped(false)
+{
+#if !qWinOS
+    int fd = ::open(filename, O_RDONLY);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0 && static_cast<uint64>(st.st_size) <= 0xFFFFFFFF)
+        {
+            void* data = ::mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                // The whole file is consumed, mostly front to back.
+                madvise(data, static_cast<size_t>(st.st_size), MADV_WILLNEED);
+
+                m_Data = static_cast<const uint8*>(data);
+                m_Length = static_cast<uint32>(st.st_size);
+                m_BytesRead = m_Length;
+                m_Mapped = true;
+            }
+        }
+        ::close(fd);
+    }
+
+    if (m_Mapped)
+        return;
+#endif
+
+    dng_file_stream stream(filename);
+
+    m_Length = stream.Length();
+
+    // Too large for a memory-backed stream; MakeStream opens the file.
+    if (m_Length > 0xFFFFFFFF)
+        return;
+
+    m_Memory.Reset(allocator.Allocate(static_cast<uint32>(m_Length)));
+
+    stream.SetReadPosition(0);
+    stream.Get(m_Memory->Buffer(), static_cast<uint32>(m_Length));
+
+    m_Data = m_Memory->Buffer_uint8();
+    m_BytesRead = m_Length;
+}
+
+SharedInputFile::~SharedInputFile(void)
+{
+#if !qWinOS
+    if (m_Mapped)
+        ::munmap(const_cast<uint8*>(m_Data), static_cast<size_t>(m_Length));
+#endif
+}
+
+dng_stream* SharedInputFile::MakeStream() const
+{
+    if (m_Data)
+        return new dng_stream(m_Data, static_cast<uint32>(m_Length));
+
+    return new dng_file_stream(m_FileName.c_str());
+}
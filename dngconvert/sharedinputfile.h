@@ -0,0 +1,75 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "dng_auto_ptr.h"
+#include "dng_memory.h"
+#include "dng_stream.h"
+
+// The input raw file, mapped (or, where mapping is not available, read)
+// into memory exactly once. LibRaw, Exiv2 and the embed path each get
+// their own dng_stream view of it, which reads straight from the shared
+// bytes without touching the file again.
+//
+// Files of 4 GB or more do not fit a memory-backed dng_stream. They are
+// not loaded; each view is then a dng_file_stream of its own, as before
+// the file was shared.
+class SharedInputFile
+{
+public:
+    SharedInputFile(const char* filename, dng_memory_allocator &allocator = gDefaultDNGMemoryAllocator);
+    ~SharedInputFile(void);
+
+    // NULL when the file is too large to be shared.
+    const uint8* Data() const
+    {
+        return m_Data;
+    }
+
+    uint64 Length() const
+    {
+        return m_Length;
+    }
+
+    // New read-only stream over the shared bytes, owned by the caller.
+    // Views have independent positions, so they can be used concurrently.
+    dng_stream* MakeStream() const;
+
+    // Bytes actually read from storage (or mapped) to fill the buffer; 0
+    // when the views read the file themselves.
+    uint64 BytesRead() const
+    {
+        return m_BytesRead;
+    }
+
+private:
+    std::string m_FileName;
+    const uint8* m_Data;
+    uint64 m_Length;
+    uint64 m_BytesRead;
+    AutoPtr<dng_memory_block> m_Memory;
+    bool m_Mapped;
+
+    // Hidden copy constructor and assignment operator.
+    SharedInputFile(const SharedInputFile&);
+    SharedInputFile& operator=(const SharedInputFile&);
+};
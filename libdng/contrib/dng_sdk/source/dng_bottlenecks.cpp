@@ -51,6 +51,7 @@ dng_suite gDNGSuite =
 	RefBaselineABCtoRGB,
 	RefBaselineABCDtoRGB,
 	RefBaselineHueSatMap,
+	RefBaselineHueSatTable,
 	RefBaselineRGBtoGray,
 	RefBaselineRGBtoRGB,
 	RefBaseline1DTable,
@@ -65,7 +66,11 @@ dng_suite gDNGSuite =
 	RefEqualArea32,
 	RefVignetteMask16,
 	RefVignette16,
-	RefMapArea16
+	RefMapArea16,
+	RefGainMapRow32,
+	RefPackBits16,
+	RefUnpackBits16,
+	RefDiffArea16
 	};
 
 /*****************************************************************************/
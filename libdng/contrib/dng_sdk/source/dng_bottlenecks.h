@@ -386,6 +386,16 @@ typedef void (BaselineHueSatMapProc)
 			  uint32 count,
 			  const dng_hue_sat_map &lut);
 			 
+typedef void (BaselineHueSatTableProc)
+			 (const real32 *sPtrR,
+			  const real32 *sPtrG,
+			  const real32 *sPtrB,
+			  real32 *dPtrR,
+			  real32 *dPtrG,
+			  real32 *dPtrB,
+			  uint32 count,
+			  const dng_hue_sat_table &table);
+			 
 /*****************************************************************************/
 
 typedef void (BaselineGrayToRGBProc)
@@ -551,6 +561,50 @@ typedef void (MapArea16Proc)
 
 /*****************************************************************************/
 
+typedef void (GainMapRow32Proc)
+			 (real32 *dPtr,
+			  const real32 *gPtr1,
+			  const real32 *gPtr2,
+			  uint32 count,
+			  int32 dColStep,
+			  real32 gFract);
+
+/*****************************************************************************/
+
+typedef void (PackBits16Proc)
+			 (const uint16 *sPtr,
+			  uint8 *dPtr,
+			  uint32 count,
+			  uint32 bits);
+
+typedef void (UnpackBits16Proc)
+			 (const uint8 *sPtr,
+			  uint16 *dPtr,
+			  uint32 count,
+			  uint32 bits);
+
+/*****************************************************************************/
+
+typedef void (DiffArea16Proc)
+			 (const uint16 *sPtr,
+			  const uint16 *dPtr,
+			  uint32 rows,
+			  uint32 cols,
+			  uint32 planes,
+			  int32 sRowStep,
+			  int32 sColStep,
+			  int32 sPlaneStep,
+			  int32 dRowStep,
+			  int32 dColStep,
+			  int32 dPlaneStep,
+			  uint16 *mPtr,
+			  int32 mRowStep,
+			  uint32 *maxDiff,
+			  uint64 *diffCount,
+			  uint64 *sumSquares);
+
+/*****************************************************************************/
+
 struct dng_suite	
 	{
 	ZeroBytesProc			*ZeroBytes;
@@ -583,6 +637,7 @@ struct dng_suite
 	BaselineABCtoRGBProc	*BaselineABCtoRGB;
 	BaselineABCDtoRGBProc	*BaselineABCDtoRGB;
 	BaselineHueSatMapProc	*BaselineHueSatMap;
+	BaselineHueSatTableProc	*BaselineHueSatTable;
 	BaselineGrayToRGBProc	*BaselineRGBtoGray;
 	BaselineRGBtoRGBProc	*BaselineRGBtoRGB;
 	Baseline1DTableProc		*Baseline1DTable;
@@ -598,6 +653,10 @@ struct dng_suite
 	VignetteMask16Proc		*VignetteMask16;
 	Vignette16Proc			*Vignette16;
 	MapArea16Proc			*MapArea16;
+	GainMapRow32Proc		*GainMapRow32;
+	PackBits16Proc			*PackBits16;
+	UnpackBits16Proc		*UnpackBits16;
+	DiffArea16Proc			*DiffArea16;
 	};
 
 /*****************************************************************************/
@@ -1336,6 +1395,27 @@ inline void DoBaselineHueSatMap (const real32 *sPtrR,
 	
 	}
 
+inline void DoBaselineHueSatTable (const real32 *sPtrR,
+								   const real32 *sPtrG,
+								   const real32 *sPtrB,
+								   real32 *dPtrR,
+								   real32 *dPtrG,
+								   real32 *dPtrB,
+								   uint32 count,
+								   const dng_hue_sat_table &table)
+	{
+	
+	(gDNGSuite.BaselineHueSatTable) (sPtrR,
+									 sPtrG,
+									 sPtrB,
+									 dPtrR,
+									 dPtrG,
+									 dPtrB,
+									 count,
+									 table);
+	
+	}
+
 /*****************************************************************************/
 
 inline void DoBaselineRGBtoGray (const real32 *sPtrR,
@@ -1665,6 +1745,99 @@ inline void DoMapArea16 (uint16 *dPtr,
 
 /*****************************************************************************/
 
+inline void DoGainMapRow32 (real32 *dPtr,
+							const real32 *gPtr1,
+							const real32 *gPtr2,
+							uint32 count,
+							int32 dColStep,
+							real32 gFract)
+	{
+	
+	(gDNGSuite.GainMapRow32) (dPtr,
+							  gPtr1,
+							  gPtr2,
+							  count,
+							  dColStep,
+							  gFract);
+
+	}
+
+/*****************************************************************************/
+
+inline void DoPackBits16 (const uint16 *sPtr,
+						  uint8 *dPtr,
+						  uint32 count,
+						  uint32 bits)
+	{
+	
+	(gDNGSuite.PackBits16) (sPtr,
+							dPtr,
+							count,
+							bits);
+
+	}
+
+/*****************************************************************************/
+
+inline void DoUnpackBits16 (const uint8 *sPtr,
+							uint16 *dPtr,
+							uint32 count,
+							uint32 bits)
+	{
+	
+	(gDNGSuite.UnpackBits16) (sPtr,
+							  dPtr,
+							  count,
+							  bits);
+
+	}
+
+/*****************************************************************************/
+
+// Compares two areas and accumulates the largest absolute difference, the
+// number of differing samples and the sum of squared differences. If mPtr
+// is not NULL, the largest difference across the planes of each pixel is
+// stored there.
+
+inline void DoDiffArea16 (const uint16 *sPtr,
+						  const uint16 *dPtr,
+						  uint32 rows,
+						  uint32 cols,
+						  uint32 planes,
+						  int32 sRowStep,
+						  int32 sColStep,
+						  int32 sPlaneStep,
+						  int32 dRowStep,
+						  int32 dColStep,
+						  int32 dPlaneStep,
+						  uint16 *mPtr,
+						  int32 mRowStep,
+						  uint32 *maxDiff,
+						  uint64 *diffCount,
+						  uint64 *sumSquares)
+	{
+	
+	(gDNGSuite.DiffArea16) (sPtr,
+							dPtr,
+							rows,
+							cols,
+							planes,
+							sRowStep,
+							sColStep,
+							sPlaneStep,
+							dRowStep,
+							dColStep,
+							dPlaneStep,
+							mPtr,
+							mRowStep,
+							maxDiff,
+							diffCount,
+							sumSquares);
+
+	}
+
+/*****************************************************************************/
+
 #endif
 	
 /*****************************************************************************/
@@ -38,6 +38,7 @@ class dng_exif;
 class dng_fingerprint;
 class dng_host;
 class dng_hue_sat_map;
+class dng_hue_sat_table;
 class dng_ifd;
 class dng_image;
 class dng_image_preview;
@@ -17,6 +17,12 @@
 
 #include "dng_exceptions.h"
 
+#if !qWinOS
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 /*****************************************************************************/
 
 dng_file_stream::dng_file_stream (const char *filename,
@@ -50,6 +56,22 @@ dng_file_stream::dng_file_stream (const char *filename,
 		#endif
 
 		}
+		
+	if (!output)
+		{
+		
+		// Reads are buffered by dng_stream, so let that buffer grow on
+		// sequential scans instead of double buffering in stdio.
+		
+		SetMaxBufferSize (kHugeBufferSize);
+		
+		#if !qWinOS
+		
+		setvbuf (fFile, NULL, _IONBF, 0);
+		
+		#endif
+		
+		}
 	
 	}
 		
@@ -89,6 +111,39 @@ void dng_file_stream::DoRead (void *data,
 							  uint64 offset)
 	{
 	
+	#if !qWinOS
+	
+	// One positioned read instead of a seek plus a read.
+	
+	int fd = fileno (fFile);
+	
+	uint8 *dPtr = (uint8 *) data;
+	
+	while (count)
+		{
+		
+		ssize_t bytesRead = pread (fd, dPtr, count, (off_t) offset);
+		
+		if (bytesRead < 0 && errno == EINTR)
+			{
+			continue;
+			}
+		
+		if (bytesRead <= 0)
+			{
+			
+			ThrowReadFile ();
+
+			}
+			
+		dPtr   += bytesRead;
+		offset += bytesRead;
+		count  -= (uint32) bytesRead;
+		
+		}
+	
+	#else
+	
 	if (fseek (fFile, (uint32) offset, SEEK_SET) != 0)
 		{
 		
@@ -104,6 +159,30 @@ void dng_file_stream::DoRead (void *data,
 		ThrowReadFile ();
 
 		}
+		
+	#endif
+	
+	}
+
+/*****************************************************************************/
+
+void dng_file_stream::Prefetch (uint64 offset,
+								uint64 count)
+	{
+	
+	#if defined(POSIX_FADV_WILLNEED)
+	
+	posix_fadvise (fileno (fFile),
+				   (off_t) offset,
+				   (off_t) count,
+				   POSIX_FADV_WILLNEED);
+	
+	#else
+	
+	(void) offset;
+	(void) count;
+	
+	#endif
 	
 	}
 		
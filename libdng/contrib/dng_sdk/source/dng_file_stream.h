@@ -47,6 +47,9 @@ class dng_file_stream: public dng_stream
 						 uint32 bufferSize = kDefaultBufferSize);
 		
 		virtual ~dng_file_stream ();
+		
+		virtual void Prefetch (uint64 offset,
+							   uint64 count);
 	
 	protected:
 	
@@ -15,6 +15,7 @@
 
 #include "dng_gain_map.h"
 
+#include "dng_bottlenecks.h"
 #include "dng_exceptions.h"
 #include "dng_globals.h"
 #include "dng_host.h"
@@ -523,8 +524,79 @@ void dng_opcode_GainMap::PutData (dng_stream &stream) const
 		
 /*****************************************************************************/
 
+static void FindGainMapIndex (real64 indexF,
+							  int32 points,
+							  uint32 &index1,
+							  uint32 &index2,
+							  real32 &fract)
+	{
+	
+	if (indexF <= 0.0)
+		{
+		
+		index1 = 0;
+		index2 = 0;
+		
+		fract = 0.0f;
+		
+		}
+		
+	else
+		{
+		
+		index1 = (uint32) indexF;
+		
+		if ((int32) index1 >= points - 1)
+			{
+			
+			index1 = points - 1;
+			index2 = index1;
+			
+			fract = 0.0f;
+			
+			}
+			
+		else
+			{
+			
+			index2 = index1 + 1;
+			
+			fract = (real32) (indexF - (real64) index1);
+			
+			}
+			
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void dng_opcode_GainMap::Prepare (dng_negative & /* negative */,
+								  uint32 threadCount,
+								  const dng_point &tileSize,
+								  const dng_rect & /* imageBounds */,
+								  uint32 /* imagePlanes */,
+								  uint32 /* bufferPixelType */,
+								  dng_memory_allocator &allocator)
+	{
+	
+	// Column indices, column fractions and two expanded gain rows.
+	
+	uint32 bufferSize = tileSize.h * 4 * sizeof (real32);
+	
+	for (uint32 threadIndex = 0; threadIndex < threadCount; threadIndex++)
+		{
+		
+		fRowBuffers [threadIndex] . Reset (allocator.Allocate (bufferSize));
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
 void dng_opcode_GainMap::ProcessArea (dng_negative & /* negative */,
-									  uint32 /* threadIndex */,
+									  uint32 threadIndex,
 									  dng_pixel_buffer &buffer,
 									  const dng_rect &dstArea,
 									  const dng_rect &imageBounds)
@@ -535,43 +607,114 @@ void dng_opcode_GainMap::ProcessArea (dng_negative & /* negative */,
 	if (overlap.NotEmpty ())
 		{
 		
+		const dng_gain_map &map = *fGainMap;
+		
 		uint32 cols = overlap.W ();
 		
 		uint32 colPitch = fAreaSpec.ColPitch ();
 		
+		uint32 count = (cols + colPitch - 1) / colPitch;
+		
+		uint32 *colIndex = fRowBuffers [threadIndex]->Buffer_uint32 ();
+		
+		real32 *colFract = fRowBuffers [threadIndex]->Buffer_real32 () + count;
+		real32 *gainRow1 = colFract + count;
+		real32 *gainRow2 = gainRow1 + count;
+		
+		// The horizontal position within the map only depends on the column,
+		// so find it once for every processed column in this area.
+		
+		const real64 scaleV = 1.0 / imageBounds.H ();
+		const real64 scaleH = 1.0 / imageBounds.W ();
+		
+		const real64 offsetV = 0.5 - imageBounds.t;
+		const real64 offsetH = 0.5 - imageBounds.l;
+		
+		for (uint32 j = 0; j < count; j++)
+			{
+			
+			int32 col = overlap.l + (int32) (j * colPitch);
+			
+			real64 colIndexF = (scaleH * (col + offsetH) -
+								map.Origin ().h) / map.Spacing ().h;
+			
+			uint32 index2;
+			
+			FindGainMapIndex (colIndexF,
+							  map.Points ().h,
+							  colIndex [j],
+							  index2,
+							  colFract [j]);
+			
+			}
+		
 		for (uint32 plane = fAreaSpec.Plane ();
 			 plane < fAreaSpec.Plane () + fAreaSpec.Planes () &&
 			 plane < buffer.Planes ();
 			 plane++)
 			{
 			
-			uint32 mapPlane = Min_uint32 (plane, fGainMap->Planes () - 1);
+			uint32 mapPlane = Min_uint32 (plane, map.Planes () - 1);
+			
+			// Map rows currently expanded into gainRow1 and gainRow2.
+			
+			uint32 expanded1 = 0xFFFFFFFF;
+			uint32 expanded2 = 0xFFFFFFFF;
 			
 			for (int32 row = overlap.t; row < overlap.b; row += fAreaSpec.RowPitch ())
 				{
 				
-				real32 *dPtr = buffer.DirtyPixel_real32 (row, overlap.l, plane);
+				real64 rowIndexF = (scaleV * (row + offsetV) -
+									map.Origin ().v) / map.Spacing ().v;
 				
-				dng_gain_map_interpolator interp (*fGainMap,
-												  imageBounds,
-												  row,
-												  overlap.l,
-												  mapPlane);
-										   
-				for (uint32 col = 0; col < cols; col += colPitch)
+				uint32 rowIndex1;
+				uint32 rowIndex2;
+				real32 rowFract;
+				
+				FindGainMapIndex (rowIndexF,
+								  map.Points ().v,
+								  rowIndex1,
+								  rowIndex2,
+								  rowFract);
+				
+				// Map rows are typically hundreds of pixels apart, so the
+				// expansion is only redone when the bracketing rows change.
+				
+				if (rowIndex1 != expanded1 || rowIndex2 != expanded2)
 					{
 					
-					real32 gain = interp.Interpolate ();
-					
-					dPtr [col] = Min_real32 (dPtr [col] * gain, 1.0f);
+					uint32 lastCol = map.Points ().h - 1;
 					
-					for (uint32 j = 0; j < colPitch; j++)
+					for (uint32 j = 0; j < count; j++)
 						{
-						interp.Increment ();
+						
+						uint32 c1 = colIndex [j];
+						uint32 c2 = Min_uint32 (c1 + 1, lastCol);
+						
+						real32 f = colFract [j];
+						
+						gainRow1 [j] = map.Entry (rowIndex1, c1, mapPlane) * (1.0f - f) +
+									   map.Entry (rowIndex1, c2, mapPlane) * (       f);
+						
+						gainRow2 [j] = map.Entry (rowIndex2, c1, mapPlane) * (1.0f - f) +
+									   map.Entry (rowIndex2, c2, mapPlane) * (       f);
+						
 						}
+						
+					expanded1 = rowIndex1;
+					expanded2 = rowIndex2;
 					
 					}
 				
+				real32 *dPtr = buffer.DirtyPixel_real32 (row, overlap.l, plane);
+				
+				DoGainMapRow32 (dPtr,
+								gainRow1,
+								gainRow2,
+								count,
+								colPitch,
+								rowFract);
+				
 				}
 			
 			}
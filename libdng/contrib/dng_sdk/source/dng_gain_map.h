@@ -20,6 +20,7 @@
 
 #include "dng_memory.h"
 #include "dng_misc_opcodes.h"
+#include "dng_sdk_limits.h"
 #include "dng_tag_types.h"
 
 /*****************************************************************************/
@@ -125,6 +126,11 @@ class dng_opcode_GainMap: public dng_inplace_opcode
 		dng_area_spec fAreaSpec;
 	
 		AutoPtr<dng_gain_map> fGainMap;
+		
+		// Per-thread scratch space for the column interpolation indices
+		// and the gain map rows expanded to pixel resolution.
+		
+		AutoPtr<dng_memory_block> fRowBuffers [kMaxMPThreads];
 	
 	public:
 	
@@ -146,6 +152,14 @@ class dng_opcode_GainMap: public dng_inplace_opcode
 			return fAreaSpec.Overlap (imageBounds);
 			}
 	
+		virtual void Prepare (dng_negative &negative,
+							  uint32 threadCount,
+							  const dng_point &tileSize,
+							  const dng_rect &imageBounds,
+							  uint32 imagePlanes,
+							  uint32 bufferPixelType,
+							  dng_memory_allocator &allocator);
+	
 		virtual void ProcessArea (dng_negative &negative,
 								  uint32 threadIndex,
 								  dng_pixel_buffer &buffer,
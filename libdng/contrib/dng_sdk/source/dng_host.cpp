@@ -47,6 +47,7 @@ dng_host::dng_host (dng_memory_allocator *allocator,
 	,	fSaveDNGVersion		(dngVersion_None)
 	,	fSaveLinearDNG		(false)
 	,	fKeepOriginalFile	(false)
+	,	fStageCacheSize		(0)
 	
 	{
 	
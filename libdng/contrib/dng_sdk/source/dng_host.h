@@ -104,6 +104,12 @@ class dng_host
 		// Keep the original raw file data block?
 		
 		bool fKeepOriginalFile;
+		
+		// If non-zero, the stage 2 and stage 3 images are computed lazily,
+		// one tile at a time as they are read, keeping about this many bytes
+		// of computed tiles.  If zero, they are computed in full up front.
+		
+		uint32 fStageCacheSize;
 	
 	public:
 	
@@ -313,6 +319,24 @@ class dng_host
 			return fKeepOriginalFile;
 			}
 
+		/// Setter for the size of the tile cache for lazily computed stage 2
+		/// and stage 3 images.
+		/// \param size Approximate number of bytes of computed tiles to keep
+		/// per stage, or zero to compute the stage images in full.
+
+		void SetStageCacheSize (uint32 size)
+			{
+			fStageCacheSize = size;
+			}
+
+		/// Getter for the size of the tile cache for lazily computed stage 2
+		/// and stage 3 images. Zero if they are computed in full.
+
+		uint32 StageCacheSize () const
+			{
+			return fStageCacheSize;
+			}
+
 		/// Determine if an error is the result of a temporary, but planned-for
 		/// occurence such as user cancellation or memory exhaustion. This method is
 		/// sometimes used to determine whether to try and continue processing a DNG
@@ -363,3 +363,127 @@ dng_hue_sat_map * dng_hue_sat_map::Interpolate (const dng_hue_sat_map &map1,
 	}
 
 /*****************************************************************************/
+
+dng_hue_sat_table::dng_hue_sat_table ()
+
+	:	fHueDivisions (0)
+	,	fSatDivisions (0)
+	,	fValDivisions (0)
+	,	fCorners      (0)
+	,	fHueStep      (0)
+	,	fValStep      (0)
+	,	fCells        ()
+	
+	{
+	
+	}
+
+/*****************************************************************************/
+
+dng_hue_sat_table::dng_hue_sat_table (const dng_hue_sat_map &map)
+
+	:	fHueDivisions (0)
+	,	fSatDivisions (0)
+	,	fValDivisions (0)
+	,	fCorners      (0)
+	,	fHueStep      (0)
+	,	fValStep      (0)
+	,	fCells        ()
+	
+	{
+	
+	Initialize (map);
+	
+	}
+
+/*****************************************************************************/
+
+void dng_hue_sat_table::Initialize (const dng_hue_sat_map &map)
+	{
+	
+	fCells.Clear ();
+	
+	if (!map.IsValid ())
+		{
+		
+		fHueDivisions = 0;
+		fSatDivisions = 0;
+		fValDivisions = 0;
+		
+		fCorners = 0;
+		
+		fHueStep = 0;
+		fValStep = 0;
+		
+		return;
+		
+		}
+	
+	map.GetDivisions (fHueDivisions,
+					  fSatDivisions,
+					  fValDivisions);
+					  
+	bool is3D = fValDivisions > 1;
+	
+	fCorners = is3D ? 8 : 4;
+	
+	uint32 satCells = fSatDivisions - 1;
+	uint32 valCells = is3D ? fValDivisions - 1 : 1;
+	
+	fHueStep = satCells;
+	fValStep = fHueDivisions * fHueStep;
+	
+	uint32 cellSize = CellSize ();
+	
+	fCells.Allocate (valCells * fValStep * cellSize * sizeof (real32));
+	
+	const dng_hue_sat_map::HSBModify *deltas = map.GetDeltas ();
+	
+	uint32 mapHueStep = fSatDivisions;
+	uint32 mapValStep = fHueDivisions * mapHueStep;
+	
+	const real32 hueScale = 6.0f / 360.0f;
+	
+	real32 *cell = fCells.Buffer_real32 ();
+	
+	for (uint32 valIndex = 0; valIndex < valCells; valIndex++)
+		{
+		
+		for (uint32 hueIndex = 0; hueIndex < fHueDivisions; hueIndex++)
+			{
+			
+			// The last hue cell interpolates back to the first hue entry.
+			
+			uint32 hueIndex1 = (hueIndex + 1 < fHueDivisions) ? hueIndex + 1 : 0;
+			
+			for (uint32 satIndex = 0; satIndex < satCells; satIndex++)
+				{
+				
+				for (uint32 corner = 0; corner < fCorners; corner++)
+					{
+					
+					uint32 v = valIndex + ((corner >> 2) & 1);
+					uint32 h = (corner & 2) ? hueIndex1 : hueIndex;
+					uint32 s = satIndex + (corner & 1);
+					
+					const dng_hue_sat_map::HSBModify &entry = deltas [v * mapValStep +
+																	  h * mapHueStep +
+																	  s];
+					
+					cell [kHueShift * fCorners + corner] = entry.fHueShift * hueScale;
+					cell [kSatScale * fCorners + corner] = entry.fSatScale;
+					cell [kValScale * fCorners + corner] = entry.fValScale;
+					
+					}
+					
+				cell += cellSize;
+				
+				}
+				
+			}
+			
+		}
+	
+	}
+
+/*****************************************************************************/
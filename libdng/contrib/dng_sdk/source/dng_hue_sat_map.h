@@ -136,6 +136,107 @@ class dng_hue_sat_map
 
 /*****************************************************************************/
 
+/// \brief A dng_hue_sat_map expanded into self-contained interpolation cells.
+///
+/// Each cell holds the corner deltas needed to interpolate inside one grid
+/// cell of the map, with the hue wrap-around already resolved and the hue
+/// shift already converted to the internal 0..6 hue range. A lookup then reads
+/// one contiguous block instead of entries spread over several map rows.
+/// Built once per render, and read-only (so shareable) afterwards.
+
+class dng_hue_sat_table
+	{
+	
+	public:
+	
+		// Cell component blocks, each holding one value per corner.
+		
+		enum
+			{
+			kHueShift = 0,
+			kSatScale = 1,
+			kValScale = 2,
+			kComponents = 3
+			};
+	
+	private:
+	
+		uint32 fHueDivisions;
+		uint32 fSatDivisions;
+		uint32 fValDivisions;
+		
+		// 4 corners (hue x sat) for "2.5D" tables, 8 (hue x sat x val) otherwise.
+		
+		uint32 fCorners;
+		
+		uint32 fHueStep;
+		uint32 fValStep;
+		
+		dng_memory_data fCells;
+		
+	public:
+	
+		dng_hue_sat_table ();
+		
+		explicit dng_hue_sat_table (const dng_hue_sat_map &map);
+		
+		void Initialize (const dng_hue_sat_map &map);
+		
+		bool IsValid () const
+			{
+			return fCells.Buffer () != NULL;
+			}
+		
+		void GetDivisions (uint32 &hueDivisions,
+						   uint32 &satDivisions,
+						   uint32 &valDivisions) const
+			{
+			hueDivisions = fHueDivisions;
+			satDivisions = fSatDivisions;
+			valDivisions = fValDivisions;
+			}
+			
+		uint32 Corners () const
+			{
+			return fCorners;
+			}
+			
+		/// Number of real32 entries per cell.
+			
+		uint32 CellSize () const
+			{
+			return fCorners * kComponents;
+			}
+		
+		/// Cell offsets, in cells, between adjacent hue and value indices.
+		
+		uint32 HueStep () const
+			{
+			return fHueStep;
+			}
+			
+		uint32 ValStep () const
+			{
+			return fValStep;
+			}
+		
+		const real32 * Cells () const
+			{
+			return fCells.Buffer_real32 ();
+			}
+		
+	private:
+	
+		// Hidden copy constructor and assignment operator.
+	
+		dng_hue_sat_table (const dng_hue_sat_table &table);
+		
+		dng_hue_sat_table & operator= (const dng_hue_sat_table &table);
+		
+	};
+
+/*****************************************************************************/
+
 #endif
 
 /*****************************************************************************/
@@ -2365,16 +2365,18 @@ void dng_ifd::PostParse ()
 		fDefaultCropSizeV = dng_urational (fActiveArea.H (), 1);
 		}
 		
-	// Default white level.
+	// Default white level.  Floating point data is normalized to 1.0.
 		
-	uint32 defaultWhite = (1 << fBitsPerSample [0]) - 1;
+	real64 defaultWhite = (fSampleFormat [0] == sfFloatingPoint)
+						? 1.0
+						: (real64) (((uint64) 1 << fBitsPerSample [0]) - 1);
 						
 	for (j = 0; j < kMaxSamplesPerPixel; j++)
 		{
 		
 		if (fWhiteLevel [j] < 0.0)
 			{
-			fWhiteLevel [j] = (real64) defaultWhite;
+			fWhiteLevel [j] = defaultWhite;
 			}
 		
 		}
@@ -2579,7 +2581,7 @@ bool dng_ifd::IsValidDNG (dng_shared &shared,
 		
 	dng_rect imageArea (0, 0, fImageLength, fImageWidth);
 		
-	uint32 defaultWhite = (1 << fBitsPerSample [0]) - 1;
+	real64 defaultWhite = (real64) (((uint64) 1 << fBitsPerSample [0]) - 1);
 						
 	bool isMonochrome = (shared.fCameraProfile.fColorPlanes == 1);
 	bool isColor      = !isMonochrome;
@@ -2963,6 +2965,9 @@ bool dng_ifd::IsValidDNG (dng_shared &shared,
 			
 			}
 			
+		case ccDeflate:
+			break;
+			
 		default:
 			{
 			
@@ -2979,20 +2984,52 @@ bool dng_ifd::IsValidDNG (dng_shared &shared,
 			
 		}
 		
-	// Check Predictor.
+	// Check Predictor.  Predictors are only used with deflate compression,
+	// and the floating point predictors only with floating point data.
+	
+	bool isFloat = (fSampleFormat [0] == sfFloatingPoint);
 		
-	if (fPredictor != cpNullPredictor)
+	switch (fPredictor)
 		{
 		
-		#if qDNGValidate
-
-		ReportError ("Unsupported Predictor",
-					 LookupParentCode (parentCode));
-					 
-		#endif
-					 
-		return false;
+		case cpNullPredictor:
+			break;
+			
+		case cpHorizontalDifference:
+		case cpHorizontalDifferenceX2:
+		case cpHorizontalDifferenceX4:
+		case cpFloatingPoint:
+		case cpFloatingPointX2:
+		case cpFloatingPointX4:
+			{
+			
+			bool floatPredictor = (fPredictor == cpFloatingPoint   ||
+								   fPredictor == cpFloatingPointX2 ||
+								   fPredictor == cpFloatingPointX4);
+			
+			if (fCompression == ccDeflate && floatPredictor == isFloat)
+				{
+				break;
+				}
+				
+			}
+			
+		// Fall through.
+			
+		default:
+			{
 		
+			#if qDNGValidate
+
+			ReportError ("Unsupported Predictor",
+						 LookupParentCode (parentCode));
+						 
+			#endif
+						 
+			return false;
+			
+			}
+			
 		}
 		
 	// Check FillOrder.
@@ -3043,10 +3080,19 @@ bool dng_ifd::IsValidDNG (dng_shared &shared,
 		
 		}
 		
-	// Check SampleFormat.
+	// Check SampleFormat.  Floating point is only supported for 32-bit
+	// raw data.
 	
 	for (j = 0; j < fSamplesPerPixel; j++)
 		{
+		
+		if (fSampleFormat [j] == sfFloatingPoint &&
+			fSampleFormat [j] == fSampleFormat [0] &&
+			fBitsPerSample [j] == 32 &&
+			maxBitsPerSample == 32)
+			{
+			continue;
+			}
 	
 		if (fSampleFormat [j] != sfUnsignedInteger)
 			{
@@ -3304,7 +3350,15 @@ bool dng_ifd::IsValidDNG (dng_shared &shared,
 	// Check WhiteLevel.
 	
 	real64 maxWhite = fLinearizationTableCount ? 65535.0
-											   : (real64) defaultWhite;
+											   : defaultWhite;
+											   
+	// Floating point data may exceed its nominal range, so any positive
+	// white level is accepted.
+	
+	if (fSampleFormat [0] == sfFloatingPoint)
+		{
+		maxWhite = 1.0e30;
+		}
 		
 	for (j = 0; j < fSamplesPerPixel; j++)
 		{
@@ -15,17 +15,20 @@
 
 #include "dng_image_writer.h"
 
+#include "dng_area_task.h"
 #include "dng_bottlenecks.h"
 #include "dng_camera_profile.h"
 #include "dng_color_space.h"
 #include "dng_exif.h"
 #include "dng_flags.h"
 #include "dng_exceptions.h"
+#include "dng_fingerprint.h"
 #include "dng_host.h"
 #include "dng_ifd.h"
 #include "dng_image.h"
 #include "dng_lossless_jpeg.h"
 #include "dng_memory_stream.h"
+#include "dng_mutex.h"
 #include "dng_negative.h"
 #include "dng_pixel_buffer.h"
 #include "dng_preview.h"
@@ -36,6 +39,8 @@
 #include "dng_utils.h"
 #include "dng_xmp.h"
 
+#include "zlib.h"
+
 /*****************************************************************************/
 
 // Defines for testing DNG 1.2 features.
@@ -2469,11 +2474,13 @@ tag_dng_noise_profile::tag_dng_noise_profile (const dng_noise_profile &profile)
 		
 /*****************************************************************************/
 
-dng_image_writer::dng_image_writer ()
+dng_raw_tile_policy::dng_raw_tile_policy ()
 
-	:	fCompressedBuffer   ()
-	,	fUncompressedBuffer ()
-	,	fSubTileBlockBuffer ()
+	:	fMode         (kBytesPerTile)
+	,	fBytesPerTile (128 * 1024)
+	,	fTileSize     (256, 256)
+	,	fTilesPerCPU  (4)
+	,	fCPUCount     (1)
 	
 	{
 	
@@ -2481,181 +2488,869 @@ dng_image_writer::dng_image_writer ()
 
 /*****************************************************************************/
 
-dng_image_writer::~dng_image_writer ()
+void dng_raw_tile_policy::Apply (dng_ifd &ifd,
+								 uint32 cellH,
+								 uint32 cellV) const
 	{
 	
+	switch (fMode)
+		{
+		
+		case kFixedSize:
+			{
+			
+			// Tiles larger than the image only add padding.
+			
+			uint32 maxWidth  = ((ifd.fImageWidth  + cellH - 1) / cellH) * cellH;
+			uint32 maxLength = ((ifd.fImageLength + cellV - 1) / cellV) * cellV;
+			
+			uint32 tileWidth  = Max_uint32 (1, (uint32) Max_int32 (0, fTileSize.h));
+			uint32 tileLength = Max_uint32 (1, (uint32) Max_int32 (0, fTileSize.v));
+			
+			tileWidth  = ((tileWidth  + cellH - 1) / cellH) * cellH;
+			tileLength = ((tileLength + cellV - 1) / cellV) * cellV;
+			
+			ifd.fTileWidth  = Min_uint32 (tileWidth , maxWidth );
+			ifd.fTileLength = Min_uint32 (tileLength, maxLength);
+			
+			ifd.fUsesTiles  = true;
+			ifd.fUsesStrips = false;
+			
+			break;
+			
+			}
+			
+		case kTilesPerCPU:
+			{
+			
+			uint32 bytesPerPixel = ifd.fSamplesPerPixel *
+								   ((ifd.fBitsPerSample [0] + 7) >> 3);
+								   
+			real64 imageBytes = (real64) ifd.fImageWidth  *
+								(real64) ifd.fImageLength *
+								(real64) bytesPerPixel;
+								
+			uint32 tileCount = Max_uint32 (1, fTilesPerCPU * fCPUCount);
+			
+			// Don't let the tiles get smaller than one cell.
+			
+			real64 bytesPerTile = Max_real64 (imageBytes / tileCount,
+											  cellH * cellV * bytesPerPixel);
+			
+			ifd.FindTileSize (Round_uint32 (Min_real64 (bytesPerTile, 0x7FFFFFFF)),
+							  cellH,
+							  cellV);
+			
+			break;
+			
+			}
+			
+		default:
+			{
+			
+			ifd.FindTileSize (fBytesPerTile,
+							  cellH,
+							  cellV);
+			
+			break;
+			
+			}
+		
+		}
+		
 	}
-						    
+
 /*****************************************************************************/
 
-uint32 dng_image_writer::CompressedBufferSize (const dng_ifd &ifd,
-											   uint32 uncompressedSize)
+// Accumulates the RawImageDigest from the tiles fetched while the raw image
+// is being written.  Tiles are copied into a band of full width rows, and
+// each completed band is hashed using the same layout and byte order as
+// dng_negative::FindRawImageDigest, so the results are identical.
+
+class dng_tile_digest
 	{
 	
-	// If we are saving lossless JPEG from an 8-bit image, reserve
-	// space to pad the data out to 16-bits.
+	private:
 	
-	if (ifd.fCompression == ccJPEG && ifd.fBitsPerSample [0] <= 8)
-		{
+		const dng_image &fImage;
 		
-		return uncompressedSize * 2;
+		dng_rect fBounds;
 		
-		}
+		uint32 fPlanes;
+		
+		uint32 fPixelSize;
+		
+		bool fExpandBytes;
+		
+		uint32 fRowBytes;
+		
+		uint32 fBandRows;
+		
+		int32 fBandTop;
+		int32 fBandBottom;
+		
+		AutoPtr<dng_memory_block> fBand;
+		
+		dng_md5_printer fPrinter;
+		
+		// Tiles may be captured by several threads at once.
+		
+		dng_mutex fMutex;
+		
+	public:
 	
-	return 0;
+		dng_tile_digest (const dng_image &image);
+		
+		const dng_image & Image () const
+			{
+			return fImage;
+			}
+			
+		void Allocate (dng_host &host,
+					   uint32 bandRows);
+					   
+		void Capture (const dng_pixel_buffer &buffer);
+		
+		void Flush ();
+		
+		dng_fingerprint Result ();
+		
+	private:
+	
+		// Hidden copy constructor and assignment operator.
+	
+		dng_tile_digest (const dng_tile_digest &digest);
+		
+		dng_tile_digest & operator= (const dng_tile_digest &digest);
+		
+	};
 	
-	}
-						    
 /*****************************************************************************/
 
-void dng_image_writer::EncodePredictor (dng_host & /* host */,
-									    const dng_ifd &ifd,
-						        	    dng_pixel_buffer & /* buffer */)
+dng_tile_digest::dng_tile_digest (const dng_image &image)
+
+	:	fImage       (image)
+	,	fBounds      (image.Bounds ())
+	,	fPlanes      (image.Planes ())
+	,	fPixelSize   (image.PixelSize ())
+	,	fExpandBytes (image.PixelType () == ttByte)
+	,	fRowBytes    (0)
+	,	fBandRows    (0)
+	,	fBandTop     (image.Bounds ().t)
+	,	fBandBottom  (image.Bounds ().t)
+	,	fBand        ()
+	,	fPrinter     ()
+	,	fMutex       ("dng_tile_digest")
+	
 	{
 	
-	if (ifd.fPredictor != cpNullPredictor)
+	// Sometimes we expand 8-bit data to 16-bit data while reading or
+	// writing, so the digest of 8-bit data is always computed as 16-bits.
+	
+	if (fExpandBytes)
 		{
-		
-		ThrowProgramError ();
-		
+		fPixelSize = 2;
 		}
 	
+	fRowBytes = fBounds.W () * fPlanes * fPixelSize;
+		
 	}
-						    
+
 /*****************************************************************************/
 
-void dng_image_writer::ByteSwapBuffer (dng_host & /* host */,
-									   dng_pixel_buffer &buffer)
+void dng_tile_digest::Allocate (dng_host &host,
+								uint32 bandRows)
 	{
 	
-	uint32 pixels = buffer.fRowStep * buffer.fArea.H ();
+	fBandRows = Min_uint32 (bandRows, fBounds.H ());
 	
-	switch (buffer.fPixelSize)
+	fBand.Reset (host.Allocate (fBandRows * fRowBytes));
+	
+	}
+
+/*****************************************************************************/
+
+void dng_tile_digest::Capture (const dng_pixel_buffer &buffer)
+	{
+	
+	// Edge tiles may extend past the image bounds.
+	
+	dng_rect area = buffer.fArea & fBounds;
+	
+	if (area.IsEmpty ())
+		{
+		return;
+		}
+		
+	dng_lock_mutex lock (&fMutex);
+		
+	if (area.b - fBandTop > (int32) fBandRows ||
+		area.t < fBandTop ||
+		buffer.fPlanes != fPlanes ||
+		buffer.fColStep != (int32) fPlanes ||
+		buffer.fPlaneStep != 1)
 		{
+		ThrowProgramError ("Unexpected tile for raw image digest");
+		}
 		
-		case 2:
+	fBandBottom = Max_int32 (fBandBottom, area.b);
+	
+	uint32 count = area.W () * fPlanes;
+	
+	for (int32 row = area.t; row < area.b; row++)
+		{
+		
+		uint8 *dPtr = fBand->Buffer_uint8 () + (row - fBandTop) * fRowBytes
+											 + (area.l - fBounds.l) * fPlanes * fPixelSize;
+		
+		if (fExpandBytes)
 			{
 			
-			DoSwapBytes16 ((uint16 *) buffer.fData,
-						   pixels);
-						   
-			break;
+			const uint8 *sPtr = buffer.ConstPixel_uint8 (row, area.l, 0);
+			
+			uint16 *dPtr16 = (uint16 *) dPtr;
 			
+			for (uint32 j = 0; j < count; j++)
+				{
+				dPtr16 [j] = sPtr [j];
+				}
+				
 			}
 			
-		case 4:
+		else
 			{
 			
-			DoSwapBytes32 ((uint32 *) buffer.fData,
-						   pixels);
-						   
-			break;
+			DoCopyBytes (buffer.ConstPixel (row, area.l, 0),
+						 dPtr,
+						 count * fPixelSize);
 			
 			}
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void dng_tile_digest::Flush ()
+	{
+	
+	if (fBandBottom > fBandTop)
+		{
+		
+		uint32 count = (fBandBottom - fBandTop) * fRowBytes;
+		
+		#if qDNGBigEndian
+		
+		// Match the little-endian byte order used by FindRawImageDigest.
+		
+		if (fPixelSize == 2)
+			{
+			DoSwapBytes16 (fBand->Buffer_uint16 (), count >> 1);
+			}
 			
-		default:
-			break;
+		else if (fPixelSize == 4)
+			{
+			DoSwapBytes32 (fBand->Buffer_uint32 (), count >> 2);
+			}
 			
+		#endif
+		
+		fPrinter.Process (fBand->Buffer (), count);
+		
+		fBandTop = fBandBottom;
+		
 		}
-
+	
 	}
-						    
+
 /*****************************************************************************/
 
-void dng_image_writer::ReorderSubTileBlocks (const dng_ifd &ifd,
-											 dng_pixel_buffer &buffer)
+dng_fingerprint dng_tile_digest::Result ()
 	{
 	
-	uint32 blockRows = ifd.fSubTileBlockRows;
-	uint32 blockCols = ifd.fSubTileBlockCols;
+	Flush ();
 	
-	uint32 rowBlocks = buffer.fArea.H () / blockRows;
-	uint32 colBlocks = buffer.fArea.W () / blockCols;
+	if (fBandTop != fBounds.b)
+		{
+		ThrowProgramError ("Incomplete raw image digest");
+		}
 	
-	int32 rowStep = buffer.fRowStep * buffer.fPixelSize;
-	int32 colStep = buffer.fColStep * buffer.fPixelSize;
+	return fPrinter.Result ();
 	
-	int32 rowBlockStep = rowStep * blockRows;
-	int32 colBlockStep = colStep * blockCols;
+	}
+
+/*****************************************************************************/
+
+dng_image_writer::dng_image_writer ()
+
+	:	fCompressedBuffer   ()
+	,	fUncompressedBuffer ()
+	,	fSubTileBlockBuffer ()
+	,	fTileDigest         ()
+	,	fRawTilePolicy      ()
+	,	fDeflateLevel       (6)
+	,	fPackRawBits        (false)
 	
-	uint32 blockColBytes = blockCols * buffer.fPlanes * buffer.fPixelSize;
+	{
 	
-	const uint8 *s0 = fUncompressedBuffer->Buffer_uint8 ();
-	      uint8 *d0 = fSubTileBlockBuffer->Buffer_uint8 ();
+	}
+
+/*****************************************************************************/
+
+dng_image_writer::~dng_image_writer ()
+	{
 	
-	for (uint32 rowBlock = 0; rowBlock < rowBlocks; rowBlock++)
+	}
+						    
+/*****************************************************************************/
+
+uint32 dng_image_writer::CompressedBufferSize (const dng_ifd &ifd,
+											   uint32 uncompressedSize)
+	{
+	
+	// If we are saving lossless JPEG from an 8-bit image, reserve
+	// space to pad the data out to 16-bits.
+	
+	if (ifd.fCompression == ccJPEG && ifd.fBitsPerSample [0] <= 8)
 		{
 		
-		const uint8 *s1 = s0;
+		return uncompressedSize * 2;
 		
-		for (uint32 colBlock = 0; colBlock < colBlocks; colBlock++)
-			{
-			
-			const uint8 *s2 = s1;
-			
-			for (uint32 blockRow = 0; blockRow < blockRows; blockRow++)
-				{
-				
-				for (uint32 j = 0; j < blockColBytes; j++)
-					{
-					
-					d0 [j] = s2 [j];
-					
-					}
-					
-				d0 += blockColBytes;
-				
-				s2 += rowStep;
-				
-				}
-			
-			s1 += colBlockStep;
-			
-			}
-			
-		s0 += rowBlockStep;
+		}
+		
+	if (ifd.fCompression == ccDeflate)
+		{
+		
+		return (uint32) compressBound (uncompressedSize);
 		
 		}
 		
-	// Copy back reordered pixels.
+	// Packed samples are smaller than the 16-bit data they come from.
 		
-	DoCopyBytes (fSubTileBlockBuffer->Buffer      (),
-				 fUncompressedBuffer->Buffer      (),
-				 fUncompressedBuffer->LogicalSize ());
+	if (ifd.fCompression == ccUncompressed &&
+		ifd.fBitsPerSample [0] > 8 &&
+		ifd.fBitsPerSample [0] < 16)
+		{
+		
+		return uncompressedSize;
+		
+		}
+	
+	return 0;
 	
 	}
 						    
 /*****************************************************************************/
 
-void dng_image_writer::WriteData (dng_host &host,
-								  const dng_ifd &ifd,
-						          dng_stream &stream,
-						          dng_pixel_buffer &buffer)
+static void EncodeDelta8 (uint8 *dPtr,
+						  uint32 rows,
+						  uint32 rowSamples,
+						  uint32 rowStep,
+						  uint32 stride)
 	{
 	
-	switch (ifd.fCompression)
+	for (uint32 row = 0; row < rows; row++)
 		{
 		
-		case ccUncompressed:
+		for (uint32 col = rowSamples - 1; col >= stride; col--)
 			{
+			dPtr [col] = (uint8) (dPtr [col] - dPtr [col - stride]);
+			}
 			
-			// Special case support for when we save to 8-bits from
-			// 16-bit data.
-			
-			if (ifd.fBitsPerSample [0] == 8 && buffer.fPixelType == ttShort)
-				{
-				
-				uint32 count = buffer.fRowStep *
-							   buffer.fArea.H ();
+		dPtr += rowStep;
+		
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+static void EncodeDelta16 (uint16 *dPtr,
+						   uint32 rows,
+						   uint32 rowSamples,
+						   uint32 rowStep,
+						   uint32 stride)
+	{
+	
+	for (uint32 row = 0; row < rows; row++)
+		{
+		
+		for (uint32 col = rowSamples - 1; col >= stride; col--)
+			{
+			dPtr [col] = (uint16) (dPtr [col] - dPtr [col - stride]);
+			}
+			
+		dPtr += rowStep;
+		
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+static void EncodeDelta32 (uint32 *dPtr,
+						   uint32 rows,
+						   uint32 rowSamples,
+						   uint32 rowStep,
+						   uint32 stride)
+	{
+	
+	for (uint32 row = 0; row < rows; row++)
+		{
+		
+		for (uint32 col = rowSamples - 1; col >= stride; col--)
+			{
+			dPtr [col] -= dPtr [col - stride];
+			}
+			
+		dPtr += rowStep;
+		
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+// Floating point predictor from Adobe Photoshop TIFF Technical Note 3.  The
+// bytes of each row are rearranged so all the most significant bytes come
+// first, then differenced.  The result is a byte stream, so it is written
+// without byte swapping.
+
+static void EncodeFPDelta (uint8 *dPtr,
+						   uint8 *temp,
+						   uint32 rows,
+						   uint32 rowSamples,
+						   uint32 rowStep,
+						   uint32 stride)
+	{
+	
+	const uint32 bytesPerSample = 4;
+	
+	const uint32 rowBytes = rowSamples * bytesPerSample;
+	
+	for (uint32 row = 0; row < rows; row++)
+		{
+		
+		const uint8 *sPtr = dPtr;
+		
+		for (uint32 col = 0; col < rowSamples; col++)
+			{
+			
+			for (uint32 b = 0; b < bytesPerSample; b++)
+				{
+				
+				#if qDNGBigEndian
+				temp [b * rowSamples + col] = sPtr [b];
+				#else
+				temp [b * rowSamples + col] = sPtr [bytesPerSample - 1 - b];
+				#endif
+				
+				}
+				
+			sPtr += bytesPerSample;
+			
+			}
+			
+		for (uint32 j = rowBytes - 1; j >= stride; j--)
+			{
+			temp [j] = (uint8) (temp [j] - temp [j - stride]);
+			}
+			
+		DoCopyBytes (temp, dPtr, rowBytes);
+		
+		dPtr += rowStep * bytesPerSample;
+		
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+void dng_image_writer::EncodePredictor (dng_host &host,
+									    const dng_ifd &ifd,
+						        	    dng_pixel_buffer &buffer)
+	{
+	
+	uint32 stride = buffer.fPlanes;
+	
+	switch (ifd.fPredictor)
+		{
+		
+		case cpNullPredictor:
+			return;
+			
+		case cpHorizontalDifference:
+		case cpFloatingPoint:
+			break;
+			
+		case cpHorizontalDifferenceX2:
+		case cpFloatingPointX2:
+			{
+			stride *= 2;
+			break;
+			}
+			
+		case cpHorizontalDifferenceX4:
+		case cpFloatingPointX4:
+			{
+			stride *= 4;
+			break;
+			}
+			
+		default:
+			{
+			ThrowProgramError ();
+			}
+			
+		}
+		
+	uint32 rows       = buffer.fArea.H ();
+	uint32 rowSamples = buffer.fArea.W () * buffer.fPlanes;
+	
+	if (buffer.fColStep != (int32) buffer.fPlanes || buffer.fPlaneStep != 1)
+		{
+		ThrowProgramError ("Predictors require interleaved pixels");
+		}
+		
+	if (rowSamples <= stride)
+		{
+		return;
+		}
+		
+	if (ifd.fPredictor == cpFloatingPoint   ||
+		ifd.fPredictor == cpFloatingPointX2 ||
+		ifd.fPredictor == cpFloatingPointX4)
+		{
+		
+		if (buffer.fPixelType != ttFloat)
+			{
+			ThrowProgramError ();
+			}
+			
+		AutoPtr<dng_memory_block> temp (host.Allocate (rowSamples * buffer.fPixelSize));
+		
+		EncodeFPDelta (buffer.DirtyPixel_uint8 (buffer.fArea.t, buffer.fArea.l, buffer.fPlane),
+					   temp->Buffer_uint8 (),
+					   rows,
+					   rowSamples,
+					   buffer.fRowStep,
+					   stride);
+		
+		return;
+		
+		}
+		
+	switch (buffer.fPixelSize)
+		{
+		
+		case 1:
+			{
+			
+			EncodeDelta8 (buffer.DirtyPixel_uint8 (buffer.fArea.t, buffer.fArea.l, buffer.fPlane),
+						  rows,
+						  rowSamples,
+						  buffer.fRowStep,
+						  stride);
+						  
+			break;
+			
+			}
+			
+		case 2:
+			{
+			
+			EncodeDelta16 (buffer.DirtyPixel_uint16 (buffer.fArea.t, buffer.fArea.l, buffer.fPlane),
+						   rows,
+						   rowSamples,
+						   buffer.fRowStep,
+						   stride);
+						  
+			break;
+			
+			}
+			
+		case 4:
+			{
+			
+			EncodeDelta32 (buffer.DirtyPixel_uint32 (buffer.fArea.t, buffer.fArea.l, buffer.fPlane),
+						   rows,
+						   rowSamples,
+						   buffer.fRowStep,
+						   stride);
+						  
+			break;
+			
+			}
+			
+		default:
+			{
+			ThrowProgramError ();
+			}
+			
+		}
+	
+	}
+						    
+/*****************************************************************************/
+
+void dng_image_writer::ByteSwapBuffer (dng_host & /* host */,
+									   dng_pixel_buffer &buffer)
+	{
+	
+	uint32 pixels = buffer.fRowStep * buffer.fArea.H ();
+	
+	switch (buffer.fPixelSize)
+		{
+		
+		case 2:
+			{
+			
+			DoSwapBytes16 ((uint16 *) buffer.fData,
+						   pixels);
+						   
+			break;
+			
+			}
+			
+		case 4:
+			{
+			
+			DoSwapBytes32 ((uint32 *) buffer.fData,
+						   pixels);
+						   
+			break;
+			
+			}
+			
+		default:
+			break;
+			
+		}
+
+	}
+						    
+/*****************************************************************************/
+
+void dng_image_writer::ReorderSubTileBlocks (const dng_ifd &ifd,
+											 dng_pixel_buffer &buffer)
+	{
+	
+	uint32 blockRows = ifd.fSubTileBlockRows;
+	uint32 blockCols = ifd.fSubTileBlockCols;
+	
+	uint32 rowBlocks = buffer.fArea.H () / blockRows;
+	uint32 colBlocks = buffer.fArea.W () / blockCols;
+	
+	int32 rowStep = buffer.fRowStep * buffer.fPixelSize;
+	int32 colStep = buffer.fColStep * buffer.fPixelSize;
+	
+	int32 rowBlockStep = rowStep * blockRows;
+	int32 colBlockStep = colStep * blockCols;
+	
+	uint32 blockColBytes = blockCols * buffer.fPlanes * buffer.fPixelSize;
+	
+	const uint8 *s0 = fUncompressedBuffer->Buffer_uint8 ();
+	      uint8 *d0 = fSubTileBlockBuffer->Buffer_uint8 ();
+	
+	for (uint32 rowBlock = 0; rowBlock < rowBlocks; rowBlock++)
+		{
+		
+		const uint8 *s1 = s0;
+		
+		for (uint32 colBlock = 0; colBlock < colBlocks; colBlock++)
+			{
+			
+			const uint8 *s2 = s1;
+			
+			for (uint32 blockRow = 0; blockRow < blockRows; blockRow++)
+				{
+				
+				for (uint32 j = 0; j < blockColBytes; j++)
+					{
+					
+					d0 [j] = s2 [j];
+					
+					}
+					
+				d0 += blockColBytes;
+				
+				s2 += rowStep;
+				
+				}
+			
+			s1 += colBlockStep;
+			
+			}
+			
+		s0 += rowBlockStep;
+		
+		}
+		
+	// Copy back reordered pixels.
+		
+	DoCopyBytes (fSubTileBlockBuffer->Buffer      (),
+				 fUncompressedBuffer->Buffer      (),
+				 fUncompressedBuffer->LogicalSize ());
+	
+	}
+						    
+/*****************************************************************************/
+
+// Converts a tile that has been through the predictor to the byte layout
+// stored in the file, returning the number of bytes.
+
+static uint32 PrepareDeflateData (const dng_ifd &ifd,
+								  dng_pixel_buffer &buffer,
+								  bool swapBytes)
+	{
+	
+	uint32 count = buffer.fRowStep * buffer.fArea.H ();
+	
+	// Special case support for when we save to 8-bits from 16-bit data.
+	
+	if (ifd.fBitsPerSample [0] == 8 && buffer.fPixelType == ttShort)
+		{
+		
+		const uint16 *sPtr = (const uint16 *) buffer.fData;
+		
+		uint8 *dPtr = (uint8 *) buffer.fData;
+		
+		for (uint32 j = 0; j < count; j++)
+			{
+			dPtr [j] = (uint8) sPtr [j];
+			}
+			
+		return count;
+		
+		}
+		
+	bool bytePlanes = ifd.fPredictor == cpFloatingPoint   ||
+					  ifd.fPredictor == cpFloatingPointX2 ||
+					  ifd.fPredictor == cpFloatingPointX4;
+		
+	if (swapBytes && !bytePlanes)
+		{
+		
+		if (buffer.fPixelSize == 2)
+			{
+			DoSwapBytes16 ((uint16 *) buffer.fData, count);
+			}
+			
+		else if (buffer.fPixelSize == 4)
+			{
+			DoSwapBytes32 ((uint32 *) buffer.fData, count);
+			}
+		
+		}
+		
+	return count * buffer.fPixelSize;
+	
+	}
+
+/*****************************************************************************/
+
+static uint32 DeflateData (int32 level,
+						   const void *data,
+						   uint32 dataSize,
+						   void *compressed,
+						   uint32 compressedSize)
+	{
+	
+	uLongf destLen = compressedSize;
+	
+	int zResult = compress2 ((Bytef *) compressed,
+							 &destLen,
+							 (const Bytef *) data,
+							 dataSize,
+							 Pin_int32 (Z_BEST_SPEED, level, Z_BEST_COMPRESSION));
+							 
+	if (zResult == Z_MEM_ERROR)
+		{
+		ThrowMemoryFull ();
+		}
+		
+	if (zResult != Z_OK)
+		{
+		ThrowProgramError ("Deflate compression failed");
+		}
+		
+	return (uint32) destLen;
+	
+	}
+
+/*****************************************************************************/
+
+void dng_image_writer::WriteData (dng_host &host,
+								  const dng_ifd &ifd,
+						          dng_stream &stream,
+						          dng_pixel_buffer &buffer)
+	{
+	
+	switch (ifd.fCompression)
+		{
+		
+		case ccUncompressed:
+			{
+			
+			// Special case support for when we save to 8-bits from
+			// 16-bit data.  Narrow the whole buffer first, so it goes
+			// to the stream as a single block.
+			
+			if (ifd.fBitsPerSample [0] == 8 && buffer.fPixelType == ttShort)
+				{
+				
+				uint32 count = buffer.fRowStep *
+							   buffer.fArea.H ();
 							   
 				const uint16 *sPtr = (const uint16 *) buffer.fData;
 				
+				uint8 *dPtr = fCompressedBuffer->Buffer_uint8 ();
+				
 				for (uint32 j = 0; j < count; j++)
 					{
 					
-					stream.Put_uint8 ((uint8) sPtr [j]);
+					dPtr [j] = (uint8) sPtr [j];
+					
+					}
+					
+				stream.Put (dPtr, count);
+				
+				}
+				
+			// Pack 16-bit data into fewer bits per sample.  Each row
+			// starts on a byte boundary, and the packed bit stream does
+			// not depend on the byte order of the file.
+				
+			else if (ifd.fBitsPerSample [0] > 8 &&
+					 ifd.fBitsPerSample [0] < 16 &&
+					 buffer.fPixelType == ttShort)
+				{
+				
+				uint32 bits = ifd.fBitsPerSample [0];
+				
+				uint32 rowSamples = buffer.fArea.W () * buffer.fPlanes;
+				
+				uint32 packedRowBytes = (rowSamples * bits + 7) >> 3;
+				
+				const uint16 *sPtr = (const uint16 *) buffer.fData;
+				
+				uint8 *dPtr = fCompressedBuffer->Buffer_uint8 ();
+				
+				uint32 rows = buffer.fArea.H ();
+				
+				for (uint32 row = 0; row < rows; row++)
+					{
+					
+					DoPackBits16 (sPtr, dPtr, rowSamples, bits);
+					
+					sPtr += buffer.fRowStep;
+					
+					dPtr += packedRowBytes;
 					
 					}
+					
+				stream.Put (fCompressedBuffer->Buffer (), packedRowBytes * rows);
 				
 				}
 				
@@ -2706,96 +3401,560 @@ void dng_image_writer::WriteData (dng_host &host,
 				
 				}
 				
-			EncodeLosslessJPEG ((const uint16 *) temp.fData,
-								temp.fArea.H (),
-								temp.fArea.W (),
-								temp.fPlanes,
-								ifd.fBitsPerSample [0],
-								temp.fRowStep,
-								temp.fColStep,
-								stream);
-										
-			break;
+			EncodeLosslessJPEG ((const uint16 *) temp.fData,
+								temp.fArea.H (),
+								temp.fArea.W (),
+								temp.fPlanes,
+								ifd.fBitsPerSample [0],
+								temp.fRowStep,
+								temp.fColStep,
+								stream);
+										
+			break;
+			
+			}
+			
+		case ccDeflate:
+			{
+			
+			uint32 dataSize = PrepareDeflateData (ifd,
+												  buffer,
+												  stream.SwapBytes ());
+			
+			uint32 compressedSize = DeflateData (fDeflateLevel,
+												 buffer.fData,
+												 dataSize,
+												 fCompressedBuffer->Buffer (),
+												 fCompressedBuffer->LogicalSize ());
+												 
+			stream.Put (fCompressedBuffer->Buffer (), compressedSize);
+			
+			break;
+			
+			}
+			
+		default:
+			{
+			
+			ThrowProgramError ();
+			
+			}
+			
+		}
+	
+	}
+						    
+/*****************************************************************************/
+
+void dng_image_writer::WriteTile (dng_host &host,
+						          const dng_ifd &ifd,
+						          dng_stream &stream,
+						          const dng_image &image,
+						          const dng_rect &tileArea,
+						          uint32 fakeChannels)
+	{
+	
+	// Create pixel buffer to hold uncompressed tile.
+	
+	dng_pixel_buffer buffer;
+	
+	buffer.fArea = tileArea;
+	
+	buffer.fPlane  = 0;
+	buffer.fPlanes = ifd.fSamplesPerPixel;
+	
+	buffer.fRowStep   = buffer.fPlanes * tileArea.W ();
+	buffer.fColStep   = buffer.fPlanes;
+	buffer.fPlaneStep = 1;
+	
+	buffer.fPixelType = image.PixelType ();
+	buffer.fPixelSize = image.PixelSize ();
+	
+	buffer.fData = fUncompressedBuffer->Buffer ();
+	
+	// Get the uncompressed data.
+	
+	image.Get (buffer, dng_image::edge_zero);
+	
+	// Add the tile to the raw image digest, if one is being computed.
+	
+	if (fTileDigest.Get () && &fTileDigest->Image () == &image)
+		{
+		
+		fTileDigest->Capture (buffer);
+		
+		}
+	
+	// Deal with sub-tile blocks.
+	
+	if (ifd.fSubTileBlockRows > 1)
+		{
+		
+		ReorderSubTileBlocks (ifd, buffer);
+		
+		}
+	
+	// Run predictor.
+	
+	EncodePredictor (host,
+					 ifd,
+					 buffer);
+		
+	// Adjust pixel buffer for fake channels.
+	
+	if (fakeChannels > 1)
+		{
+		
+		buffer.fPlanes  *= fakeChannels;
+		buffer.fColStep *= fakeChannels;
+		
+		buffer.fArea.r = buffer.fArea.l + (buffer.fArea.W () / fakeChannels);
+		
+		}
+		
+	// Compress (if required) and write out the data.
+	
+	WriteData (host,
+			   ifd,
+			   stream,
+			   buffer);
+			   
+	}
+
+/*****************************************************************************/
+
+// Compresses a batch of Deflate tiles in parallel.  Each tile is read, run
+// through the predictor and compressed independently into its own slot,
+// and the slots are written out in tile order once the batch is done.  The
+// task area is in units of tiles, not pixels.
+
+class dng_deflate_tile_task: public dng_area_task
+	{
+	
+	private:
+	
+		enum
+			{
+			
+			// Limits on the compressed tiles held by one batch.
+			
+			kMaxBatchTiles = 64,
+			
+			kMaxBatchBytes = 32 * 1024 * 1024
+			
+			};
+	
+		dng_image_writer &fWriter;
+		
+		dng_host &fHost;
+		
+		const dng_ifd &fIFD;
+		
+		const dng_image &fImage;
+		
+		bool fSwapBytes;
+		
+		bool fDigest;
+		
+		uint32 fUncompressedSize;
+		uint32 fCompressedSize;
+		
+		dng_rect fBatch;
+		
+		AutoPtr<dng_memory_block> fBuffer [kMaxMPThreads];
+		
+		AutoPtr<dng_memory_block> fResult [kMaxBatchTiles];
+		
+		uint32 fResultSize [kMaxBatchTiles];
+		
+	public:
+	
+		dng_deflate_tile_task (dng_image_writer &writer,
+							   dng_host &host,
+							   const dng_ifd &ifd,
+							   const dng_image &image,
+							   bool swapBytes,
+							   bool digest);
+							   
+		uint32 MaxBatchTiles () const
+			{
+			return Pin_uint32 (1, kMaxBatchBytes / fCompressedSize, kMaxBatchTiles);
+			}
+			
+		void SetBatch (const dng_rect &batch)
+			{
+			fBatch = batch;
+			}
+							   
+		virtual void Start (uint32 threadCount,
+							const dng_point &tileSize,
+							dng_memory_allocator *allocator,
+							dng_abort_sniffer *sniffer);
+							
+		virtual void Process (uint32 threadIndex,
+							  const dng_rect &tile,
+							  dng_abort_sniffer *sniffer);
+							  
+		void Put (dng_stream &stream,
+				  uint32 rowIndex,
+				  uint32 colIndex) const;
+							  
+	private:
+	
+		// Hidden copy constructor and assignment operator.
+	
+		dng_deflate_tile_task (const dng_deflate_tile_task &task);
+		
+		dng_deflate_tile_task & operator= (const dng_deflate_tile_task &task);
+		
+	};
+	
+/*****************************************************************************/
+
+dng_deflate_tile_task::dng_deflate_tile_task (dng_image_writer &writer,
+											  dng_host &host,
+											  const dng_ifd &ifd,
+											  const dng_image &image,
+											  bool swapBytes,
+											  bool digest)
+											  
+	:	fWriter           (writer)
+	,	fHost             (host)
+	,	fIFD              (ifd)
+	,	fImage            (image)
+	,	fSwapBytes        (swapBytes)
+	,	fDigest           (digest)
+	,	fUncompressedSize (0)
+	,	fCompressedSize   (0)
+	,	fBatch            ()
+	
+	{
+	
+	fMinTaskArea = 1;
+	
+	fMaxTileSize = dng_point (1, 1);
+	
+	fUncompressedSize = ifd.fTileWidth  *
+						ifd.fTileLength *
+						ifd.fSamplesPerPixel *
+						image.PixelSize ();
+						
+	fCompressedSize = writer.CompressedBufferSize (ifd, fUncompressedSize);
+	
+	for (uint32 j = 0; j < kMaxBatchTiles; j++)
+		{
+		fResultSize [j] = 0;
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void dng_deflate_tile_task::Start (uint32 threadCount,
+								   const dng_point & /* tileSize */,
+								   dng_memory_allocator * /* allocator */,
+								   dng_abort_sniffer * /* sniffer */)
+	{
+	
+	// The buffers are kept from one batch to the next.
+	
+	for (uint32 threadIndex = 0; threadIndex < threadCount; threadIndex++)
+		{
+		
+		if (!fBuffer [threadIndex].Get ())
+			{
+			
+			fBuffer [threadIndex] . Reset (fHost.Allocate (fUncompressedSize));
+			
+			}
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void dng_deflate_tile_task::Process (uint32 threadIndex,
+									 const dng_rect &tile,
+									 dng_abort_sniffer * /* sniffer */)
+	{
+	
+	for (int32 rowIndex = tile.t; rowIndex < tile.b; rowIndex++)
+		{
+		
+		for (int32 colIndex = tile.l; colIndex < tile.r; colIndex++)
+			{
+			
+			dng_rect tileArea = fIFD.TileArea (rowIndex, colIndex);
+			
+			dng_pixel_buffer buffer;
+			
+			buffer.fArea = tileArea;
+			
+			buffer.fPlane  = 0;
+			buffer.fPlanes = fIFD.fSamplesPerPixel;
+			
+			buffer.fRowStep   = buffer.fPlanes * tileArea.W ();
+			buffer.fColStep   = buffer.fPlanes;
+			buffer.fPlaneStep = 1;
+			
+			buffer.fPixelType = fImage.PixelType ();
+			buffer.fPixelSize = fImage.PixelSize ();
+			
+			buffer.fData = fBuffer [threadIndex]->Buffer ();
+			
+			fImage.Get (buffer, dng_image::edge_zero);
+			
+			if (fDigest)
+				{
+				fWriter.fTileDigest->Capture (buffer);
+				}
+				
+			fWriter.EncodePredictor (fHost,
+									 fIFD,
+									 buffer);
+									 
+			uint32 dataSize = PrepareDeflateData (fIFD,
+												  buffer,
+												  fSwapBytes);
+												  
+			uint32 slot = (rowIndex - fBatch.t) * fBatch.W () +
+						  (colIndex - fBatch.l);
+						  
+			if (!fResult [slot].Get ())
+				{
+				
+				fResult [slot] . Reset (fHost.Allocate (fCompressedSize));
+				
+				}
+				
+			fResultSize [slot] = DeflateData (fWriter.fDeflateLevel,
+											  buffer.fData,
+											  dataSize,
+											  fResult [slot]->Buffer (),
+											  fCompressedSize);
 			
 			}
 			
-		default:
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void dng_deflate_tile_task::Put (dng_stream &stream,
+								 uint32 rowIndex,
+								 uint32 colIndex) const
+	{
+	
+	uint32 slot = (rowIndex - fBatch.t) * fBatch.W () +
+				  (colIndex - fBatch.l);
+	
+	stream.Put (fResult [slot]->Buffer (),
+				fResultSize [slot]);
+	
+	}
+
+/*****************************************************************************/
+
+uint32 dng_image_writer::PackedRawBits (dng_host &host,
+										const dng_negative &negative)
+	{
+	
+	const dng_image &image = negative.RawImage ();
+	
+	// The stored values must cover both the data and the white level,
+	// or for linearized data, the linearization table.
+	
+	uint32 maxCode = 0;
+	
+	const dng_linearization_info *rangeInfo = negative.GetLinearizationInfo ();
+	
+	if (rangeInfo && rangeInfo->fLinearizationTable.Get ())
+		{
+		
+		maxCode = (rangeInfo->fLinearizationTable->LogicalSize () >> 1) - 1;
+		
+		}
+		
+	else
+		{
+		
+		for (uint32 plane = 0; plane < image.Planes (); plane++)
 			{
 			
-			ThrowProgramError ();
+			maxCode = Max_uint32 (maxCode, negative.WhiteLevel (plane));
 			
 			}
 			
 		}
+		
+	dng_rect bounds = image.Bounds ();
 	
-	}
-						    
-/*****************************************************************************/
-
-void dng_image_writer::WriteTile (dng_host &host,
-						          const dng_ifd &ifd,
-						          dng_stream &stream,
-						          const dng_image &image,
-						          const dng_rect &tileArea,
-						          uint32 fakeChannels)
-	{
+	uint32 rowSamples = bounds.W () * image.Planes ();
 	
-	// Create pixel buffer to hold uncompressed tile.
+	uint32 bandRows = Max_uint32 (1, kImageBufferSize / (rowSamples * 2));
 	
-	dng_pixel_buffer buffer;
+	AutoPtr<dng_memory_block> block (host.Allocate (bandRows * rowSamples * 2));
 	
-	buffer.fArea = tileArea;
+	dng_pixel_buffer buffer;
 	
 	buffer.fPlane  = 0;
-	buffer.fPlanes = ifd.fSamplesPerPixel;
+	buffer.fPlanes = image.Planes ();
 	
-	buffer.fRowStep   = buffer.fPlanes * tileArea.W ();
-	buffer.fColStep   = buffer.fPlanes;
+	buffer.fRowStep   = rowSamples;
+	buffer.fColStep   = image.Planes ();
 	buffer.fPlaneStep = 1;
 	
-	buffer.fPixelType = image.PixelType ();
-	buffer.fPixelSize = image.PixelSize ();
+	buffer.fPixelType = ttShort;
+	buffer.fPixelSize = 2;
 	
-	buffer.fData = fUncompressedBuffer->Buffer ();
+	buffer.fData = block->Buffer ();
 	
-	// Get the uncompressed data.
+	for (int32 top = bounds.t; top < bounds.b; top += bandRows)
+		{
+		
+		host.SniffForAbort ();
+		
+		buffer.fArea = dng_rect (top,
+								 bounds.l,
+								 Min_int32 (top + bandRows, bounds.b),
+								 bounds.r);
+								 
+		image.Get (buffer);
+		
+		const uint16 *sPtr = block->Buffer_uint16 ();
+		
+		uint32 count = rowSamples * buffer.fArea.H ();
+		
+		uint32 bandMax = 0;
+		
+		for (uint32 j = 0; j < count; j++)
+			{
+			bandMax = Max_uint32 (bandMax, sPtr [j]);
+			}
+			
+		maxCode = Max_uint32 (maxCode, bandMax);
+		
+		}
+		
+	if (maxCode < 0x100)
+		{
+		return 8;
+		}
+		
+	if (maxCode < 0x400)
+		{
+		return 10;
+		}
+		
+	if (maxCode < 0x1000)
+		{
+		return 12;
+		}
+		
+	if (maxCode < 0x4000)
+		{
+		return 14;
+		}
+		
+	return 16;
 	
-	image.Get (buffer, dng_image::edge_zero);
+	}
 	
-	// Deal with sub-tile blocks.
+/*****************************************************************************/
+
+void dng_image_writer::WriteDeflateTiles (dng_host &host,
+										  const dng_ifd &ifd,
+										  dng_basic_tag_set &basic,
+										  dng_stream &stream,
+										  const dng_image &image)
+	{
 	
-	if (ifd.fSubTileBlockRows > 1)
+	uint32 tilesAcross = ifd.TilesAcross ();
+	uint32 tilesDown   = ifd.TilesDown   ();
+	
+	bool digest = fTileDigest.Get () && &fTileDigest->Image () == &image;
+	
+	dng_deflate_tile_task task (*this,
+								host,
+								ifd,
+								image,
+								stream.SwapBytes (),
+								digest);
+								
+	// Batches are whole rows of tiles, or parts of a single row when the
+	// rows are very wide.
+	
+	uint32 batchTiles = task.MaxBatchTiles ();
+	
+	uint32 batchRows = Max_uint32 (1, batchTiles / tilesAcross);
+	uint32 batchCols = Min_uint32 (tilesAcross, batchTiles);
+	
+	if (digest)
 		{
 		
-		ReorderSubTileBlocks (ifd, buffer);
+		fTileDigest->Allocate (host, batchRows * ifd.fTileLength);
 		
 		}
-	
-	// Run predictor.
-	
-	EncodePredictor (host,
-					 ifd,
-					 buffer);
 		
-	// Adjust pixel buffer for fake channels.
-	
-	if (fakeChannels > 1)
+	for (uint32 rowIndex = 0; rowIndex < tilesDown; rowIndex += batchRows)
 		{
 		
-		buffer.fPlanes  *= fakeChannels;
-		buffer.fColStep *= fakeChannels;
+		uint32 rowLimit = Min_uint32 (rowIndex + batchRows, tilesDown);
 		
-		buffer.fArea.r = buffer.fArea.l + (buffer.fArea.W () / fakeChannels);
+		for (uint32 colIndex = 0; colIndex < tilesAcross; colIndex += batchCols)
+			{
+			
+			dng_rect batch (rowIndex,
+							colIndex,
+							rowLimit,
+							Min_uint32 (colIndex + batchCols, tilesAcross));
+							
+			task.SetBatch (batch);
+			
+			host.PerformAreaTask (task, batch);
+			
+			// Write out the batch in tile order.
+			
+			for (int32 row = batch.t; row < batch.b; row++)
+				{
+				
+				for (int32 col = batch.l; col < batch.r; col++)
+					{
+					
+					uint32 tileIndex = row * tilesAcross + col;
+					
+					uint32 tileOffset = (uint32) stream.Position ();
+					
+					basic.SetTileOffset (tileIndex, tileOffset);
+					
+					task.Put (stream, row, col);
+					
+					uint32 tileByteCount = (uint32) stream.Position () - tileOffset;
+					
+					basic.SetTileByteCount (tileIndex, tileByteCount);
+					
+					// Keep the tiles on even byte offsets.
+					
+					if (tileByteCount & 1)
+						{
+						stream.Put_uint8 (0);
+						}
+					
+					}
+				
+				}
+			
+			}
+			
+		if (digest)
+			{
+			fTileDigest->Flush ();
+			}
 		
 		}
-		
-	// Compress (if required) and write out the data.
 	
-	WriteData (host,
-			   ifd,
-			   stream,
-			   buffer);
-			   
 	}
 
 /*****************************************************************************/
@@ -2831,6 +3990,24 @@ void dng_image_writer::WriteImage (dng_host &host,
 		return;
 		
 		}
+		
+	// Deflate compressed tiles are independent, so compress them in
+	// parallel.
+	
+	if (ifd.fCompression == ccDeflate &&
+		ifd.fSubTileBlockRows <= 1 &&
+		fakeChannels == 1)
+		{
+		
+		WriteDeflateTiles (host,
+						   ifd,
+						   basic,
+						   stream,
+						   image);
+						   
+		return;
+		
+		}
 	
 	// Compute basic information.
 	
@@ -2878,19 +4055,46 @@ void dng_image_writer::WriteImage (dng_host &host,
 	
 	uint32 compressedSize = CompressedBufferSize (ifd, uncompressedSize);
 	
+	// If we are saving 8-bit data from a 16-bit image, reserve space to
+	// narrow the data before writing it.
+	
+	if (ifd.fCompression == ccUncompressed &&
+		ifd.fBitsPerSample [0] == 8 &&
+		image.PixelType () == ttShort)
+		{
+		
+		compressedSize = uncompressedSize >> 1;
+		
+		}
+	
 	if (compressedSize)
 		{
 		
 		fCompressedBuffer.Reset (host.Allocate (compressedSize));
 	
 		}
-									
+		
 	// Write out each tile.
 	
 	uint32 tileIndex = 0;
 	
 	uint32 tilesAcross = ifd.TilesAcross ();
 	uint32 tilesDown   = ifd.TilesDown   ();
+	
+	// If computing the raw image digest, allocate a band that holds the
+	// rows being written.  Single tile wide images complete their rows
+	// with each sub-tile, others need a full row of tiles.
+	
+	bool digest = fTileDigest.Get () && &fTileDigest->Image () == &image;
+	
+	if (digest)
+		{
+		
+		fTileDigest->Allocate (host,
+							   tilesAcross == 1 ? subTileLength
+												: ifd.fTileLength);
+		
+		}
 						   
 	for (uint32 rowIndex = 0; rowIndex < tilesDown; rowIndex++)
 		{
@@ -2932,6 +4136,11 @@ void dng_image_writer::WriteImage (dng_host &host,
 						   subArea,
 						   fakeChannels);
 						   
+				if (digest && tilesAcross == 1)
+					{
+					fTileDigest->Flush ();
+					}
+						   
 				}
 				
 			// Update tile count.
@@ -2950,6 +4159,11 @@ void dng_image_writer::WriteImage (dng_host &host,
 				}
 				
 			}
+			
+		if (digest)
+			{
+			fTileDigest->Flush ();
+			}
 
 		}
 		
@@ -3293,6 +4507,14 @@ void dng_image_writer::WriteDNG (dng_host &host,
 		{
 		dngBackwardVersion = Max_uint32 (dngBackwardVersion, dngVersion_1_3_0_0);
 		}
+		
+	// Deflate compressed raw data, and its predictors, need DNG 1.4.
+	
+	if (compression == ccDeflate)
+		{
+		dngVersion         = Max_uint32 (dngVersion        , dngVersion_1_4_0_0);
+		dngBackwardVersion = Max_uint32 (dngBackwardVersion, dngVersion_1_4_0_0);
+		}
 									 
 	if (dngBackwardVersion > dngVersion)
 		{
@@ -3335,10 +4557,10 @@ void dng_image_writer::WriteDNG (dng_host &host,
 	
 	const dng_image &rawImage (negative.RawImage ());
 	
-	// We currently don't support compression for deeper
-	// than 16-bit images.
+	// Lossless JPEG is limited to 16-bit integer images.
 	
-	if (rawImage.PixelType () == ttLong)
+	if ((rawImage.PixelType () == ttLong ||
+		 rawImage.PixelType () == ttFloat) && compression == ccJPEG)
 		{
 		compression = ccUncompressed;
 		}
@@ -3422,12 +4644,64 @@ void dng_image_writer::WriteDNG (dng_host &host,
 			break;
 			}
 			
+		case ttFloat:
+			{
+			
+			info.fBitsPerSample [0] = 32;
+			
+			for (j = 0; j < info.fSamplesPerPixel; j++)
+				{
+				info.fSampleFormat [j] = sfFloatingPoint;
+				}
+				
+			break;
+			
+			}
+			
 		default:
 			{
 			ThrowProgramError ();
 			}
 			
 		}
+		
+	// For Deflate compression, difference each sample against the
+	// previous sample of the same color.
+	
+	if (info.fCompression == ccDeflate)
+		{
+		
+		uint32 cfaWidth = mosaicInfo.IsColorFilterArray () ? mosaicInfo.fCFAPatternSize.h : 1;
+		
+		bool isFloat = (rawPixelType == ttFloat);
+		
+		if (cfaWidth == 2)
+			{
+			info.fPredictor = isFloat ? cpFloatingPointX2 : cpHorizontalDifferenceX2;
+			}
+			
+		else if (cfaWidth == 4)
+			{
+			info.fPredictor = isFloat ? cpFloatingPointX4 : cpHorizontalDifferenceX4;
+			}
+			
+		else
+			{
+			info.fPredictor = isFloat ? cpFloatingPoint : cpHorizontalDifference;
+			}
+		
+		}
+		
+	// Optionally pack uncompressed 16-bit data into fewer bits per sample.
+	
+	if (fPackRawBits &&
+		info.fCompression == ccUncompressed &&
+		rawPixelType == ttShort)
+		{
+		
+		info.fBitsPerSample [0] = PackedRawBits (host, negative);
+		
+		}
 	
 	// For lossless JPEG compression, we often lie about the
 	// actual channel count to get the predictors to work across
@@ -3468,10 +4742,11 @@ void dng_image_writer::WriteDNG (dng_host &host,
 		
 	// Figure out tile sizes.
 	
-	if (info.fCompression == ccJPEG)
+	if (info.fCompression == ccJPEG ||
+		info.fCompression == ccDeflate)
 		{
 		
-		info.FindTileSize (128 * 1024);
+		fRawTilePolicy.Apply (info);
 		
 		}
 		
@@ -3716,26 +4991,58 @@ void dng_image_writer::WriteDNG (dng_host &host,
 		
 		}
 		
-	negative.FindRawImageDigest (host);
+	// If the raw image digest is not already known, compute it from the
+	// tiles as the raw image is written, rather than reading the whole
+	// raw image an extra time.  The tag data is not needed until the IFDs
+	// are written, after the raw data.  Row interleaved images are written
+	// out of order, so those still use a separate pass.
+	
+	fTileDigest.Reset ();
+	
+	bool deferDigest = negative.RawImageDigest ().IsNull () &&
+					   info.fRowInterleaveFactor <= 1;
+	
+	if (deferDigest)
+		{
+		
+		fTileDigest.Reset (new dng_tile_digest (rawImage));
+		
+		}
+		
+	else
+		{
+		
+		negative.FindRawImageDigest (host);
+		
+		}
 	
 	tag_uint8_ptr tagRawImageDigest (tcRawImageDigest,
 									 negative.RawImageDigest ().data,
 							   		 16);
 							   		  
-	if (negative.RawImageDigest ().IsValid ())
+	if (deferDigest || negative.RawImageDigest ().IsValid ())
 		{
 							   
 		mainIFD.Add (&tagRawImageDigest);
 		
 		}
 	
-	negative.FindRawDataUniqueID (host);
+	// The unique ID includes the raw image digest.
+	
+	bool deferUniqueID = deferDigest && negative.RawDataUniqueID ().IsNull ();
+	
+	if (!deferUniqueID)
+		{
+		
+		negative.FindRawDataUniqueID (host);
+		
+		}
 	
 	tag_uint8_ptr tagRawDataUniqueID (tcRawDataUniqueID,
 							   		  negative.RawDataUniqueID ().data,
 							   		  16);
 							   		  
-	if (negative.RawDataUniqueID ().IsValid ())
+	if (deferUniqueID || negative.RawDataUniqueID ().IsValid ())
 		{
 							   
 		mainIFD.Add (&tagRawDataUniqueID);
@@ -3977,6 +5284,24 @@ void dng_image_writer::WriteDNG (dng_host &host,
 				stream,
 				rawImage,
 				fakeChannels);
+				
+	// Finish the raw image digest and unique ID.
+	
+	if (deferDigest)
+		{
+		
+		negative.SetFoundRawImageDigest (fTileDigest->Result ());
+		
+		fTileDigest.Reset ();
+		
+		if (deferUniqueID)
+			{
+			
+			negative.FindRawDataUniqueID (host);
+			
+			}
+		
+		}
 					
 	// Trim the file to this length.
 	
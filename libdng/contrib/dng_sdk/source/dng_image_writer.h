@@ -980,12 +980,77 @@ class tag_dng_noise_profile: public tag_data_ptr
 
 /*****************************************************************************/
 
+/// \brief Policy for choosing the tile geometry of lossless JPEG compressed
+/// raw data written by dng_image_writer::WriteDNG.
+///
+/// Readers that decode tiles in parallel scale with the tile count, while
+/// larger tiles compress slightly better and have less per-tile overhead.
+
+class dng_raw_tile_policy
+	{
+	
+	public:
+	
+		enum
+			{
+			
+			/// Roughly square tiles of about fBytesPerTile uncompressed bytes.
+			
+			kBytesPerTile = 0,
+			
+			/// Tiles of fTileSize pixels, rounded up to multiples of 16.
+			
+			kFixedSize,
+			
+			/// About fTilesPerCPU * fCPUCount roughly square tiles.
+			
+			kTilesPerCPU
+			
+			};
+	
+		uint32 fMode;
+		
+		uint32 fBytesPerTile;
+		
+		dng_point fTileSize;
+		
+		uint32 fTilesPerCPU;
+		
+		uint32 fCPUCount;
+		
+	public:
+	
+		/// Defaults to 128 KB tiles, the size WriteDNG has always used.
+	
+		dng_raw_tile_policy ();
+		
+		/// Sets the tile width and length of ifd, which must already have
+		/// its image size, samples per pixel and bits per sample.
+		/// \param cellH Tile widths are rounded up to a multiple of this.
+		/// \param cellV Tile lengths are rounded up to a multiple of this.
+		
+		void Apply (dng_ifd &ifd,
+					uint32 cellH = 16,
+					uint32 cellV = 16) const;
+		
+	};
+
+/*****************************************************************************/
+
+class dng_tile_digest;
+
+class dng_deflate_tile_task;
+
+/*****************************************************************************/
+
 /// \brief Support for writing dng_image or dng_negative instances to a
 /// dng_stream in TIFF or DNG format.
 
 class dng_image_writer
 	{
 	
+	friend class dng_deflate_tile_task;
+	
 	protected:
 	
 		enum
@@ -1002,12 +1067,61 @@ class dng_image_writer
 		AutoPtr<dng_memory_block> fUncompressedBuffer;
 		
 		AutoPtr<dng_memory_block> fSubTileBlockBuffer;
+		
+		// Used by WriteDNG to compute the RawImageDigest from the tiles
+		// read by WriteTile, instead of in a separate pass over the image.
+		
+		AutoPtr<dng_tile_digest> fTileDigest;
+		
+		dng_raw_tile_policy fRawTilePolicy;
+		
+		int32 fDeflateLevel;
+		
+		bool fPackRawBits;
 	
 	public:
 	
 		dng_image_writer ();
 		
 		virtual ~dng_image_writer ();
+		
+		/// Sets the tile geometry used for compressed raw data by WriteDNG.
+		
+		void SetRawTilePolicy (const dng_raw_tile_policy &policy)
+			{
+			fRawTilePolicy = policy;
+			}
+			
+		const dng_raw_tile_policy & RawTilePolicy () const
+			{
+			return fRawTilePolicy;
+			}
+			
+		/// Sets the zlib level (1 to 9) used for ccDeflate compression.
+		
+		void SetDeflateLevel (int32 level)
+			{
+			fDeflateLevel = level;
+			}
+			
+		int32 DeflateLevel () const
+			{
+			return fDeflateLevel;
+			}
+			
+		/// When set, WriteDNG stores uncompressed 16-bit raw data with
+		/// only as many bits per sample (10, 12 or 14) as its largest
+		/// value needs, tightly packed.
+		
+		void SetPackRawBits (bool pack)
+			{
+			fPackRawBits = pack;
+			}
+			
+		bool PackRawBits () const
+			{
+			return fPackRawBits;
+			}
 
 		virtual void WriteImage (dng_host &host,
 						         const dng_ifd &ifd,
@@ -1071,7 +1185,7 @@ class dng_image_writer
 		/// \param stream The dng_stream on which to write the TIFF.
 		/// \param negative The image data and metadata (EXIF, IPTC, XMP) to be written.
 		/// \param thumbnail Thumbanil image. Must be provided.
-		/// \param compression Either ccUncompressed or ccJPEG for lossless JPEG.
+		/// \param compression Either ccUncompressed, ccJPEG for lossless JPEG, or ccDeflate.
 		/// \param previewList List of previews (not counting thumbnail) to write to the file. Defaults to empty.
 
 		virtual void WriteDNG (dng_host &host,
@@ -1107,6 +1221,15 @@ class dng_image_writer
 						        const dng_image &image,
 						        const dng_rect &tileArea,
 						        uint32 fakeChannels);
+						        
+		void WriteDeflateTiles (dng_host &host,
+								const dng_ifd &ifd,
+								dng_basic_tag_set &basic,
+								dng_stream &stream,
+								const dng_image &image);
+								
+		virtual uint32 PackedRawBits (dng_host &host,
+									  const dng_negative &negative);
 
 	};
 	
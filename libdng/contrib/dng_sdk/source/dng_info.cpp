@@ -2378,7 +2378,101 @@ bool dng_info::IsValidDNG ()
 			}
 		
 		}
+		
+	// The SDK is for DNG 1.3. Files that need a DNG 1.4 reader are only
+	// accepted when the 1.4 features they use are implemented here.
+	
+	if (fShared->fDNGBackwardVersion > dngVersion_MaxBackward &&
+		!IsSupportedDNG14 ())
+		{
+		
+		return false;
+		
+		}
+			
+	return true;
+	
+	}
+
+/*****************************************************************************/
+
+bool dng_info::IsSupportedDNG14 () const
+	{
+	
+	// Tags that change how the image is rendered.
+	
+	uint32 unsupportedTag = fShared->fUnsupportedTag;
+	
+	if (!unsupportedTag)
+		{
+		unsupportedTag = fShared->fCameraProfile.fUnsupportedTag;
+		}
+		
+	if (unsupportedTag)
+		{
+		
+		#if qDNGValidate
+		
+		char message [256];
+		
+		sprintf (message,
+				 "Unsupported DNG 1.4 value for %s",
+				 LookupTagCode (0, unsupportedTag));
+				 
+		ReportError (message);
+		
+		#endif
+		
+		return false;
+		
+		}
+		
+	for (uint32 index = 0; index < fIFDCount; index++)
+		{
+		
+		const dng_ifd &ifd = *fIFD [index];
+		
+		// The raw data must use a compression this SDK can decode.
+		// IsValidDNG already limits its sample formats and predictors.
+		
+		if (index == (uint32) fMainIndex &&
+			ifd.fCompression != ccUncompressed &&
+			ifd.fCompression != ccJPEG &&
+			ifd.fCompression != ccDeflate)
+			{
+			
+			#if qDNGValidate
+			
+			ReportError (ifd.fCompression == ccLossyJPEG
+						 ? "Lossy JPEG compressed raw data is not supported"
+						 : "Unsupported DNG 1.4 compression");
+						 
+			#endif
+			
+			return false;
 			
+			}
+			
+		// New kinds of IFD, such as transparency masks, would otherwise be
+		// dropped without notice.
+			
+		if (ifd.fNewSubFileType != sfMainImage    &&
+			ifd.fNewSubFileType != sfPreviewImage &&
+			ifd.fNewSubFileType != sfAltPreviewImage)
+			{
+			
+			#if qDNGValidate
+			
+			ReportError ("Unsupported DNG 1.4 NewSubFileType");
+						 
+			#endif
+			
+			return false;
+			
+			}
+			
+		}
+		
 	return true;
 	
 	}
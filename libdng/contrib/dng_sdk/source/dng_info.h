@@ -90,6 +90,11 @@ class dng_info
 		virtual bool IsValidDNG ();
 		
 	protected:
+	
+		/// Checks a file that needs a DNG 1.4 reader for 1.4 features
+		/// this SDK does not implement.
+		
+		virtual bool IsSupportedDNG14 () const;
 		
 		virtual void ValidateMagic ();
 
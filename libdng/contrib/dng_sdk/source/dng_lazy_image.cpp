@@ -0,0 +1,359 @@
+/*****************************************************************************/
+
+#include "dng_lazy_image.h"
+
+#include "dng_exceptions.h"
+#include "dng_pixel_buffer.h"
+#include "dng_simple_image.h"
+#include "dng_tag_types.h"
+#include "dng_utils.h"
+
+/*****************************************************************************/
+
+// The cache always has room for a few tiles, so that reads which straddle
+// tile boundaries do not evict the tiles they are still using.
+
+const uint32 kMinCacheTiles = 4;
+
+/*****************************************************************************/
+
+dng_lazy_image::dng_lazy_image (const dng_rect &bounds,
+								uint32 planes,
+								uint32 pixelType,
+								const dng_point &tileSize,
+								uint32 cacheSize,
+								dng_memory_allocator &allocator)
+
+	:	dng_image (bounds,
+				   planes,
+				   pixelType)
+
+	,	fAllocator     (allocator)
+	,	fTileSize      (tileSize)
+	,	fCacheTiles    (kMinCacheTiles)
+	,	fMutex         ("dng_lazy_image")
+	,	fTiles         ()
+	,	fUseCount      (0)
+	,	fComputedTiles (0)
+
+	{
+
+	if (fTileSize.v <= 0 || fTileSize.h <= 0)
+		{
+		ThrowProgramError ("Bad tile size for dng_lazy_image");
+		}
+
+	uint32 tileBytes = fTileSize.v *
+					   fTileSize.h *
+					   planes *
+					   TagTypeSize (pixelType);
+
+	fCacheTiles = Max_uint32 (cacheSize / Max_uint32 (tileBytes, 1),
+							  kMinCacheTiles);
+
+	}
+
+/*****************************************************************************/
+
+dng_lazy_image::~dng_lazy_image ()
+	{
+
+	for (uint32 index = 0; index < fTiles.size (); index++)
+		{
+
+		DNG_ASSERT (fTiles [index]->fRefCount == 0,
+					"Lazy image deleted while a tile is in use");
+
+		delete fTiles [index];
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+dng_image * dng_lazy_image::Clone () const
+	{
+
+	AutoPtr<dng_image> result (new dng_simple_image (Bounds (),
+													 Planes (),
+													 PixelType (),
+													 fAllocator));
+
+	result->CopyArea (*this,
+					  Bounds (),
+					  0,
+					  Planes ());
+
+	return result.Release ();
+
+	}
+
+/*****************************************************************************/
+
+dng_rect dng_lazy_image::RepeatingTile () const
+	{
+
+	return dng_rect (fTileSize.v, fTileSize.h) + fBounds.TL ();
+
+	}
+
+/*****************************************************************************/
+
+void dng_lazy_image::TrimCache () const
+	{
+
+	// Called with the mutex held. Drops failed tiles, then the least
+	// recently used tiles until there is room for one more. Tiles that
+	// are in use or still being computed are never dropped.
+
+	uint32 index = 0;
+
+	while (index < fTiles.size ())
+		{
+
+		tile_entry *entry = fTiles [index];
+
+		if (entry->fFailed && entry->fRefCount == 0)
+			{
+
+			fTiles.erase (fTiles.begin () + index);
+
+			delete entry;
+
+			}
+
+		else
+			{
+
+			index++;
+
+			}
+
+		}
+
+	while (fTiles.size () >= fCacheTiles)
+		{
+
+		int32 oldest = -1;
+
+		for (index = 0; index < fTiles.size (); index++)
+			{
+
+			tile_entry *entry = fTiles [index];
+
+			if (entry->fRefCount == 0 && entry->fImage.Get ())
+				{
+
+				if (oldest < 0 || entry->fLastUse < fTiles [oldest]->fLastUse)
+					{
+					oldest = index;
+					}
+
+				}
+
+			}
+
+		if (oldest < 0)
+			{
+			break;
+			}
+
+		tile_entry *entry = fTiles [oldest];
+
+		fTiles.erase (fTiles.begin () + oldest);
+
+		delete entry;
+
+		}
+
+	}
+
+/*****************************************************************************/
+
+void dng_lazy_image::AcquireTileBuffer (dng_tile_buffer &buffer,
+										const dng_rect &area,
+										bool dirty) const
+	{
+
+	if (dirty)
+		{
+		ThrowProgramError ("dng_lazy_image is read-only");
+		}
+
+	// Find the tile that holds the area. The tile iterators only ask for
+	// areas within one tile of the RepeatingTile grid.
+
+	int32 tileRow = (area.t - fBounds.t) / fTileSize.v;
+	int32 tileCol = (area.l - fBounds.l) / fTileSize.h;
+
+	dng_rect tileArea (fBounds.t + tileRow * fTileSize.v,
+					   fBounds.l + tileCol * fTileSize.h,
+					   fBounds.t + (tileRow + 1) * fTileSize.v,
+					   fBounds.l + (tileCol + 1) * fTileSize.h);
+
+	tileArea = tileArea & fBounds;
+
+	if (area.IsEmpty () || (area & tileArea) != area)
+		{
+		ThrowProgramError ("Area spans more than one dng_lazy_image tile");
+		}
+
+	tile_entry *entry = NULL;
+
+	bool compute = false;
+
+	while (!entry)
+		{
+
+		dng_lock_mutex lock (&fMutex);
+
+		for (uint32 index = 0; index < fTiles.size (); index++)
+			{
+
+			if (fTiles [index]->fArea == tileArea && !fTiles [index]->fFailed)
+				{
+				entry = fTiles [index];
+				break;
+				}
+
+			}
+
+		if (!entry)
+			{
+
+			TrimCache ();
+
+			AutoPtr<tile_entry> newEntry (new tile_entry);
+
+			newEntry->fArea     = tileArea;
+			newEntry->fRefCount = 0;
+			newEntry->fLastUse  = 0;
+			newEntry->fFailed   = false;
+
+			fTiles.push_back (newEntry.Get ());
+
+			entry = newEntry.Release ();
+
+			compute = true;
+
+			}
+
+		entry->fRefCount++;
+
+		entry->fLastUse = ++fUseCount;
+
+		#if qDNGThreadSafe
+
+		// Another thread is computing this tile. If it fails, try again
+		// here, so that this thread sees the same error.
+
+		while (!compute && !entry->fImage.Get () && !entry->fFailed)
+			{
+			fTileReady.Wait (fMutex);
+			}
+
+		#endif
+
+		if (entry->fFailed)
+			{
+
+			entry->fRefCount--;
+
+			entry = NULL;
+
+			}
+
+		}
+
+	if (compute)
+		{
+
+		try
+			{
+
+			AutoPtr<dng_simple_image> tile (new dng_simple_image (tileArea,
+																  Planes (),
+																  PixelType (),
+																  fAllocator));
+
+			ComputeTile (*tile.Get ());
+
+			dng_lock_mutex lock (&fMutex);
+
+			entry->fImage.Reset (tile.Release ());
+
+			fComputedTiles++;
+
+			#if qDNGThreadSafe
+
+			fTileReady.Broadcast ();
+
+			#endif
+
+			}
+
+		catch (...)
+			{
+
+			dng_lock_mutex lock (&fMutex);
+
+			entry->fFailed = true;
+
+			entry->fRefCount--;
+
+			#if qDNGThreadSafe
+
+			fTileReady.Broadcast ();
+
+			#endif
+
+			throw;
+
+			}
+
+		}
+
+	dng_pixel_buffer tileBuffer;
+
+	entry->fImage->GetPixelBuffer (tileBuffer);
+
+	buffer.fArea = area;
+
+	buffer.fPlane      = 0;
+	buffer.fPlanes     = tileBuffer.fPlanes;
+	buffer.fRowStep    = tileBuffer.fRowStep;
+	buffer.fColStep    = tileBuffer.fColStep;
+	buffer.fPlaneStep  = tileBuffer.fPlaneStep;
+	buffer.fPixelType  = tileBuffer.fPixelType;
+	buffer.fPixelSize  = tileBuffer.fPixelSize;
+
+	buffer.fData = (void *) tileBuffer.ConstPixel (area.t,
+												   area.l,
+												   0);
+
+	buffer.fDirty = false;
+
+	buffer.SetRefData (entry);
+
+	}
+
+/*****************************************************************************/
+
+void dng_lazy_image::ReleaseTileBuffer (dng_tile_buffer &buffer) const
+	{
+
+	tile_entry *entry = (tile_entry *) buffer.GetRefData ();
+
+	if (entry)
+		{
+
+		dng_lock_mutex lock (&fMutex);
+
+		entry->fRefCount--;
+
+		}
+
+	}
+
+/*****************************************************************************/
@@ -0,0 +1,145 @@
+/*****************************************************************************/
+
+/** \file
+ * Images whose pixels are computed on demand, one tile at a time.
+ */
+
+/*****************************************************************************/
+
+#ifndef __dng_lazy_image__
+#define __dng_lazy_image__
+
+/*****************************************************************************/
+
+#include <vector>
+
+#include "dng_auto_ptr.h"
+#include "dng_classes.h"
+#include "dng_image.h"
+#include "dng_mutex.h"
+#include "dng_point.h"
+#include "dng_rect.h"
+#include "dng_simple_image.h"
+#include "dng_types.h"
+
+/*****************************************************************************/
+
+/// \brief Read-only image whose pixels are computed only when they are read.
+///
+/// The image is divided into a grid of tiles. The first time a tile is
+/// accessed, ComputeTile is called to fill it in, and the result is kept in
+/// a least-recently-used cache of bounded size. Reading a small area of the
+/// image only computes the tiles that overlap it, and reading the whole
+/// image in order only keeps a few tiles in memory at a time.
+///
+/// Tiles may be read from several threads at once. A tile being computed
+/// by one thread is waited for, not computed twice.
+
+class dng_lazy_image: public dng_image
+	{
+
+	private:
+
+		struct tile_entry
+			{
+
+			dng_rect fArea;
+
+			AutoPtr<dng_simple_image> fImage;
+
+			uint32 fRefCount;
+
+			uint64 fLastUse;
+
+			bool fFailed;
+
+			};
+
+	protected:
+
+		dng_memory_allocator &fAllocator;
+
+		dng_point fTileSize;
+
+		uint32 fCacheTiles;
+
+	private:
+
+		mutable dng_mutex fMutex;
+
+		#if qDNGThreadSafe
+
+		mutable dng_condition fTileReady;
+
+		#endif
+
+		mutable std::vector<tile_entry *> fTiles;
+
+		mutable uint64 fUseCount;
+
+		mutable uint32 fComputedTiles;
+
+	public:
+
+		/// Create a lazy image.
+		/// \param bounds Bounds of the image.
+		/// \param planes Number of image planes.
+		/// \param pixelType Pixel type of the image.
+		/// \param tileSize Size of the tiles that are computed and cached.
+		/// \param cacheSize Approximate number of bytes of computed tiles to
+		/// keep. At least a few tiles are always kept.
+		/// \param allocator Allocator for the tile memory.
+
+		dng_lazy_image (const dng_rect &bounds,
+						uint32 planes,
+						uint32 pixelType,
+						const dng_point &tileSize,
+						uint32 cacheSize,
+						dng_memory_allocator &allocator);
+
+		virtual ~dng_lazy_image ();
+
+		/// Computes the whole image into a dng_simple_image.
+
+		virtual dng_image * Clone () const;
+
+		virtual dng_rect RepeatingTile () const;
+
+		/// Number of tiles computed so far, including tiles computed again
+		/// after being dropped from the cache.
+
+		uint32 ComputedTiles () const
+			{
+			return fComputedTiles;
+			}
+
+	protected:
+
+		/// Compute the pixels for one tile.
+		/// \param tile Image to fill in. Its bounds are the area of the tile.
+
+		virtual void ComputeTile (dng_image &tile) const = 0;
+
+		virtual void AcquireTileBuffer (dng_tile_buffer &buffer,
+										const dng_rect &area,
+										bool dirty) const;
+
+		virtual void ReleaseTileBuffer (dng_tile_buffer &buffer) const;
+
+	private:
+
+		void TrimCache () const;
+
+		// Hidden copy constructor and assignment operator.
+
+		dng_lazy_image (const dng_lazy_image &image);
+
+		dng_lazy_image & operator= (const dng_lazy_image &image);
+
+	};
+
+/*****************************************************************************/
+
+#endif
+
+/*****************************************************************************/
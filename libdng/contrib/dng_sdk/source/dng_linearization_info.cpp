@@ -28,6 +28,108 @@
 
 /*****************************************************************************/
 
+// Most pixels go through a single table lookup. The two tables alternate
+// column by column, for black patterns two columns wide; pass the same
+// table twice otherwise.
+
+template <class T>
+static void LookupRow16 (const T *sPtr,
+						 int32 sStep,
+						 uint16 *dPtr,
+						 int32 dStep,
+						 uint32 count,
+						 const uint16 *table0,
+						 const uint16 *table1)
+	{
+	
+	uint32 j = 0;
+	
+	if (sStep == 1 && dStep == 1)
+		{
+		
+		for (; j + 1 < count; j += 2)
+			{
+			
+			dPtr [j    ] = table0 [sPtr [j    ]];
+			dPtr [j + 1] = table1 [sPtr [j + 1]];
+			
+			}
+			
+		if (j < count)
+			{
+			
+			dPtr [j] = table0 [sPtr [j]];
+			
+			}
+		
+		return;
+		
+		}
+		
+	for (; j < count; j++)
+		{
+		
+		*dPtr = (j & 1) ? table1 [*sPtr] : table0 [*sPtr];
+		
+		sPtr += sStep;
+		dPtr += dStep;
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+// Integer math for black levels that vary too much to fold into tables.
+// The table lookups are done a block at a time, so the black level
+// subtraction, shift and clipping run as plain loops over contiguous
+// arrays, which the compiler can vectorize.
+
+static void LinearizeRow16 (const uint16 *sPtr,
+							uint16 *dPtr,
+							uint32 count,
+							const int32 *lut,
+							int32 b1,
+							const int32 *b2)
+	{
+	
+	const uint32 kBlockSize = 256;
+	
+	int32 x [kBlockSize];
+	
+	for (uint32 j = 0; j < count; j += kBlockSize)
+		{
+		
+		uint32 n = Min_uint32 (kBlockSize, count - j);
+		
+		uint32 k;
+		
+		for (k = 0; k < n; k++)
+			{
+			x [k] = lut [sPtr [j + k]] - b1;
+			}
+			
+		if (b2)
+			{
+			
+			for (k = 0; k < n; k++)
+				{
+				x [k] -= b2 [j + k];
+				}
+				
+			}
+			
+		for (k = 0; k < n; k++)
+			{
+			dPtr [j + k] = (uint16) Pin_int32 (0, x [k] >> 8, 0x0FFFF);
+			}
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
 class dng_linearize_plane
 	{
 	
@@ -58,6 +160,11 @@ class dng_linearize_plane
 		
 		AutoPtr<dng_memory_block> fBlack_1D_buffer;
 		
+		uint32 fFused_rows;
+		uint32 fFused_cols;
+		
+		AutoPtr<dng_memory_block> fFused_buffer;
+		
 	public:
 	
 		dng_linearize_plane (dng_host &host,
@@ -94,6 +201,9 @@ dng_linearize_plane::dng_linearize_plane (dng_host &host,
 	,	fBlack_2D_buffer ()
 	,	fBlack_1D_rows (0)
 	,	fBlack_1D_buffer ()
+	,	fFused_rows (0)
+	,	fFused_cols (0)
+	,	fFused_buffer ()
 	
 	{
 	
@@ -143,9 +253,11 @@ dng_linearize_plane::dng_linearize_plane (dng_host &host,
 	
 	fScale = (real32) scale;
 		
-	// Calculate two-dimensional black pattern, if any.
+	// Calculate two-dimensional black pattern, if any. Each row of the
+	// pattern is expanded to the full active width, so it lines up with
+	// the image columns.
 	
-	if (info.fBlackDeltaH.Get ())
+	if (info.fBlackDeltaH.Get () || info.fBlackLevelRepeatCols > 1)
 		{
 		
 		fBlack_2D_rows = info.fBlackLevelRepeatRows;
@@ -153,14 +265,6 @@ dng_linearize_plane::dng_linearize_plane (dng_host &host,
 		
 		}
 		
-	else if (info.fBlackLevelRepeatCols > 1)
-		{
-		
-		fBlack_2D_rows = info.fBlackLevelRepeatRows;
-		fBlack_2D_cols = info.fBlackLevelRepeatCols;
-		
-		}
-		
 	if (fBlack_2D_rows)
 		{
 		
@@ -405,6 +509,74 @@ dng_linearize_plane::dng_linearize_plane (dng_host &host,
 				
 				}
 				
+			// If the black level only repeats over a small pattern, fold
+			// it into one 16-bit table per pattern cell, so the integer
+			// math case becomes a single lookup per pixel.
+			
+			const uint32 kMaxFusedTables = 4;
+			
+			uint32 fusedRows = info.fBlackLevelRepeatRows;
+			uint32 fusedCols = fBlack_2D_rows ? info.fBlackLevelRepeatCols : 1;
+			
+			if (!fReal32 &&
+				!info.fBlackDeltaH.Get () &&
+				!info.fBlackDeltaV.Get () &&
+				fusedCols <= 2 &&
+				fusedCols <= info.fActiveArea.W () &&
+				fusedRows * fusedCols <= kMaxFusedTables)
+				{
+				
+				fFused_rows = fusedRows;
+				fFused_cols = fusedCols;
+				
+				fFused_buffer.Reset (host.Allocate (fusedRows * fusedCols * 0x10000 * 2));
+				
+				const int32 *lut = fScale_buffer->Buffer_int32 ();
+				
+				for (uint32 row = 0; row < fusedRows; row++)
+					{
+					
+					int32 b1 = 0;
+					
+					if (fBlack_1D_rows)
+						{
+						b1 = fBlack_1D_buffer->Buffer_int32 () [row % fBlack_1D_rows];
+						}
+						
+					b1 -= 128;		// Rounding for 8 bit shift
+					
+					for (uint32 col = 0; col < fusedCols; col++)
+						{
+						
+						int32 b2 = 0;
+						
+						if (fBlack_2D_rows)
+							{
+							b2 = fBlack_2D_buffer->Buffer_int32 () [row * fBlack_2D_cols + col];
+							}
+							
+						uint16 *table = fFused_buffer->Buffer_uint16 () +
+										(row * fusedCols + col) * 0x10000;
+						
+						for (j = 0; j < 0x10000; j++)
+							{
+							
+							int32 x = lut [j] - b1;
+							
+							x -= b2;
+							
+							x >>= 8;
+							
+							table [j] = Pin_uint16 (x);
+							
+							}
+							
+						}
+						
+					}
+				
+				}
+				
 			}
 		
 		}
@@ -463,39 +635,29 @@ void dng_linearize_plane::Process (const dng_rect &srcTile)
 				
 				const uint16 *lut = fScale_buffer->Buffer_uint16 ();
 				
-				uint16 *dstPtr = (uint16 *) dPtr;
-				
 				if (fSrcPixelType == ttByte)
 					{
 					
-					const uint8 *srcPtr = (const uint8 *) sPtr;
-			
-					for (uint32 j = 0; j < count; j++)
-						{
-						
-						*dstPtr = lut [*srcPtr];
-						
-						srcPtr += sStep;
-						dstPtr += dStep;
-						
-						}
+					LookupRow16 ((const uint8 *) sPtr,
+								 sStep,
+								 (uint16 *) dPtr,
+								 dStep,
+								 count,
+								 lut,
+								 lut);
 						
 					}
 					
 				else
 					{
 
-					const uint16 *srcPtr = (const uint16 *) sPtr;
-			
-					for (uint32 j = 0; j < count; j++)
-						{
-						
-						*dstPtr = lut [*srcPtr];
-						
-						srcPtr += sStep;
-						dstPtr += dStep;
-						
-						}
+					LookupRow16 ((const uint16 *) sPtr,
+								 sStep,
+								 (uint16 *) dPtr,
+								 dStep,
+								 count,
+								 lut,
+								 lut);
 						
 					}
 					
@@ -546,6 +708,45 @@ void dng_linearize_plane::Process (const dng_rect &srcTile)
 			
 			}
 			
+		// Black pattern folded into the tables.
+		
+		else if (fFused_buffer.Get ())
+			{
+			
+			const uint16 *tables = fFused_buffer->Buffer_uint16 () +
+								   (dstRow % fFused_rows) * fFused_cols * 0x10000;
+								   
+			const uint16 *table0 = tables + ((dstCol    ) % fFused_cols) * 0x10000;
+			const uint16 *table1 = tables + ((dstCol + 1) % fFused_cols) * 0x10000;
+			
+			if (fSrcPixelType == ttByte)
+				{
+				
+				LookupRow16 ((const uint8 *) sPtr,
+							 sStep,
+							 (uint16 *) dPtr,
+							 dStep,
+							 count,
+							 table0,
+							 table1);
+					
+				}
+				
+			else
+				{
+
+				LookupRow16 ((const uint16 *) sPtr,
+							 sStep,
+							 (uint16 *) dPtr,
+							 dStep,
+							 count,
+							 table0,
+							 table1);
+					
+				}
+			
+			}
+			
 		// Integer math case.
 		
 		else if (!fReal32)
@@ -579,7 +780,19 @@ void dng_linearize_plane::Process (const dng_rect &srcTile)
 
 			b1 -= 128;		// Rounding for 8 bit shift
 			
-			if (fSrcPixelType == ttByte)
+			if (fSrcPixelType == ttShort && sStep == 1 && dStep == 1)
+				{
+				
+				LinearizeRow16 ((const uint16 *) sPtr,
+								dstPtr,
+								count,
+								lut,
+								b1,
+								b2 ? b2 + b2_phase : NULL);
+				
+				}
+			
+			else if (fSrcPixelType == ttByte)
 				{
 			
 				const uint8 *srcPtr = (const uint8 *) sPtr;
@@ -1315,8 +1528,10 @@ void dng_linearization_info::Linearize (dng_host &host,
 								   srcImage,
 								   dstImage);
 								   
+	// The destination may cover only part of the active area.
+	
 	host.PerformAreaTask (processor,
-						  fActiveArea);
+						  dstImage.Bounds () + fActiveArea.TL ());
 						
 	}
 				
@@ -118,7 +118,8 @@ class dng_linearization_info
 		/// Convert raw data from in-file format to a true linear image using linearization data from DNG.
 		/// \param host Used to allocate buffers, check for aborts, and post progress updates.
 		/// \param srcImage Input pre-linearization RAW samples.
-		/// \param dstImage Output linearized image.
+		/// \param dstImage Output linearized image. Only the part of the active area
+		/// covered by its bounds is computed.
 
 		virtual void Linearize (dng_host &host,
 								const dng_image &srcImage,
@@ -1090,6 +1090,208 @@ void dng_bilinear_interpolator::Interpolate (dng_pixel_buffer &srcBuffer,
 	
 /*****************************************************************************/
 
+class dng_bilinear_interpolate_task: public dng_area_task
+	{
+	
+	protected:
+	
+		const dng_mosaic_info &fInfo;
+		
+		const dng_image &fSrcImage;
+		
+		dng_image &fDstImage;
+		
+		uint32 fSrcPlane;
+		
+		uint32 fSrcShiftV;
+		uint32 fSrcShiftH;
+		
+		dng_point fSrcTileSize;
+		
+		AutoPtr<dng_memory_block> fSrcBuffer [kMaxMPThreads];
+		AutoPtr<dng_memory_block> fDstBuffer [kMaxMPThreads];
+		
+		AutoPtr<dng_bilinear_interpolator> fInterpolator [kMaxMPThreads];
+		
+	public:
+	
+		dng_bilinear_interpolate_task (const dng_mosaic_info &info,
+									   const dng_image &srcImage,
+									   dng_image &dstImage,
+									   uint32 srcPlane);
+		
+		virtual dng_rect RepeatingTile1 () const;
+		
+		virtual void Start (uint32 threadCount,
+							const dng_point &tileSize,
+							dng_memory_allocator *allocator,
+							dng_abort_sniffer *sniffer);
+							
+		virtual void Process (uint32 threadIndex,
+							  const dng_rect &dstTile,
+							  dng_abort_sniffer *sniffer);
+		
+	};
+
+/*****************************************************************************/
+
+dng_bilinear_interpolate_task::dng_bilinear_interpolate_task (const dng_mosaic_info &info,
+															  const dng_image &srcImage,
+															  dng_image &dstImage,
+															  uint32 srcPlane)
+															  
+	:	fInfo      (info    )
+	,	fSrcImage  (srcImage)
+	,	fDstImage  (dstImage)
+	,	fSrcPlane  (srcPlane)
+	,	fSrcShiftV (0)
+	,	fSrcShiftH (0)
+	,	fSrcTileSize ()
+	
+	{
+	
+	// Find destination to source bit shifts.
+	
+	dng_point scale = fInfo.FullScale ();
+	
+	fSrcShiftV = scale.v - 1;
+	fSrcShiftH = scale.h - 1;
+	
+	// Keep the destination tiles small enough that the source and
+	// destination buffers stay in cache.
+	
+	const int32 kMaxDstTileRows = 128;
+	const int32 kMaxDstTileCols = 128;
+	
+	fMaxTileSize = fDstImage.RepeatingTile ().Size ();
+	
+	fMaxTileSize.v = Min_int32 (fMaxTileSize.v, kMaxDstTileRows);
+	fMaxTileSize.h = Min_int32 (fMaxTileSize.h, kMaxDstTileCols);
+	
+	}
+
+/*****************************************************************************/
+
+dng_rect dng_bilinear_interpolate_task::RepeatingTile1 () const
+	{
+	
+	return fDstImage.RepeatingTile ();
+	
+	}
+
+/*****************************************************************************/
+
+void dng_bilinear_interpolate_task::Start (uint32 threadCount,
+										   const dng_point &tileSize,
+										   dng_memory_allocator *allocator,
+										   dng_abort_sniffer * /* sniffer */)
+	{
+	
+	// A destination tile that starts on an odd row or column can touch
+	// one more source row or column than its size alone suggests.
+	
+	fSrcTileSize.v = (tileSize.v + (1 << fSrcShiftV) - 1) >> fSrcShiftV;
+	fSrcTileSize.h = (tileSize.h + (1 << fSrcShiftH) - 1) >> fSrcShiftH;
+	
+	fSrcTileSize.v += fInfo.fCFAPatternSize.v * 2;
+	fSrcTileSize.h += fInfo.fCFAPatternSize.h * 2;
+	
+	uint32 srcBufferSize = fSrcImage.PixelSize () *
+						   fSrcTileSize.h *
+						   fSrcTileSize.v;
+						   
+	uint32 dstBufferSize = fDstImage.PixelSize () *
+						   fInfo.fColorPlanes *
+						   tileSize.h *
+						   tileSize.v;
+	
+	for (uint32 threadIndex = 0; threadIndex < threadCount; threadIndex++)
+		{
+		
+		fSrcBuffer [threadIndex] . Reset (allocator->Allocate (srcBufferSize));
+		fDstBuffer [threadIndex] . Reset (allocator->Allocate (dstBufferSize));
+		
+		// The kernel offsets depend on the source row step, which is the
+		// same for every tile, so each thread builds its interpolator once.
+		
+		fInterpolator [threadIndex] . Reset (new dng_bilinear_interpolator (fInfo,
+																			fSrcTileSize.h,
+																			1));
+		
+		}
+		
+	}
+							
+/*****************************************************************************/
+
+void dng_bilinear_interpolate_task::Process (uint32 threadIndex,
+											 const dng_rect &dstTile,
+											 dng_abort_sniffer * /* sniffer */)
+	{
+	
+	// Setup buffers for this tile.
+	
+	dng_rect srcTile (dstTile);
+	
+	srcTile.t >>= fSrcShiftV;
+	srcTile.b >>= fSrcShiftV;
+	
+	srcTile.l >>= fSrcShiftH;
+	srcTile.r >>= fSrcShiftH;
+	
+	srcTile.t -= fInfo.fCFAPatternSize.v;
+	srcTile.b += fInfo.fCFAPatternSize.v;
+	
+	srcTile.l -= fInfo.fCFAPatternSize.h;
+	srcTile.r += fInfo.fCFAPatternSize.h;
+	
+	dng_pixel_buffer srcBuffer;
+	
+	srcBuffer.fArea = srcTile;
+	
+	srcBuffer.fPlane = fSrcPlane;
+	
+	srcBuffer.fRowStep = fSrcTileSize.h;
+
+	srcBuffer.fPixelType = fSrcImage.PixelType ();
+	srcBuffer.fPixelSize = fSrcImage.PixelSize ();
+	
+	srcBuffer.fData = fSrcBuffer [threadIndex]->Buffer ();
+	
+	dng_pixel_buffer dstBuffer;
+	
+	dstBuffer.fArea = dstTile;
+	
+	dstBuffer.fPlanes = fInfo.fColorPlanes;
+	
+	dstBuffer.fRowStep   = dstTile.W () * fInfo.fColorPlanes;
+	dstBuffer.fPlaneStep = dstTile.W ();
+	
+	dstBuffer.fPixelType = fDstImage.PixelType ();
+	dstBuffer.fPixelSize = fDstImage.PixelSize ();
+	
+	dstBuffer.fData = fDstBuffer [threadIndex]->Buffer ();
+	
+	// Get source data.
+	
+	fSrcImage.Get (srcBuffer,
+				   dng_image::edge_repeat,
+				   fInfo.fCFAPatternSize.v,
+				   fInfo.fCFAPatternSize.h);
+				  
+	// Process data.
+	
+	fInterpolator [threadIndex]->Interpolate (srcBuffer,
+											  dstBuffer);
+							  
+	// Save results.
+	
+	fDstImage.Put (dstBuffer);
+	
+	}
+
+/*****************************************************************************/
+
 class dng_fast_interpolator: public dng_filter_task
 	{
 	
@@ -1793,134 +1995,17 @@ void dng_mosaic_info::InterpolateGeneric (dng_host &host,
 								   		  uint32 srcPlane) const
 	{
 	
-	// Find destination to source bit shifts.
-	
-	dng_point scale = FullScale ();
-	
-	uint32 srcShiftV = scale.v - 1;
-	uint32 srcShiftH = scale.h - 1;
-	
-	// Find tile sizes.
-	
-	const uint32 kMaxDstTileRows = 128;
-	const uint32 kMaxDstTileCols = 128;
-	
-	dng_point dstTileSize = dstImage.RepeatingTile ().Size ();
-	
-	dstTileSize.v = Min_int32 (dstTileSize.v, kMaxDstTileRows);
-	dstTileSize.h = Min_int32 (dstTileSize.h, kMaxDstTileCols);
-	
-	dng_point srcTileSize = dstTileSize;
-	
-	srcTileSize.v >>= srcShiftV;
-	srcTileSize.h >>= srcShiftH;
-	
-	srcTileSize.v += fCFAPatternSize.v * 2;
-	srcTileSize.h += fCFAPatternSize.h * 2;
-	
-	// Allocate source buffer.
-	
-	dng_pixel_buffer srcBuffer;
-	
-	srcBuffer.fPlane = srcPlane;
-	
-	srcBuffer.fRowStep = srcTileSize.h;
-
-	srcBuffer.fPixelType = srcImage.PixelType ();
-	srcBuffer.fPixelSize = srcImage.PixelSize ();
-	
-	uint32 srcBufferSize = srcBuffer.fPixelSize *
-						   srcBuffer.fRowStep *
-						   srcTileSize.v;
-	
-	AutoPtr<dng_memory_block> srcData (host.Allocate (srcBufferSize));
-	
-	srcBuffer.fData = srcData->Buffer ();
+	// Create bilinear interpolator task.
 	
-	// Allocate destination buffer.
+	dng_bilinear_interpolate_task interpolator (*this,
+												srcImage,
+												dstImage,
+												srcPlane);
 	
-	dng_pixel_buffer dstBuffer;
-	
-	dstBuffer.fPlanes = fColorPlanes;
-	
-	dstBuffer.fRowStep   = dstTileSize.h * fColorPlanes;
-	dstBuffer.fPlaneStep = dstTileSize.h;
-	
-	dstBuffer.fPixelType = dstImage.PixelType ();
-	dstBuffer.fPixelSize = dstImage.PixelSize ();
-	
-	uint32 dstBufferSize = dstBuffer.fPixelSize *
-						   dstBuffer.fRowStep *
-						   dstTileSize.v;
-	
-	AutoPtr<dng_memory_block> dstData (host.Allocate (dstBufferSize));
-	
-	dstBuffer.fData = dstData->Buffer ();
-	
-	// Create interpolator.
-	
-	dng_bilinear_interpolator interpolator (*this,
-											srcBuffer.fRowStep,
-											srcBuffer.fColStep);
-											
-	// Iterate over destination tiles.
-	
-	dng_rect dstArea;
-	
-	dng_tile_iterator iter1 (dstImage, dstImage.Bounds ());
+	// Do the interpolation.
 	
-	while (iter1.GetOneTile (dstArea))
-		{
-		
-		// Break into buffer sized tiles.
-		
-		dng_rect dstTile;
-		
-		dng_tile_iterator iter2 (dstTileSize, dstArea);
-		
-		while (iter2.GetOneTile (dstTile))
-			{
-			
-			host.SniffForAbort ();
-			
-			// Setup buffers for this tile.
-			
-			dng_rect srcTile (dstTile);
-			
-			srcTile.t >>= srcShiftV;
-			srcTile.b >>= srcShiftV;
-			
-			srcTile.l >>= srcShiftH;
-			srcTile.r >>= srcShiftH;
-			
-			srcTile.t -= fCFAPatternSize.v;
-			srcTile.b += fCFAPatternSize.v;
-			
-			srcTile.l -= fCFAPatternSize.h;
-			srcTile.r += fCFAPatternSize.h;
-			
-			srcBuffer.fArea = srcTile;
-			dstBuffer.fArea = dstTile;
-			
-			// Get source data.
-			
-			srcImage.Get (srcBuffer,
-						  dng_image::edge_repeat,
-						  fCFAPatternSize.v,
-						  fCFAPatternSize.h);
-						  
-			// Process data.
-			
-			interpolator.Interpolate (srcBuffer,
-									  dstBuffer);
-									  
-			// Save results.
-			
-			dstImage.Put (dstBuffer);
-							  
-			}
-			
-		}
+	host.PerformAreaTask (interpolator,
+						  dstImage.Bounds ());
 		
 	}
 
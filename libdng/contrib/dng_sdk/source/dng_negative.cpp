@@ -25,6 +25,7 @@
 #include "dng_image.h"
 #include "dng_image_writer.h"
 #include "dng_info.h"
+#include "dng_lazy_image.h"
 #include "dng_linearization_info.h"
 #include "dng_memory_stream.h"
 #include "dng_mosaic_info.h"
@@ -2717,10 +2718,159 @@ void dng_negative::SetStage3Image (AutoPtr<dng_image> &image)
 
 /*****************************************************************************/
 
+// Size of the tiles computed by the lazy stage images.
+
+const int32 kLazyStageTileSize = 256;
+
+/*****************************************************************************/
+
+// Stage 2 image that linearizes the stage 1 image one tile at a time, as
+// the tiles are read. It owns the stage 1 image and the linearization info.
+
+class dng_lazy_stage2_image: public dng_lazy_image
+	{
+	
+	private:
+	
+		AutoPtr<dng_image> fStage1Image;
+		
+		AutoPtr<dng_linearization_info> fInfo;
+		
+		dng_abort_sniffer *fSniffer;
+		
+	public:
+	
+		dng_lazy_stage2_image (dng_host &host,
+							   AutoPtr<dng_image> &stage1Image,
+							   AutoPtr<dng_linearization_info> &info,
+							   uint32 pixelType)
+							   
+			:	dng_lazy_image (dng_rect (info->fActiveArea.Size ()),
+								stage1Image->Planes (),
+								pixelType,
+								dng_point (kLazyStageTileSize,
+										   kLazyStageTileSize),
+								host.StageCacheSize (),
+								host.Allocator ())
+								
+			,	fStage1Image (stage1Image.Release ())
+			,	fInfo        (info.Release ())
+			,	fSniffer     (host.Sniffer ())
+			
+			{
+			
+			}
+			
+	protected:
+	
+		virtual void ComputeTile (dng_image &tile) const
+			{
+			
+			// The tile is computed on the calling thread; the caller is
+			// usually an area task that is already spread over threads.
+			
+			dng_host host (&fAllocator, fSniffer);
+			
+			fInfo->Linearize (host,
+							  *fStage1Image.Get (),
+							  tile);
+			
+			}
+	
+	};
+
+/*****************************************************************************/
+
+// Stage 3 image that interpolates the stage 2 image one tile at a time, as
+// the tiles are read. It owns the stage 2 image and the mosaic info.
+
+class dng_lazy_stage3_image: public dng_lazy_image
+	{
+	
+	private:
+	
+		dng_negative &fNegative;
+	
+		AutoPtr<dng_image> fStage2Image;
+		
+		AutoPtr<dng_mosaic_info> fInfo;
+		
+		dng_point fDownScale;
+		
+		uint32 fSrcPlane;
+		
+		dng_abort_sniffer *fSniffer;
+		
+	public:
+	
+		dng_lazy_stage3_image (dng_host &host,
+							   dng_negative &negative,
+							   AutoPtr<dng_image> &stage2Image,
+							   AutoPtr<dng_mosaic_info> &info,
+							   const dng_point &dstSize,
+							   const dng_point &downScale,
+							   uint32 srcPlane)
+							   
+			:	dng_lazy_image (dng_rect (dstSize),
+								info->fColorPlanes,
+								stage2Image->PixelType (),
+								dng_point (kLazyStageTileSize,
+										   kLazyStageTileSize),
+								host.StageCacheSize (),
+								host.Allocator ())
+								
+			,	fNegative    (negative)
+			,	fStage2Image (stage2Image.Release ())
+			,	fInfo        (info.Release ())
+			,	fDownScale   (downScale)
+			,	fSrcPlane    (srcPlane)
+			,	fSniffer     (host.Sniffer ())
+			
+			{
+			
+			}
+			
+	protected:
+	
+		virtual void ComputeTile (dng_image &tile) const
+			{
+			
+			dng_host host (&fAllocator, fSniffer);
+			
+			fInfo->Interpolate (host,
+								fNegative,
+								*fStage2Image.Get (),
+								tile,
+								fDownScale,
+								fSrcPlane);
+			
+			}
+	
+	};
+
+/*****************************************************************************/
+
 void dng_negative::DoBuildStage2 (dng_host &host,
 								  uint32 pixelType)
 	{
 	
+	// The stage 2 image can be computed lazily if nothing needs to write
+	// to it or keep a copy of it.
+	
+	if (host.StageCacheSize () != 0 &&
+		fRawImageStage == rawImageStageNone &&
+		fOpcodeList2.IsEmpty ())
+		{
+		
+		fStage2Image.Reset (new dng_lazy_stage2_image (host,
+													   fStage1Image,
+													   fLinearizationInfo,
+													   pixelType));
+		
+		return;
+		
+		}
+	
 	dng_image &stage1 = *fStage1Image.Get ();
 		
 	dng_linearization_info &info = *fLinearizationInfo.Get ();
@@ -2906,15 +3056,35 @@ void dng_negative::DoInterpolateStage3 (dng_host &host,
 		}
 	
 	dng_point dstSize = info.DstSize (downScale);
-			
-	fStage3Image.Reset (host.Make_dng_image (dng_rect (dstSize),
-											 info.fColorPlanes,
-											 stage2.PixelType ()));
-
+	
 	if (srcPlane < 0 || srcPlane >= (int32) stage2.Planes ())
 		{
 		srcPlane = 0;
 		}
+		
+	// The stage 3 image can be computed lazily if nothing needs to write
+	// to it or keep a copy of it.
+	
+	if (host.StageCacheSize () != 0 &&
+		fRawImageStage == rawImageStageNone &&
+		fOpcodeList3.IsEmpty ())
+		{
+		
+		fStage3Image.Reset (new dng_lazy_stage3_image (host,
+													   *this,
+													   fStage2Image,
+													   fMosaicInfo,
+													   dstSize,
+													   downScale,
+													   (uint32) srcPlane));
+													   
+		return;
+		
+		}
+			
+	fStage3Image.Reset (host.Make_dng_image (dng_rect (dstSize),
+											 info.fColorPlanes,
+											 stage2.PixelType ()));
 				
 	info.Interpolate (host,
 					  *this,
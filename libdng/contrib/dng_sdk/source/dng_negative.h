@@ -1121,6 +1121,14 @@ class dng_negative
 			
 		void FindRawImageDigest (dng_host &host) const;
 		
+		// Records a digest computed by a caller that has already read
+		// the whole raw image, e.g. dng_image_writer while writing it.
+		
+		void SetFoundRawImageDigest (const dng_fingerprint &digest) const
+			{
+			fRawImageDigest = digest;
+			}
+		
 		void ValidateRawImageDigest (dng_host &host);
 							   
 		// API for RawDataUniqueID:
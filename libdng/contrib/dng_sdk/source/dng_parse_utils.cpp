@@ -380,6 +380,10 @@ const char * LookupTagCode (uint32 parentCode,
 		{	tcOpcodeList2,						"OpcodeList2"					},
 		{	tcOpcodeList3,						"OpcodeList3"					},
 		{	tcNoiseProfile,						"NoiseProfile"					},
+		{	tcProfileHueSatMapEncoding,			"ProfileHueSatMapEncoding"		},
+		{	tcProfileLookTableEncoding,			"ProfileLookTableEncoding"		},
+		{	tcBaselineExposureOffset,			"BaselineExposureOffset"		},
+		{	tcDefaultBlackRender,				"DefaultBlackRender"			},
 		{	tcKodakKDCPrivateIFD,				"KodakKDCPrivateIFD"			}
 		};
 
@@ -627,6 +631,7 @@ const char * LookupCompression (uint32 key)
 		{	ccOldJPEG,			"Old JPEG"		},
 		{	ccJPEG,				"JPEG"			},
 		{	ccDeflate,			"Deflate"		},
+		{	ccLossyJPEG,		"LossyJPEG"		},
 		{	ccPackBits,			"PackBits"		},
 		{	ccOldDeflate,		"OldDeflate"	}
 		};
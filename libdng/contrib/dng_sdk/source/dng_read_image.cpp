@@ -26,6 +26,8 @@
 #include "dng_tag_types.h"
 #include "dng_tag_values.h"
 #include "dng_utils.h"
+
+#include "zlib.h"
 	
 /*****************************************************************************/
 
@@ -489,7 +491,8 @@ bool dng_read_image::ReadUncompressed (dng_host &host,
 	else if (bitDepth == 32)
 		{
 		
-		buffer.fPixelType = ttLong;
+		buffer.fPixelType = (ifd.fSampleFormat [0] == sfFloatingPoint) ? ttFloat
+																	   : ttLong;
 		buffer.fPixelSize = 4;
 		
 		stream.Get (buffer.fData, samplesPerTile * 4);
@@ -504,87 +507,44 @@ bool dng_read_image::ReadUncompressed (dng_host &host,
 				
 		}
 		
-	else if (bitDepth == 12)
+	else if (bitDepth > 8 && bitDepth < 16)
 		{
 		
 		buffer.fPixelType = ttShort;
 		buffer.fPixelSize = 2;
 		
-		uint16 *p = (uint16 *) buffer.fData;
-			
-		uint32 evenSamples = samplesPerRow >> 1;
+		// Each row of packed samples starts on a byte boundary.  Read
+		// the packed rows in one go, then unpack them into the buffer.
 		
-		for (uint32 row = 0; row < rows; row++)
+		uint32 packedRowBytes = (samplesPerRow * bitDepth + 7) >> 3;
+		
+		uint32 packedBytes = packedRowBytes * rows;
+		
+		if (fCompressedBuffer.Get () == NULL ||
+			fCompressedBuffer->LogicalSize () < packedBytes)
 			{
 			
-			for (uint32 j = 0; j < evenSamples; j++)
-				{
-				
-				uint32 b0 = stream.Get_uint8 ();
-				uint32 b1 = stream.Get_uint8 ();
-				uint32 b2 = stream.Get_uint8 ();
-								
-				p [0] = (uint16) ((b0 << 4) | (b1 >> 4));
-				p [1] = (uint16) (((b1 << 8) | b2) & 0x0FFF);
-				
-				p += 2;
-				
-				}
-				
-			if (samplesPerRow & 1)
-				{
-				
-				uint32 b0 = stream.Get_uint8 ();
-				uint32 b1 = stream.Get_uint8 ();
-				
-				p [0] = (uint16) ((b0 << 4) | (b1 >> 4));
-				
-				p += 1;
-				
-				}
+			fCompressedBuffer.Reset (host.Allocate (packedBytes));
 			
 			}
+			
+		stream.Get (fCompressedBuffer->Buffer (), packedBytes);
 		
-		}
-		
-	else if (bitDepth > 8 && bitDepth < 16)
-		{
-		
-		buffer.fPixelType = ttShort;
-		buffer.fPixelSize = 2;
+		const uint8 *sPtr = fCompressedBuffer->Buffer_uint8 ();
 		
 		uint16 *p = (uint16 *) buffer.fData;
-			
-		uint32 bitMask = (1 << bitDepth) - 1;
-							
+		
 		for (uint32 row = 0; row < rows; row++)
 			{
 			
-			uint32 bitBuffer  = 0;
-			uint32 bufferBits = 0;
+			DoUnpackBits16 (sPtr, p, samplesPerRow, bitDepth);
+			
+			sPtr += packedRowBytes;
 			
-			for (uint32 j = 0; j < samplesPerRow; j++)
-				{
-				
-				while (bufferBits < bitDepth)
-					{
-					
-					bitBuffer = (bitBuffer << 8) | stream.Get_uint8 ();
-					
-					bufferBits += 8;
-					
-					}
-									
-				p [j] = (uint16) ((bitBuffer >> (bufferBits - bitDepth)) & bitMask);
-				
-				bufferBits -= bitDepth;
-				
-				}
-				
 			p += samplesPerRow;
 			
 			}
-			
+		
 		}
 		
 	else if (bitDepth > 16 && bitDepth < 32)
@@ -740,9 +700,357 @@ bool dng_read_image::ReadLosslessJPEG (dng_host &host,
 	
 /*****************************************************************************/
 
+static void DecodeDelta8 (uint8 *dPtr,
+						  uint32 rows,
+						  uint32 rowSamples,
+						  uint32 stride)
+	{
+	
+	for (uint32 row = 0; row < rows; row++)
+		{
+		
+		for (uint32 col = stride; col < rowSamples; col++)
+			{
+			dPtr [col] = (uint8) (dPtr [col] + dPtr [col - stride]);
+			}
+			
+		dPtr += rowSamples;
+		
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+static void DecodeDelta16 (uint16 *dPtr,
+						   uint32 rows,
+						   uint32 rowSamples,
+						   uint32 stride)
+	{
+	
+	for (uint32 row = 0; row < rows; row++)
+		{
+		
+		for (uint32 col = stride; col < rowSamples; col++)
+			{
+			dPtr [col] = (uint16) (dPtr [col] + dPtr [col - stride]);
+			}
+			
+		dPtr += rowSamples;
+		
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+static void DecodeDelta32 (uint32 *dPtr,
+						   uint32 rows,
+						   uint32 rowSamples,
+						   uint32 stride)
+	{
+	
+	for (uint32 row = 0; row < rows; row++)
+		{
+		
+		for (uint32 col = stride; col < rowSamples; col++)
+			{
+			dPtr [col] += dPtr [col - stride];
+			}
+			
+		dPtr += rowSamples;
+		
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+// Inverse of the floating point predictor from Adobe Photoshop TIFF
+// Technical Note 3.  Each row is stored as differenced byte planes, most
+// significant byte first, and is reassembled into native order floats.
+
+static void DecodeFPDelta (uint8 *dPtr,
+						   uint8 *temp,
+						   uint32 rows,
+						   uint32 rowSamples,
+						   uint32 stride)
+	{
+	
+	const uint32 bytesPerSample = 4;
+	
+	const uint32 rowBytes = rowSamples * bytesPerSample;
+	
+	for (uint32 row = 0; row < rows; row++)
+		{
+		
+		for (uint32 j = stride; j < rowBytes; j++)
+			{
+			dPtr [j] = (uint8) (dPtr [j] + dPtr [j - stride]);
+			}
+			
+		for (uint32 col = 0; col < rowSamples; col++)
+			{
+			
+			for (uint32 b = 0; b < bytesPerSample; b++)
+				{
+				
+				#if qDNGBigEndian
+				temp [col * bytesPerSample + b] = dPtr [b * rowSamples + col];
+				#else
+				temp [col * bytesPerSample + bytesPerSample - 1 - b] = dPtr [b * rowSamples + col];
+				#endif
+				
+				}
+			
+			}
+			
+		DoCopyBytes (temp, dPtr, rowBytes);
+		
+		dPtr += rowBytes;
+		
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+bool dng_read_image::ReadDeflate (dng_host &host,
+								  const dng_ifd &ifd,
+								  dng_stream &stream,
+								  dng_image &image,
+								  const dng_rect &tileArea,
+								  uint32 plane,
+								  uint32 planes,
+								  uint32 tileByteCount)
+	{
+	
+	if (ifd.fPlanarConfiguration == pcRowInterleaved)
+		{
+		return false;
+		}
+		
+	uint32 stride = planes;
+	
+	bool isFloat = false;
+	
+	switch (ifd.fPredictor)
+		{
+		
+		case cpNullPredictor:
+		case cpHorizontalDifference:
+			break;
+			
+		case cpHorizontalDifferenceX2:
+			{
+			stride *= 2;
+			break;
+			}
+			
+		case cpHorizontalDifferenceX4:
+			{
+			stride *= 4;
+			break;
+			}
+			
+		case cpFloatingPoint:
+			{
+			isFloat = true;
+			break;
+			}
+			
+		case cpFloatingPointX2:
+			{
+			isFloat = true;
+			stride *= 2;
+			break;
+			}
+			
+		case cpFloatingPointX4:
+			{
+			isFloat = true;
+			stride *= 4;
+			break;
+			}
+			
+		default:
+			{
+			return false;
+			}
+			
+		}
+		
+	uint32 pixelType = ifd.PixelType ();
+	
+	uint32 pixelSize = TagTypeSize (pixelType);
+	
+	if (isFloat && pixelType != ttFloat)
+		{
+		return false;
+		}
+	
+	uint32 rows       = tileArea.H ();
+	uint32 rowSamples = tileArea.W () * planes;
+	
+	uint32 rowBytes = rowSamples * pixelSize;
+	
+	uint32 tileBytes = rowBytes * rows;
+	
+	// Read the compressed data.
+	
+	if (fCompressedBuffer.Get () == NULL ||
+		fCompressedBuffer->LogicalSize () < tileByteCount)
+		{
+		
+		fCompressedBuffer.Reset (host.Allocate (tileByteCount));
+		
+		}
+		
+	stream.Get (fCompressedBuffer->Buffer (), tileByteCount);
+	
+	// Decompress it.  The floating point predictor needs an extra row
+	// of scratch space.
+	
+	uint32 bufferSize = tileBytes + (isFloat ? rowBytes : 0);
+	
+	if (fUncompressedBuffer.Get () == NULL ||
+		fUncompressedBuffer->LogicalSize () < bufferSize)
+		{
+		
+		fUncompressedBuffer.Reset (host.Allocate (bufferSize));
+		
+		}
+		
+	uLongf destLen = tileBytes;
+		
+	int zResult = uncompress (fUncompressedBuffer->Buffer_uint8 (),
+							  &destLen,
+							  fCompressedBuffer->Buffer_uint8 (),
+							  tileByteCount);
+							  
+	if (zResult == Z_MEM_ERROR)
+		{
+		ThrowMemoryFull ();
+		}
+		
+	if (zResult != Z_OK || destLen != tileBytes)
+		{
+		ThrowBadFormat ();
+		}
+		
+	// Undo the predictor.
+	
+	uint8 *data = fUncompressedBuffer->Buffer_uint8 ();
+	
+	if (isFloat)
+		{
+		
+		DecodeFPDelta (data,
+					   data + tileBytes,
+					   rows,
+					   rowSamples,
+					   stride);
+		
+		}
+		
+	else
+		{
+		
+		if (stream.SwapBytes ())
+			{
+			
+			if (pixelSize == 2)
+				{
+				DoSwapBytes16 ((uint16 *) data, tileBytes >> 1);
+				}
+				
+			else if (pixelSize == 4)
+				{
+				DoSwapBytes32 ((uint32 *) data, tileBytes >> 2);
+				}
+				
+			}
+			
+		if (ifd.fPredictor != cpNullPredictor)
+			{
+			
+			switch (pixelSize)
+				{
+				
+				case 1:
+					{
+					DecodeDelta8 (data, rows, rowSamples, stride);
+					break;
+					}
+					
+				case 2:
+					{
+					DecodeDelta16 ((uint16 *) data, rows, rowSamples, stride);
+					break;
+					}
+					
+				case 4:
+					{
+					DecodeDelta32 ((uint32 *) data, rows, rowSamples, stride);
+					break;
+					}
+					
+				default:
+					{
+					return false;
+					}
+					
+				}
+				
+			}
+		
+		}
+		
+	dng_pixel_buffer buffer;
+	
+	buffer.fArea = tileArea;
+	
+	buffer.fPlane  = plane;
+	buffer.fPlanes = planes;
+	
+	buffer.fRowStep   = rowSamples;
+	buffer.fColStep   = planes;
+	buffer.fPlaneStep = 1;
+	
+	buffer.fPixelType = pixelType;
+	buffer.fPixelSize = pixelSize;
+	
+	buffer.fData = data;
+	
+	if (ifd.fSampleBitShift)
+		{
+		
+		buffer.ShiftRight (ifd.fSampleBitShift);
+		
+		}
+		
+	image.Put (buffer);
+	
+	return true;
+	
+	}
+	
+/*****************************************************************************/
+
 bool dng_read_image::CanReadTile (const dng_ifd &ifd)
 	{
 	
+	if (ifd.fSampleFormat [0] == sfFloatingPoint)
+		{
+		
+		// Only 32-bit floating point data is supported.
+		
+		return ifd.fBitsPerSample [0] == 32 &&
+			   (ifd.fCompression == ccUncompressed ||
+				ifd.fCompression == ccDeflate);
+		
+		}
+	
 	if (ifd.fSampleFormat [0] != sfUnsignedInteger)
 		{
 		return false;
@@ -759,6 +1067,15 @@ bool dng_read_image::CanReadTile (const dng_ifd &ifd)
 			
 			}
 			
+		case ccDeflate:
+			{
+			
+			return ifd.fBitsPerSample [0] ==  8 ||
+				   ifd.fBitsPerSample [0] == 16 ||
+				   ifd.fBitsPerSample [0] == 32;
+			
+			}
+			
 		case ccJPEG:
 			{
 			
@@ -798,10 +1115,10 @@ bool dng_read_image::CanReadTile (const dng_ifd &ifd)
 	
 /*****************************************************************************/
 
-bool dng_read_image::NeedsCompressedBuffer (const dng_ifd & /* ifd */)
+bool dng_read_image::NeedsCompressedBuffer (const dng_ifd &ifd)
 	{
 	
-	return false;
+	return ifd.fCompression == ccDeflate;
 	
 	}
 	
@@ -889,6 +1206,27 @@ void dng_read_image::ReadTile (dng_host &host,
 			
 			}
 			
+		case ccDeflate:
+			{
+			
+			if (ReadDeflate (host,
+							 ifd,
+							 stream,
+							 image,
+							 tileArea,
+							 plane,
+							 planes,
+							 tileByteCount))
+				{
+				
+				return;
+				
+				}
+				
+			break;
+			
+			}
+			
 		default:
 			break;
 			
@@ -1221,6 +1559,56 @@ void dng_read_image::Read (dng_host &host,
 		
 		}
 		
+	// Tell the stream which byte ranges we are about to read, merging
+	// tiles that are stored back to back.
+	
+		{
+		
+		uint64 rangeStart = 0;
+		uint64 rangeEnd   = 0;
+		
+		uint32 readCount = Min_uint32 (outerSamples, image.Planes ()) *
+						   tilesAcross * tilesDown;
+		
+		for (tileIndex = 0; tileIndex < readCount; tileIndex++)
+			{
+			
+			uint64 byteCount;
+			
+			if (tileByteCount)
+				{
+				byteCount = tileByteCount [tileIndex];
+				}
+			else
+				{
+				uint32 tileInPlane = tileIndex % (tilesAcross * tilesDown);
+				byteCount = ifd.TileByteCount (ifd.TileArea (tileInPlane / tilesAcross,
+															 tileInPlane % tilesAcross));
+				}
+				
+			if (tileOffset [tileIndex] != rangeEnd)
+				{
+				
+				if (rangeEnd > rangeStart)
+					{
+					stream.Prefetch (rangeStart, rangeEnd - rangeStart);
+					}
+					
+				rangeStart = tileOffset [tileIndex];
+				
+				}
+				
+			rangeEnd = tileOffset [tileIndex] + byteCount;
+			
+			}
+			
+		if (rangeEnd > rangeStart)
+			{
+			stream.Prefetch (rangeStart, rangeEnd - rangeStart);
+			}
+		
+		}
+		
 	// Now read in each tile.
 		
 	tileIndex = 0;
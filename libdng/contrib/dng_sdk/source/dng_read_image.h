@@ -130,6 +130,15 @@ class dng_read_image
 									   uint32 planes,
 									   uint32 tileByteCount);
 									   
+		virtual bool ReadDeflate (dng_host &host,
+								  const dng_ifd &ifd,
+								  dng_stream &stream,
+								  dng_image &image,
+								  const dng_rect &tileArea,
+								  uint32 plane,
+								  uint32 planes,
+								  uint32 tileByteCount);
+									   
 		virtual bool CanReadTile (const dng_ifd &ifd);
 		
 		virtual bool NeedsCompressedBuffer (const dng_ifd &ifd);
@@ -1183,6 +1183,178 @@ void RefShiftRight16 (uint16 *dPtr,
 
 /*****************************************************************************/
 
+// Bilinear row loops for two-phase patterns (2x2 Bayer, including the
+// four-color variant) without upscaling. Each call computes column pairs
+// with a fixed number of kernel taps per phase, so the tap loops unroll
+// and the kernel tables stay in registers. The taps are summed in the
+// same order as the generic loop, so the results are bit-identical.
+
+template <uint32 kCount0, uint32 kCount1>
+static void BilinearPairs16 (const uint16 *sPtr,
+							 uint16 *dPtr,
+							 uint32 pairs,
+							 const int32 *offsets0,
+							 const uint16 *weights0,
+							 const int32 *offsets1,
+							 const uint16 *weights1)
+	{
+	
+	int32  o0 [kCount0];
+	uint32 w0 [kCount0];
+	
+	int32  o1 [kCount1];
+	uint32 w1 [kCount1];
+	
+	uint32 k;
+	
+	for (k = 0; k < kCount0; k++)
+		{
+		o0 [k] = offsets0 [k];
+		w0 [k] = weights0 [k];
+		}
+		
+	for (k = 0; k < kCount1; k++)
+		{
+		o1 [k] = offsets1 [k] + 1;
+		w1 [k] = weights1 [k];
+		}
+	
+	for (uint32 j = 0; j < pairs; j++)
+		{
+		
+		const uint16 *p = sPtr + j * 2;
+		
+		uint32 total0 = 128;
+		uint32 total1 = 128;
+		
+		for (k = 0; k < kCount0; k++)
+			{
+			total0 += p [o0 [k]] * w0 [k];
+			}
+			
+		for (k = 0; k < kCount1; k++)
+			{
+			total1 += p [o1 [k]] * w1 [k];
+			}
+			
+		dPtr [j * 2    ] = (uint16) (total0 >> 8);
+		dPtr [j * 2 + 1] = (uint16) (total1 >> 8);
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+template <uint32 kCount0, uint32 kCount1>
+static void BilinearPairs32 (const real32 *sPtr,
+							 real32 *dPtr,
+							 uint32 pairs,
+							 const int32 *offsets0,
+							 const real32 *weights0,
+							 const int32 *offsets1,
+							 const real32 *weights1)
+	{
+	
+	int32  o0 [kCount0];
+	real32 w0 [kCount0];
+	
+	int32  o1 [kCount1];
+	real32 w1 [kCount1];
+	
+	uint32 k;
+	
+	for (k = 0; k < kCount0; k++)
+		{
+		o0 [k] = offsets0 [k];
+		w0 [k] = weights0 [k];
+		}
+		
+	for (k = 0; k < kCount1; k++)
+		{
+		o1 [k] = offsets1 [k] + 1;
+		w1 [k] = weights1 [k];
+		}
+	
+	for (uint32 j = 0; j < pairs; j++)
+		{
+		
+		const real32 *p = sPtr + j * 2;
+		
+		real32 total0 = 0.0f;
+		real32 total1 = 0.0f;
+		
+		for (k = 0; k < kCount0; k++)
+			{
+			total0 += p [o0 [k]] * w0 [k];
+			}
+			
+		for (k = 0; k < kCount1; k++)
+			{
+			total1 += p [o1 [k]] * w1 [k];
+			}
+			
+		dPtr [j * 2    ] = total0;
+		dPtr [j * 2 + 1] = total1;
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+// Picks the specialized loop for a pair of kernel sizes. Bilinear
+// kernels on a Bayer pattern have 1, 2 or 4 taps; anything else returns
+// false and is left to the generic loop.
+
+template <class T, class W>
+static bool BilinearPairs (const T *sPtr,
+						   T *dPtr,
+						   uint32 pairs,
+						   uint32 count0,
+						   const int32 *offsets0,
+						   const W *weights0,
+						   uint32 count1,
+						   const int32 *offsets1,
+						   const W *weights1,
+						   void (*const table [3] [3]) (const T *,
+						   								T *,
+						   								uint32,
+						   								const int32 *,
+						   								const W *,
+						   								const int32 *,
+						   								const W *))
+	{
+	
+	static const int32 kIndex [5] = { -1, 0, 1, -1, 2 };
+	
+	if (count0 > 4 || count1 > 4)
+		{
+		return false;
+		}
+		
+	int32 index0 = kIndex [count0];
+	int32 index1 = kIndex [count1];
+	
+	if (index0 < 0 || index1 < 0)
+		{
+		return false;
+		}
+		
+	table [index0] [index1] (sPtr,
+							 dPtr,
+							 pairs,
+							 offsets0,
+							 weights0,
+							 offsets1,
+							 weights1);
+	
+	return true;
+	
+	}
+
+/*****************************************************************************/
+
 void RefBilinearRow16 (const uint16 *sPtr,
 					   uint16 *dPtr,
 					   uint32 cols,
@@ -1194,6 +1366,51 @@ void RefBilinearRow16 (const uint16 *sPtr,
 					   uint32 sShift)
 	{
 	
+	if (patCount == 2 && sShift == 0 && cols >= 2)
+		{
+		
+		static void (*const kPairs [3] [3]) (const uint16 *,
+											  uint16 *,
+											  uint32,
+											  const int32 *,
+											  const uint16 *,
+											  const int32 *,
+											  const uint16 *) =
+			{
+			{ BilinearPairs16<1, 1>, BilinearPairs16<1, 2>, BilinearPairs16<1, 4> },
+			{ BilinearPairs16<2, 1>, BilinearPairs16<2, 2>, BilinearPairs16<2, 4> },
+			{ BilinearPairs16<4, 1>, BilinearPairs16<4, 2>, BilinearPairs16<4, 4> }
+			};
+		
+		uint32 phase0 = patPhase;
+		uint32 phase1 = patPhase ^ 1;
+		
+		uint32 pairs = cols >> 1;
+		
+		if (BilinearPairs (sPtr,
+						   dPtr,
+						   pairs,
+						   kernCounts  [phase0],
+						   kernOffsets [phase0],
+						   kernWeights [phase0],
+						   kernCounts  [phase1],
+						   kernOffsets [phase1],
+						   kernWeights [phase1],
+						   kPairs))
+			{
+			
+			// An odd last column falls through to the generic loop, which
+			// starts on the same phase.
+			
+			sPtr += pairs * 2;
+			dPtr += pairs * 2;
+			
+			cols -= pairs * 2;
+			
+			}
+		
+		}
+	
 	for (uint32 j = 0; j < cols; j++)
 		{
 		
@@ -1242,6 +1459,48 @@ void RefBilinearRow32 (const real32 *sPtr,
 					   uint32 sShift)
 	{
 	
+	if (patCount == 2 && sShift == 0 && cols >= 2)
+		{
+		
+		static void (*const kPairs [3] [3]) (const real32 *,
+											  real32 *,
+											  uint32,
+											  const int32 *,
+											  const real32 *,
+											  const int32 *,
+											  const real32 *) =
+			{
+			{ BilinearPairs32<1, 1>, BilinearPairs32<1, 2>, BilinearPairs32<1, 4> },
+			{ BilinearPairs32<2, 1>, BilinearPairs32<2, 2>, BilinearPairs32<2, 4> },
+			{ BilinearPairs32<4, 1>, BilinearPairs32<4, 2>, BilinearPairs32<4, 4> }
+			};
+		
+		uint32 phase0 = patPhase;
+		uint32 phase1 = patPhase ^ 1;
+		
+		uint32 pairs = cols >> 1;
+		
+		if (BilinearPairs (sPtr,
+						   dPtr,
+						   pairs,
+						   kernCounts  [phase0],
+						   kernOffsets [phase0],
+						   kernWeights [phase0],
+						   kernCounts  [phase1],
+						   kernOffsets [phase1],
+						   kernWeights [phase1],
+						   kPairs))
+			{
+			
+			sPtr += pairs * 2;
+			dPtr += pairs * 2;
+			
+			cols -= pairs * 2;
+			
+			}
+		
+		}
+	
 	for (uint32 j = 0; j < cols; j++)
 		{
 		
@@ -1610,6 +1869,223 @@ void RefBaselineHueSatMap (const real32 *sPtrR,
 
 /*****************************************************************************/
 
+void RefBaselineHueSatTable (const real32 *sPtrR,
+							 const real32 *sPtrG,
+							 const real32 *sPtrB,
+							 real32 *dPtrR,
+							 real32 *dPtrG,
+							 real32 *dPtrB,
+							 uint32 count,
+							 const dng_hue_sat_table &table)
+	{
+	
+	uint32 hueDivisions;
+	uint32 satDivisions;
+	uint32 valDivisions;
+	
+	table.GetDivisions (hueDivisions,
+						satDivisions,
+						valDivisions);
+					  
+	real32 hScale = (hueDivisions < 2) ? 0.0f : (hueDivisions * (1.0f / 6.0f));
+	real32 sScale = (real32) (satDivisions - 1);
+	real32 vScale = (real32) (valDivisions - 1);
+		
+	int32 maxHueIndex0 = hueDivisions - 1;
+	int32 maxSatIndex0 = satDivisions - 2;
+	int32 maxValIndex0 = valDivisions - 2;
+	
+	const real32 *cells = table.Cells ();
+	
+	const uint32 corners  = table.Corners ();
+	const uint32 cellSize = table.CellSize ();
+	
+	const int32 hueStep = table.HueStep ();
+	const int32 valStep = table.ValStep ();
+	
+	// Work in blocks so that the color space conversions run as straight,
+	// branch free loops over whole blocks, separate from the table gathers.
+	
+	const uint32 kBlockSize = 64;
+	
+	real32 hBlock [kBlockSize];
+	real32 sBlock [kBlockSize];
+	real32 vBlock [kBlockSize];
+	
+	for (uint32 block = 0; block < count; block += kBlockSize)
+		{
+		
+		uint32 blockCount = Min_uint32 (kBlockSize, count - block);
+		
+		const real32 *rPtr = sPtrR + block;
+		const real32 *gPtr = sPtrG + block;
+		const real32 *bPtr = sPtrB + block;
+		
+		// RGB to HSV, matching DNG_RGBtoHSV.
+		
+		for (uint32 j = 0; j < blockCount; j++)
+			{
+			
+			real32 r = rPtr [j];
+			real32 g = gPtr [j];
+			real32 b = bPtr [j];
+			
+			real32 v = Max_real32 (r, Max_real32 (g, b));
+			
+			real32 gap = v - Min_real32 (r, Min_real32 (g, b));
+			
+			// The sextant and gray tests become 0 or 1 weights rather than
+			// selects, and the divisions are unconditional, so the loop has
+			// no data dependent branches. Multiplying by exact 0 and 1 keeps
+			// the results identical to the branching version.
+			
+			real32 rMax = (real32) (r == v);
+			real32 gMax = (real32) (g == v) * (1.0f - rMax);
+			real32 bMax = 1.0f - rMax - gMax;
+			
+			real32 num = rMax * (g - b) +
+						 gMax * (b - r) +
+						 bMax * (r - g);
+						 
+			real32 base = 2.0f * gMax + 4.0f * bMax;
+			
+			real32 color = (real32) (gap > 0.0f);
+			
+			real32 h = base + num / (gap + (1.0f - color));
+			real32 s =        gap / (v * color + (1.0f - color));
+			
+			h += 6.0f * (real32) (h < 0.0f);
+			
+			hBlock [j] = h * color;
+			sBlock [j] = s;
+			vBlock [j] = v;
+			
+			}
+			
+		// Table lookup.
+		
+		for (uint32 j = 0; j < blockCount; j++)
+			{
+			
+			real32 hScaled = hBlock [j] * hScale;
+			real32 sScaled = sBlock [j] * sScale;
+			
+			int32 hIndex0 = Min_int32 ((int32) hScaled, maxHueIndex0);
+			int32 sIndex0 = Min_int32 ((int32) sScaled, maxSatIndex0);
+				
+			real32 hFract1 = hScaled - (real32) hIndex0;
+			real32 sFract1 = sScaled - (real32) sIndex0;
+			
+			real32 hFract0 = 1.0f - hFract1;
+			real32 sFract0 = 1.0f - sFract1;
+			
+			real32 w0 = hFract0 * sFract0;
+			real32 w1 = hFract0 * sFract1;
+			real32 w2 = hFract1 * sFract0;
+			real32 w3 = hFract1 * sFract1;
+			
+			int32 cellIndex = hIndex0 * hueStep + sIndex0;
+			
+			real32 hueShift;
+			real32 satScale;
+			real32 valScale;
+			
+			if (corners == 4)
+				{
+				
+				const real32 *cell = cells + cellIndex * cellSize;
+				
+				hueShift = w0 * cell [0] + w1 * cell [1] + w2 * cell [ 2] + w3 * cell [ 3];
+				satScale = w0 * cell [4] + w1 * cell [5] + w2 * cell [ 6] + w3 * cell [ 7];
+				valScale = w0 * cell [8] + w1 * cell [9] + w2 * cell [10] + w3 * cell [11];
+				
+				}
+				
+			else
+				{
+				
+				real32 vScaled = vBlock [j] * vScale;
+				
+				int32 vIndex0 = Min_int32 ((int32) vScaled, maxValIndex0);
+				
+				real32 vFract1 = vScaled - (real32) vIndex0;
+				real32 vFract0 = 1.0f - vFract1;
+				
+				cellIndex += vIndex0 * valStep;
+				
+				const real32 *cell = cells + cellIndex * cellSize;
+				
+				hueShift = vFract0 * (w0 * cell [ 0] + w1 * cell [ 1] + w2 * cell [ 2] + w3 * cell [ 3]) +
+						   vFract1 * (w0 * cell [ 4] + w1 * cell [ 5] + w2 * cell [ 6] + w3 * cell [ 7]);
+				satScale = vFract0 * (w0 * cell [ 8] + w1 * cell [ 9] + w2 * cell [10] + w3 * cell [11]) +
+						   vFract1 * (w0 * cell [12] + w1 * cell [13] + w2 * cell [14] + w3 * cell [15]);
+				valScale = vFract0 * (w0 * cell [16] + w1 * cell [17] + w2 * cell [18] + w3 * cell [19]) +
+						   vFract1 * (w0 * cell [20] + w1 * cell [21] + w2 * cell [22] + w3 * cell [23]);
+				
+				}
+				
+			hBlock [j] += hueShift;
+			
+			sBlock [j] = Min_real32 (sBlock [j] * satScale, 1.0f);
+			vBlock [j] = Min_real32 (vBlock [j] * valScale, 1.0f);
+			
+			}
+			
+		// HSV to RGB. Rather than switching on the hue sextant like
+		// DNG_HSVtoRGB, each channel is v * (1 - s * ramp), where ramp is
+		// a clamped triangle of the hue rotated by 5, 3 or 1 sextants. The
+		// hue is wrapped with truncating conversions instead of compares,
+		// so the loop has no data dependent branches. The ramp is continuous
+		// around the hue circle, so rounding at the wrap points is harmless.
+		
+		real32 *rDst = dPtrR + block;
+		real32 *gDst = dPtrG + block;
+		real32 *bDst = dPtrB + block;
+		
+		for (uint32 j = 0; j < blockCount; j++)
+			{
+			
+			real32 h = hBlock [j];
+			real32 s = sBlock [j];
+			real32 v = vBlock [j];
+			
+			// Hue shifts are at most half a turn, so h is in (-3, 9) here.
+			
+			h -= 6.0f * (real32) ((int32) (h * (1.0f / 6.0f) + 1.0f) - 1);
+			
+			real32 kR = h + 5.0f;
+			real32 kG = h + 3.0f;
+			real32 kB = h + 1.0f;
+			
+			kR -= 6.0f * (real32) (int32) (kR * (1.0f / 6.0f));
+			kG -= 6.0f * (real32) (int32) (kG * (1.0f / 6.0f));
+			kB -= 6.0f * (real32) (int32) (kB * (1.0f / 6.0f));
+			
+			// Pin (0, Min (k, 4 - k), 1), written with fabsf since compilers
+			// turn that into a mask, where Min/Max selects may become branches.
+			
+			real32 tR = 2.0f - fabsf (kR - 2.0f);
+			real32 tG = 2.0f - fabsf (kG - 2.0f);
+			real32 tB = 2.0f - fabsf (kB - 2.0f);
+			
+			real32 rampR = 0.5f * (fabsf (tR) - fabsf (tR - 1.0f) + 1.0f);
+			real32 rampG = 0.5f * (fabsf (tG) - fabsf (tG - 1.0f) + 1.0f);
+			real32 rampB = 0.5f * (fabsf (tB) - fabsf (tB - 1.0f) + 1.0f);
+			
+			real32 sv = 0.5f * (s + fabsf (s));
+			
+			rDst [j] = v * (1.0f - sv * rampR);
+			gDst [j] = v * (1.0f - sv * rampG);
+			bDst [j] = v * (1.0f - sv * rampB);
+			
+			}
+			
+		}
+	
+	}
+
+/*****************************************************************************/
+
 void RefBaselineRGBtoGray (const real32 *sPtrR,
 						   const real32 *sPtrG,
 						   const real32 *sPtrB,
@@ -2077,6 +2553,46 @@ bool RefEqualArea16 (const uint16 *sPtr,
 					 int32 dPlaneStep)
 	{
 	
+	// Rows of contiguous samples are compared in blocks, which lets the
+	// compiler vectorize the inner loop.
+	
+	if (sPlaneStep == 1 && dPlaneStep == 1 &&
+		sColStep == (int32) planes && dColStep == (int32) planes)
+		{
+		
+		const uint32 kBlock = 64;
+		
+		uint32 count = cols * planes;
+		
+		for (uint32 row = 0; row < rows; row++)
+			{
+			
+			for (uint32 j = 0; j < count; j += kBlock)
+				{
+				
+				uint32 n = Min_uint32 (kBlock, count - j);
+				
+				uint32 diff = 0;
+				
+				for (uint32 k = 0; k < n; k++)
+					{
+					diff |= (uint32) (sPtr [j + k] ^ dPtr [j + k]);
+					}
+					
+				if (diff)
+					return false;
+				
+				}
+				
+			sPtr += sRowStep;
+			dPtr += dRowStep;
+			
+			}
+			
+		return true;
+		
+		}
+	
 	for (uint32 row = 0; row < rows; row++)
 		{
 		
@@ -2576,3 +3092,378 @@ void RefMapArea16 (uint16 *dPtr,
 	}
 
 /*****************************************************************************/
+
+void RefGainMapRow32 (real32 *dPtr,
+					  const real32 *gPtr1,
+					  const real32 *gPtr2,
+					  uint32 count,
+					  int32 dColStep,
+					  real32 gFract)
+	{
+	
+	const real32 w1 = 1.0f - gFract;
+	const real32 w2 =        gFract;
+	
+	if (dColStep == 1)
+		{
+		
+		// Process in blocks of 8 pixels, so the inner loop maps directly
+		// onto vector registers.
+		
+		uint32 blocks = count >> 3;
+		
+		while (blocks--)
+			{
+			
+			for (uint32 k = 0; k < 8; k++)
+				{
+				
+				real32 gain = gPtr1 [k] * w1 + gPtr2 [k] * w2;
+				
+				dPtr [k] = Min_real32 (dPtr [k] * gain, 1.0f);
+				
+				}
+				
+			dPtr  += 8;
+			gPtr1 += 8;
+			gPtr2 += 8;
+			
+			}
+			
+		count &= 7;
+		
+		}
+		
+	for (uint32 j = 0; j < count; j++)
+		{
+		
+		real32 gain = gPtr1 [j] * w1 + gPtr2 [j] * w2;
+		
+		dPtr [0] = Min_real32 (dPtr [0] * gain, 1.0f);
+		
+		dPtr += dColStep;
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+// 10, 12 and 14 bit samples pack four to a whole number of bytes, so they
+// are processed in independent blocks.  The block routines are inlined
+// with a constant sample size, which lets the compiler fully unroll them.
+
+static inline void RefPackBlocks16 (const uint16 *sPtr,
+							 uint8 *dPtr,
+							 uint32 blocks,
+							 const uint32 bits)
+	{
+	
+	const uint32 mask = (1 << bits) - 1;
+	
+	const uint32 blockBytes = bits >> 1;
+	
+	for (uint32 j = 0; j < blocks; j++)
+		{
+		
+		uint64 x = (((uint64) (sPtr [0] & mask)) << (bits * 3)) |
+				   (((uint64) (sPtr [1] & mask)) << (bits * 2)) |
+				   (((uint64) (sPtr [2] & mask)) << (bits    )) |
+				   (((uint64) (sPtr [3] & mask))              );
+				   
+		for (uint32 k = 0; k < blockBytes; k++)
+			{
+			dPtr [k] = (uint8) (x >> ((blockBytes - 1 - k) << 3));
+			}
+			
+		sPtr += 4;
+		dPtr += blockBytes;
+		
+		}
+		
+	}
+
+/*****************************************************************************/
+
+static inline void RefUnpackBlocks16 (const uint8 *sPtr,
+							   uint16 *dPtr,
+							   uint32 blocks,
+							   const uint32 bits)
+	{
+	
+	const uint32 mask = (1 << bits) - 1;
+	
+	const uint32 blockBytes = bits >> 1;
+	
+	for (uint32 j = 0; j < blocks; j++)
+		{
+		
+		uint64 x = 0;
+		
+		for (uint32 k = 0; k < blockBytes; k++)
+			{
+			x = (x << 8) | sPtr [k];
+			}
+			
+		dPtr [0] = (uint16) ((x >> (bits * 3)) & mask);
+		dPtr [1] = (uint16) ((x >> (bits * 2)) & mask);
+		dPtr [2] = (uint16) ((x >> (bits    )) & mask);
+		dPtr [3] = (uint16) ((x             ) & mask);
+			
+		sPtr += blockBytes;
+		dPtr += 4;
+		
+		}
+		
+	}
+
+/*****************************************************************************/
+
+// Packs count samples into a big-endian bit stream, most significant bit
+// first, as used by TIFF for sample sizes that are not a multiple of 8.
+// The final byte is zero padded.
+
+void RefPackBits16 (const uint16 *sPtr,
+					uint8 *dPtr,
+					uint32 count,
+					uint32 bits)
+	{
+	
+	const uint32 mask = (1 << bits) - 1;
+	
+	uint32 blocks = count >> 2;
+	
+	switch (bits)
+		{
+		
+		case 10:
+			RefPackBlocks16 (sPtr, dPtr, blocks, 10);
+			break;
+			
+		case 12:
+			RefPackBlocks16 (sPtr, dPtr, blocks, 12);
+			break;
+			
+		case 14:
+			RefPackBlocks16 (sPtr, dPtr, blocks, 14);
+			break;
+			
+		default:
+			blocks = 0;
+			break;
+			
+		}
+		
+	sPtr  += blocks * 4;
+	dPtr  += blocks * (bits >> 1);
+	count -= blocks * 4;
+		
+	uint32 bitBuffer  = 0;
+	uint32 bufferBits = 0;
+	
+	for (uint32 j = 0; j < count; j++)
+		{
+		
+		bitBuffer = (bitBuffer << bits) | (sPtr [j] & mask);
+		
+		bufferBits += bits;
+		
+		while (bufferBits >= 8)
+			{
+			
+			bufferBits -= 8;
+			
+			*(dPtr++) = (uint8) (bitBuffer >> bufferBits);
+			
+			}
+			
+		bitBuffer &= (1 << bufferBits) - 1;
+		
+		}
+		
+	if (bufferBits)
+		{
+		
+		*dPtr = (uint8) (bitBuffer << (8 - bufferBits));
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void RefUnpackBits16 (const uint8 *sPtr,
+					  uint16 *dPtr,
+					  uint32 count,
+					  uint32 bits)
+	{
+	
+	const uint32 mask = (1 << bits) - 1;
+	
+	uint32 blocks = count >> 2;
+	
+	switch (bits)
+		{
+		
+		case 10:
+			RefUnpackBlocks16 (sPtr, dPtr, blocks, 10);
+			break;
+			
+		case 12:
+			RefUnpackBlocks16 (sPtr, dPtr, blocks, 12);
+			break;
+			
+		case 14:
+			RefUnpackBlocks16 (sPtr, dPtr, blocks, 14);
+			break;
+			
+		default:
+			blocks = 0;
+			break;
+			
+		}
+		
+	sPtr  += blocks * (bits >> 1);
+	dPtr  += blocks * 4;
+	count -= blocks * 4;
+		
+	uint32 bitBuffer  = 0;
+	uint32 bufferBits = 0;
+	
+	for (uint32 j = 0; j < count; j++)
+		{
+		
+		while (bufferBits < bits)
+			{
+			
+			bitBuffer = ((bitBuffer << 8) | *(sPtr++)) & 0xFFFFFF;
+			
+			bufferBits += 8;
+			
+			}
+			
+		bufferBits -= bits;
+		
+		dPtr [j] = (uint16) ((bitBuffer >> bufferBits) & mask);
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+void RefDiffArea16 (const uint16 *sPtr,
+					const uint16 *dPtr,
+					uint32 rows,
+					uint32 cols,
+					uint32 planes,
+					int32 sRowStep,
+					int32 sColStep,
+					int32 sPlaneStep,
+					int32 dRowStep,
+					int32 dColStep,
+					int32 dPlaneStep,
+					uint16 *mPtr,
+					int32 mRowStep,
+					uint32 *maxDiff,
+					uint64 *diffCount,
+					uint64 *sumSquares)
+	{
+	
+	uint32 maxValue  = *maxDiff;
+	uint64 countSum  = *diffCount;
+	uint64 squareSum = *sumSquares;
+	
+	bool contiguous = sPlaneStep == 1 && dPlaneStep == 1 &&
+					  sColStep == (int32) planes && dColStep == (int32) planes;
+	
+	for (uint32 row = 0; row < rows; row++)
+		{
+		
+		// Contiguous rows without a difference map, in one flat loop the
+		// compiler can vectorize.
+		
+		if (contiguous && !mPtr)
+			{
+			
+			uint32 count = cols * planes;
+			
+			uint32 rowMax    = 0;
+			uint32 rowCount  = 0;
+			uint64 rowSquare = 0;
+			
+			for (uint32 j = 0; j < count; j++)
+				{
+				
+				int32 delta = (int32) sPtr [j] - (int32) dPtr [j];
+				
+				uint32 diff = (uint32) (delta < 0 ? -delta : delta);
+				
+				rowMax     = Max_uint32 (rowMax, diff);
+				rowCount  += (diff != 0);
+				rowSquare += diff * diff;
+				
+				}
+				
+			maxValue   = Max_uint32 (maxValue, rowMax);
+			countSum  += rowCount;
+			squareSum += rowSquare;
+			
+			}
+			
+		else
+			{
+			
+			const uint16 *sPtr1 = sPtr;
+			const uint16 *dPtr1 = dPtr;
+			
+			for (uint32 col = 0; col < cols; col++)
+				{
+				
+				uint32 pixelMax = 0;
+				
+				for (uint32 plane = 0; plane < planes; plane++)
+					{
+					
+					int32 delta = (int32) sPtr1 [plane * sPlaneStep] -
+								  (int32) dPtr1 [plane * dPlaneStep];
+					
+					uint32 diff = (uint32) (delta < 0 ? -delta : delta);
+					
+					pixelMax   = Max_uint32 (pixelMax, diff);
+					countSum  += (diff != 0);
+					squareSum += diff * diff;
+					
+					}
+					
+				maxValue = Max_uint32 (maxValue, pixelMax);
+				
+				if (mPtr)
+					{
+					mPtr [col] = (uint16) pixelMax;
+					}
+				
+				sPtr1 += sColStep;
+				dPtr1 += dColStep;
+				
+				}
+				
+			if (mPtr)
+				{
+				mPtr += mRowStep;
+				}
+			
+			}
+			
+		sPtr += sRowStep;
+		dPtr += dRowStep;
+		
+		}
+		
+	*maxDiff    = maxValue;
+	*diffCount  = countSum;
+	*sumSquares = squareSum;
+	
+	}
+
+/*****************************************************************************/
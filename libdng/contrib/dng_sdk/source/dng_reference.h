@@ -350,6 +350,15 @@ void RefBaselineHueSatMap (const real32 *sPtrR,
 						   uint32 count,
 						   const dng_hue_sat_map &lut);
 
+void RefBaselineHueSatTable (const real32 *sPtrR,
+							 const real32 *sPtrG,
+							 const real32 *sPtrB,
+							 real32 *dPtrR,
+							 real32 *dPtrG,
+							 real32 *dPtrB,
+							 uint32 count,
+							 const dng_hue_sat_table &table);
+
 /*****************************************************************************/
 
 void RefBaselineRGBtoGray (const real32 *sPtrR,
@@ -502,6 +511,44 @@ void RefMapArea16 (uint16 *dPtr,
 
 /*****************************************************************************/
 
+void RefGainMapRow32 (real32 *dPtr,
+					  const real32 *gPtr1,
+					  const real32 *gPtr2,
+					  uint32 count,
+					  int32 dColStep,
+					  real32 gFract);
+
+/*****************************************************************************/
+
+void RefPackBits16 (const uint16 *sPtr,
+					uint8 *dPtr,
+					uint32 count,
+					uint32 bits);
+
+void RefUnpackBits16 (const uint8 *sPtr,
+					  uint16 *dPtr,
+					  uint32 count,
+					  uint32 bits);
+
+void RefDiffArea16 (const uint16 *sPtr,
+					const uint16 *dPtr,
+					uint32 rows,
+					uint32 cols,
+					uint32 planes,
+					int32 sRowStep,
+					int32 sColStep,
+					int32 sPlaneStep,
+					int32 dRowStep,
+					int32 dColStep,
+					int32 dPlaneStep,
+					uint16 *mPtr,
+					int32 mRowStep,
+					uint32 *maxDiff,
+					uint64 *diffCount,
+					uint64 *sumSquares);
+
+/*****************************************************************************/
+
 #endif
 	
 /*****************************************************************************/
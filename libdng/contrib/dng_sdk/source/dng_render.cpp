@@ -21,8 +21,11 @@
 #include "dng_color_space.h"
 #include "dng_color_spec.h"
 #include "dng_filter_task.h"
+#include "dng_fingerprint.h"
 #include "dng_host.h"
 #include "dng_image.h"
+#include "dng_memory.h"
+#include "dng_mutex.h"
 #include "dng_negative.h"
 #include "dng_resample.h"
 #include "dng_utils.h"
@@ -699,6 +702,410 @@ const dng_1d_function & dng_tone_curve_acr3_default::Get ()
 
 /*****************************************************************************/
 
+// Render state that depends only on the profile, the white balance and the
+// exposure, not on the pixels. Batch conversions of many frames from one
+// camera would rebuild identical state for every negative, so it is kept in
+// a small process-wide cache keyed by a fingerprint of its inputs. Entries
+// are read-only once built and are shared between render tasks.
+
+class dng_render_cache_entry
+	{
+	
+	public:
+	
+		dng_fingerprint fKey;
+		
+		// Owned by dng_render_cache, and guarded by its mutex.
+	
+		uint32 fRefCount;
+		
+		uint32 fLastUse;
+		
+		bool fCached;
+		
+	public:
+	
+		dng_render_cache_entry (const dng_fingerprint &key)
+		
+			:	fKey      (key)
+			,	fRefCount (0)
+			,	fLastUse  (0)
+			,	fCached   (false)
+			
+			{
+			}
+			
+		virtual ~dng_render_cache_entry ()
+			{
+			}
+			
+	private:
+	
+		// Hidden copy constructor and assignment operator.
+	
+		dng_render_cache_entry (const dng_render_cache_entry &entry);
+		
+		dng_render_cache_entry & operator= (const dng_render_cache_entry &entry);
+		
+	};
+
+/*****************************************************************************/
+
+class dng_render_cache
+	{
+	
+	private:
+	
+		enum
+			{
+			kMaxEntries = 32
+			};
+	
+		dng_mutex fMutex;
+		
+		dng_render_cache_entry *fEntries [kMaxEntries];
+		
+		uint32 fUseCounter;
+		
+	public:
+	
+		dng_render_cache ();
+		
+		~dng_render_cache ();
+		
+		static dng_render_cache & Get ();
+		
+		/// Find an entry and add a reference to it, or return NULL.
+		
+		dng_render_cache_entry * Acquire (const dng_fingerprint &key);
+		
+		/// Add a newly built entry, taking ownership of it. Returns the entry
+		/// to use, with a reference added, which is an existing one if another
+		/// thread built the same state first.
+		
+		dng_render_cache_entry * Insert (dng_render_cache_entry *entry);
+		
+		void Release (dng_render_cache_entry *entry);
+		
+	private:
+	
+		// Hidden copy constructor and assignment operator.
+	
+		dng_render_cache (const dng_render_cache &cache);
+		
+		dng_render_cache & operator= (const dng_render_cache &cache);
+		
+	};
+
+/*****************************************************************************/
+
+dng_render_cache::dng_render_cache ()
+
+	:	fMutex      ("dng_render_cache")
+	,	fUseCounter (0)
+	
+	{
+	
+	for (uint32 index = 0; index < kMaxEntries; index++)
+		{
+		fEntries [index] = NULL;
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+dng_render_cache::~dng_render_cache ()
+	{
+	
+	for (uint32 index = 0; index < kMaxEntries; index++)
+		{
+		delete fEntries [index];
+		}
+	
+	}
+	
+/*****************************************************************************/
+
+dng_render_cache & dng_render_cache::Get ()
+	{
+	
+	static dng_render_cache static_dng_render_cache;
+	
+	return static_dng_render_cache;
+	
+	}
+
+/*****************************************************************************/
+
+dng_render_cache_entry * dng_render_cache::Acquire (const dng_fingerprint &key)
+	{
+	
+	dng_lock_mutex lock (&fMutex);
+	
+	for (uint32 index = 0; index < kMaxEntries; index++)
+		{
+		
+		dng_render_cache_entry *entry = fEntries [index];
+		
+		if (entry && entry->fKey == key)
+			{
+			
+			entry->fRefCount++;
+			
+			entry->fLastUse = ++fUseCounter;
+			
+			return entry;
+			
+			}
+		
+		}
+		
+	return NULL;
+	
+	}
+
+/*****************************************************************************/
+
+dng_render_cache_entry * dng_render_cache::Insert (dng_render_cache_entry *entry)
+	{
+	
+	dng_lock_mutex lock (&fMutex);
+	
+	int32 victim = -1;
+	
+	for (uint32 index = 0; index < kMaxEntries; index++)
+		{
+		
+		dng_render_cache_entry *other = fEntries [index];
+		
+		if (!other)
+			{
+			
+			if (victim < 0 || fEntries [victim])
+				{
+				victim = index;
+				}
+				
+			continue;
+			
+			}
+		
+		if (other->fKey == entry->fKey)
+			{
+			
+			delete entry;
+			
+			other->fRefCount++;
+			
+			other->fLastUse = ++fUseCounter;
+			
+			return other;
+			
+			}
+			
+		// Only unreferenced entries can be evicted, oldest first.
+			
+		if (other->fRefCount == 0 &&
+			(victim < 0 || (fEntries [victim] &&
+							fEntries [victim]->fLastUse > other->fLastUse)))
+			{
+			victim = index;
+			}
+		
+		}
+		
+	entry->fRefCount = 1;
+	
+	entry->fLastUse = ++fUseCounter;
+		
+	// If every slot is in use, the entry is simply not cached, and is
+	// deleted with its last reference.
+	
+	if (victim >= 0)
+		{
+		
+		delete fEntries [victim];
+		
+		fEntries [victim] = entry;
+		
+		entry->fCached = true;
+		
+		}
+		
+	return entry;
+	
+	}
+
+/*****************************************************************************/
+
+void dng_render_cache::Release (dng_render_cache_entry *entry)
+	{
+	
+	dng_lock_mutex lock (&fMutex);
+	
+	DNG_ASSERT (entry->fRefCount > 0, "Unbalanced dng_render_cache::Release");
+	
+	if (--entry->fRefCount == 0 && !entry->fCached)
+		{
+		
+		delete entry;
+		
+		}
+	
+	}
+
+/*****************************************************************************/
+
+// Holds a reference to a cache entry for the life of a render task.
+
+template <class T>
+class dng_render_cache_ref
+	{
+	
+	private:
+	
+		T *fEntry;
+		
+	public:
+	
+		dng_render_cache_ref ()
+			:	fEntry (NULL)
+			{
+			}
+			
+		~dng_render_cache_ref ()
+			{
+			Reset (NULL);
+			}
+			
+		void Reset (dng_render_cache_entry *entry)
+			{
+			
+			if (fEntry)
+				{
+				dng_render_cache::Get ().Release (fEntry);
+				}
+				
+			fEntry = static_cast<T *> (entry);
+			
+			}
+			
+		T * Get () const
+			{
+			return fEntry;
+			}
+			
+	private:
+	
+		// Hidden copy constructor and assignment operator.
+	
+		dng_render_cache_ref (const dng_render_cache_ref &ref);
+		
+		dng_render_cache_ref & operator= (const dng_render_cache_ref &ref);
+		
+	};
+
+/*****************************************************************************/
+
+// Camera to linear ProPhoto conversion and hue/sat map for one profile,
+// calibration and white balance.
+
+class dng_render_white_state: public dng_render_cache_entry
+	{
+	
+	public:
+	
+		dng_vector fCameraWhite;
+		dng_matrix fCameraToRGB;
+		
+		AutoPtr<dng_hue_sat_table> fHueSatMap;
+		
+	public:
+	
+		dng_render_white_state (const dng_fingerprint &key,
+								const dng_vector &cameraWhite,
+								const dng_matrix &cameraToRGB)
+			:	dng_render_cache_entry (key)
+			,	fCameraWhite (cameraWhite)
+			,	fCameraToRGB (cameraToRGB)
+			{
+			}
+		
+	};
+
+/*****************************************************************************/
+
+// Look table for one profile.
+
+class dng_render_look_state: public dng_render_cache_entry
+	{
+	
+	public:
+	
+		AutoPtr<dng_hue_sat_table> fLookTable;
+		
+	public:
+	
+		dng_render_look_state (const dng_fingerprint &key)
+			:	dng_render_cache_entry (key)
+			{
+			}
+		
+	};
+
+/*****************************************************************************/
+
+// Default tone curve, darkened for one exposure.
+
+class dng_render_tone_state: public dng_render_cache_entry
+	{
+	
+	public:
+	
+		dng_1d_table fToneCurve;
+		
+	public:
+	
+		dng_render_tone_state (const dng_fingerprint &key)
+			:	dng_render_cache_entry (key)
+			{
+			}
+		
+	};
+
+/*****************************************************************************/
+
+static void PrintReal64 (dng_md5_printer &printer,
+						 real64 x)
+	{
+	
+	printer.Process (&x, (uint32) sizeof (x));
+	
+	}
+	
+/*****************************************************************************/
+
+static void PrintMatrix (dng_md5_printer &printer,
+						 const dng_matrix &m)
+	{
+	
+	uint32 rows = m.Rows ();
+	uint32 cols = m.Cols ();
+	
+	printer.Process (&rows, (uint32) sizeof (rows));
+	printer.Process (&cols, (uint32) sizeof (cols));
+	
+	for (uint32 row = 0; row < rows; row++)
+		for (uint32 col = 0; col < cols; col++)
+			{
+			PrintReal64 (printer, m [row] [col]);
+			}
+	
+	}
+	
+/*****************************************************************************/
+
 class dng_render_task: public dng_filter_task
 	{
 	
@@ -710,16 +1117,22 @@ class dng_render_task: public dng_filter_task
 		
 		dng_point fSrcOffset;
 		
-		dng_vector fCameraWhite;
-		dng_matrix fCameraToRGB;
-		
-		AutoPtr<dng_hue_sat_map> fHueSatMap;
+		const dng_hue_sat_table *fHueSatMap;
 		
 		dng_1d_table fExposureRamp;
 		
-		AutoPtr<dng_hue_sat_map> fLookTable;
+		const dng_hue_sat_table *fLookTable;
 		
-		dng_1d_table fToneCurve;
+		const dng_1d_table *fToneCurve;
+		
+		// Shared state from dng_render_cache, or a private tone curve when
+		// the render uses a custom one.
+		
+		dng_render_cache_ref<dng_render_white_state> fWhiteState;
+		dng_render_cache_ref<dng_render_look_state > fLookState;
+		dng_render_cache_ref<dng_render_tone_state > fToneState;
+		
+		dng_1d_table fCustomToneCurve;
 		
 		dng_matrix fRGBtoFinal;
 		
@@ -763,16 +1176,19 @@ dng_render_task::dng_render_task (const dng_image &srcImage,
 	,	fParams    (params   )
 	,	fSrcOffset (srcOffset)
 	
-	,	fCameraWhite ()
-	,	fCameraToRGB ()
-	
-	,	fHueSatMap ()
+	,	fHueSatMap (NULL)
 	
 	,	fExposureRamp ()
 	
-	,	fLookTable ()
+	,	fLookTable (NULL)
+	
+	,	fToneCurve (NULL)
 	
-	,	fToneCurve ()
+	,	fWhiteState ()
+	,	fLookState  ()
+	,	fToneState  ()
+	
+	,	fCustomToneCurve ()
 	
 	,	fRGBtoFinal ()
 	
@@ -780,8 +1196,16 @@ dng_render_task::dng_render_task (const dng_image &srcImage,
 	
 	{
 	
-	fSrcPixelType = ttFloat;
-	fDstPixelType = ttFloat;
+	// The tile buffers keep 16-bit source and 8 or 16-bit destination
+	// pixels in their own formats, which makes them two to four times
+	// smaller. ProcessArea converts one row at a time to and from the
+	// floating point work rows, using the same conversions as Get and Put.
+	
+	fSrcPixelType = (srcImage.PixelType () == ttShort) ? ttShort : ttFloat;
+	
+	fDstPixelType = (dstImage.PixelType () == ttByte ||
+					 dstImage.PixelType () == ttShort) ? dstImage.PixelType ()
+													   : (uint32) ttFloat;
 	
 	}
 			
@@ -814,56 +1238,174 @@ void dng_render_task::Start (uint32 threadCount,
 		
 		dng_camera_profile_id profileID;	// Default profile ID.
 		
-		AutoPtr<dng_color_spec> spec (fNegative.MakeColorSpec (profileID));
+		const dng_camera_profile *profile = fNegative.ProfileByID (profileID);
+		
+		// The color spec only depends on the profile, the calibration data
+		// from the negative and the white balance, so fingerprint those.
+		
+		dng_fingerprint profilePrint;
+		
+		if (profile)
+			{
+			profilePrint = profile->Fingerprint ();
+			}
+		
+		dng_md5_printer whitePrinter;
+		
+		whitePrinter.Process ("white");
+		
+		whitePrinter.Process (profilePrint.data, (uint32) sizeof (profilePrint.data));
+		
+			{
+			
+			uint32 channels = fNegative.ColorChannels ();
+			
+			whitePrinter.Process (&channels, (uint32) sizeof (channels));
+			
+			for (uint32 j = 0; j < channels; j++)
+				{
+				PrintReal64 (whitePrinter, fNegative.AnalogBalance (j));
+				}
+				
+			}
+		
+		whitePrinter.Process (fNegative.CameraCalibrationSignature ().Get ());
+		
+		PrintMatrix (whitePrinter, fNegative.CameraCalibration1 ());
+		PrintMatrix (whitePrinter, fNegative.CameraCalibration2 ());
 		
 		if (fParams.WhiteXY ().IsValid ())
 			{
 			
-			spec->SetWhiteXY (fParams.WhiteXY ());
+			whitePrinter.Process ("xy");
+			
+			PrintReal64 (whitePrinter, fParams.WhiteXY ().x);
+			PrintReal64 (whitePrinter, fParams.WhiteXY ().y);
 			
 			}
 							 
 		else if (fNegative.HasCameraNeutral ())
 			{
 			
-			spec->SetWhiteXY (spec->NeutralToXY (fNegative.CameraNeutral ()));
+			whitePrinter.Process ("neutral");
+			
+			const dng_vector &neutral = fNegative.CameraNeutral ();
+			
+			for (uint32 j = 0; j < neutral.Count (); j++)
+				{
+				PrintReal64 (whitePrinter, neutral [j]);
+				}
 			
 			}
 			
 		else if (fNegative.HasCameraWhiteXY ())
 			{
 			
-			spec->SetWhiteXY (fNegative.CameraWhiteXY ());
+			whitePrinter.Process ("xy");
+			
+			PrintReal64 (whitePrinter, fNegative.CameraWhiteXY ().x);
+			PrintReal64 (whitePrinter, fNegative.CameraWhiteXY ().y);
 			
 			}
 			
 		else
 			{
 			
-			spec->SetWhiteXY (D55_xy_coord ());
+			whitePrinter.Process ("default");
 			
 			}
 			
-		fCameraWhite = spec->CameraWhite ();
+		dng_render_cache &cache = dng_render_cache::Get ();
 		
-		fCameraToRGB = dng_space_ProPhoto::Get ().MatrixFromPCS () *
-					   spec->CameraToPCS ();
-					   
-		// Find Hue/Sat table, if any.
+		fWhiteState.Reset (cache.Acquire (whitePrinter.Result ()));
 		
-		const dng_camera_profile *profile = fNegative.ProfileByID (profileID);
+		if (!fWhiteState.Get ())
+			{
+			
+			AutoPtr<dng_color_spec> spec (fNegative.MakeColorSpec (profileID));
+			
+			if (fParams.WhiteXY ().IsValid ())
+				{
+				
+				spec->SetWhiteXY (fParams.WhiteXY ());
+				
+				}
+								 
+			else if (fNegative.HasCameraNeutral ())
+				{
+				
+				spec->SetWhiteXY (spec->NeutralToXY (fNegative.CameraNeutral ()));
+				
+				}
+				
+			else if (fNegative.HasCameraWhiteXY ())
+				{
+				
+				spec->SetWhiteXY (fNegative.CameraWhiteXY ());
+				
+				}
+				
+			else
+				{
+				
+				spec->SetWhiteXY (D55_xy_coord ());
+				
+				}
+				
+			AutoPtr<dng_render_white_state> state
+				(new dng_render_white_state (whitePrinter.Result (),
+											 spec->CameraWhite (),
+											 dng_space_ProPhoto::Get ().MatrixFromPCS () *
+											 spec->CameraToPCS ()));
+						   
+			// Find Hue/Sat table, if any. Expand it into interpolation cells
+			// once here, rather than resolving the grid neighbors per pixel.
+			
+			if (profile)
+				{
+				
+				AutoPtr<dng_hue_sat_map> hueSatMap (profile->HueSatMapForWhite (spec->WhiteXY ()));
+				
+				if (hueSatMap.Get ())
+					{
+					
+					state->fHueSatMap.Reset (new dng_hue_sat_table (*hueSatMap.Get ()));
+					
+					}
+					
+				}
+				
+			fWhiteState.Reset (cache.Insert (state.Release ()));
+			
+			}
+			
+		fHueSatMap = fWhiteState.Get ()->fHueSatMap.Get ();
 		
-		if (profile)
+		// The look table only depends on the profile.
+			
+		if (profile && profile->HasLookTable ())
 			{
 			
-			fHueSatMap.Reset (profile->HueSatMapForWhite (spec->WhiteXY ()));
+			dng_md5_printer lookPrinter;
+			
+			lookPrinter.Process ("look");
+			
+			lookPrinter.Process (profilePrint.data, (uint32) sizeof (profilePrint.data));
 			
-			if (profile->HasLookTable ())
+			fLookState.Reset (cache.Acquire (lookPrinter.Result ()));
+			
+			if (!fLookState.Get ())
 				{
 				
-				fLookTable.Reset (new dng_hue_sat_map (profile->LookTable ()));
+				AutoPtr<dng_render_look_state> state (new dng_render_look_state (lookPrinter.Result ()));
+				
+				state->fLookTable.Reset (new dng_hue_sat_table (profile->LookTable ()));
+				
+				fLookState.Reset (cache.Insert (state.Release ()));
 				
 				}
+				
+			fLookTable = fLookState.Get ()->fLookTable.Get ();
 			
 			}
 		
@@ -907,7 +1449,48 @@ void dng_render_task::Start (uint32 threadCount,
 		dng_1d_concatenate totalTone (exposureTone,
 									  fParams.ToneCurve ());
 		
-		fToneCurve.Initialize (*allocator, totalTone);
+		// Only the default curve is known to be the same between renders,
+		// so only that is shared through the cache.
+		
+		if (&fParams.ToneCurve () == &dng_tone_curve_acr3_default::Get ())
+			{
+			
+			dng_md5_printer tonePrinter;
+			
+			tonePrinter.Process ("tone");
+			
+			PrintReal64 (tonePrinter, exposure);
+			
+			dng_render_cache &cache = dng_render_cache::Get ();
+			
+			fToneState.Reset (cache.Acquire (tonePrinter.Result ()));
+			
+			if (!fToneState.Get ())
+				{
+				
+				AutoPtr<dng_render_tone_state> state (new dng_render_tone_state (tonePrinter.Result ()));
+				
+				// Cached tables outlive this render, so they can not use its
+				// allocator.
+				
+				state->fToneCurve.Initialize (gDefaultDNGMemoryAllocator, totalTone);
+				
+				fToneState.Reset (cache.Insert (state.Release ()));
+				
+				}
+				
+			fToneCurve = &fToneState.Get ()->fToneCurve;
+			
+			}
+			
+		else
+			{
+		
+			fCustomToneCurve.Initialize (*allocator, totalTone);
+			
+			fToneCurve = &fCustomToneCurve;
+			
+			}
 				
 		}
 		
@@ -924,9 +1507,10 @@ void dng_render_task::Start (uint32 threadCount,
 		
 		}
 							
-	// Allocate temp buffer to hold one row of RGB data.
+	// Allocate temp buffer to hold one row of RGB data, plus one row of
+	// up to four planes of source or destination data in floating point.
 							
-	uint32 tempBufferSize = tileSize.h * sizeof (real32) * 3;
+	uint32 tempBufferSize = tileSize.h * sizeof (real32) * (3 + kMaxColorPlanes);
 	
 	for (uint32 threadIndex = 0; threadIndex < threadCount; threadIndex++)
 		{
@@ -954,6 +1538,8 @@ void dng_render_task::ProcessArea (uint32 threadIndex,
 	real32 *tPtrG = tPtrR + srcCols;
 	real32 *tPtrB = tPtrG + srcCols;
 	
+	real32 *wPtr = tPtrB + srcCols;
+	
 	for (int32 srcRow = srcArea.t; srcRow < srcArea.b; srcRow++)
 		{
 		
@@ -962,10 +1548,44 @@ void dng_render_task::ProcessArea (uint32 threadIndex,
 		
 			{
 		
-			const real32 *sPtrA = (const real32 *)
-								  srcBuffer.ConstPixel (srcRow,
-													    srcArea.l,
-													    0);
+			const real32 *sPtrA = (const real32 *) wPtr;
+			
+			int32 sPlaneStep = srcCols;
+			
+			if (fSrcPixelType == ttShort)
+				{
+				
+				// The planes of this row are passed as rows and the columns
+				// as planes, the order CopyArea picks, so the innermost loop
+				// runs along contiguous samples.
+				
+				DoCopyArea16_R32 (srcBuffer.ConstPixel_uint16 (srcRow,
+															   srcArea.l,
+															   0),
+								  wPtr,
+								  fSrcPlanes,
+								  1,
+								  srcCols,
+								  srcBuffer.fPlaneStep,
+								  0,
+								  srcBuffer.fColStep,
+								  srcCols,
+								  0,
+								  1,
+								  srcBuffer.PixelRange ());
+				
+				}
+				
+			else
+				{
+				
+				sPtrA = srcBuffer.ConstPixel_real32 (srcRow,
+													 srcArea.l,
+													 0);
+				
+				sPlaneStep = srcBuffer.fPlaneStep;
+				
+				}
 													   
 			if (fSrcPlanes == 1)
 				{
@@ -982,8 +1602,8 @@ void dng_render_task::ProcessArea (uint32 threadIndex,
 			else
 				{
 				
-				const real32 *sPtrB = sPtrA + srcBuffer.fPlaneStep;
-				const real32 *sPtrC = sPtrB + srcBuffer.fPlaneStep;
+				const real32 *sPtrB = sPtrA + sPlaneStep;
+				const real32 *sPtrC = sPtrB + sPlaneStep;
 				
 				if (fSrcPlanes == 3)
 					{
@@ -995,15 +1615,15 @@ void dng_render_task::ProcessArea (uint32 threadIndex,
 									    tPtrG,
 									    tPtrB,
 									    srcCols,
-									    fCameraWhite,
-									    fCameraToRGB);
+									    fWhiteState.Get ()->fCameraWhite,
+									    fWhiteState.Get ()->fCameraToRGB);
 					
 					}
 					
 				else
 					{
 					
-					const real32 *sPtrD = sPtrC + srcBuffer.fPlaneStep;
+					const real32 *sPtrD = sPtrC + sPlaneStep;
 				
 					DoBaselineABCDtoRGB (sPtrA,
 									     sPtrB,
@@ -1013,24 +1633,24 @@ void dng_render_task::ProcessArea (uint32 threadIndex,
 									     tPtrG,
 									     tPtrB,
 									     srcCols,
-									     fCameraWhite,
-									     fCameraToRGB);
+									     fWhiteState.Get ()->fCameraWhite,
+									     fWhiteState.Get ()->fCameraToRGB);
 					
 					}
 					
 				// Apply Hue/Sat map, if any.
 				
-				if (fHueSatMap.Get ())
+				if (fHueSatMap)
 					{
 					
-					DoBaselineHueSatMap (tPtrR,
-										 tPtrG,
-										 tPtrB,
-										 tPtrR,
-										 tPtrG,
-										 tPtrB,
-										 srcCols,
-										 *fHueSatMap.Get ());
+					DoBaselineHueSatTable (tPtrR,
+										   tPtrG,
+										   tPtrB,
+										   tPtrR,
+										   tPtrG,
+										   tPtrB,
+										   srcCols,
+										   *fHueSatMap);
 					
 					}
 				
@@ -1057,17 +1677,17 @@ void dng_render_task::ProcessArea (uint32 threadIndex,
 		
 		// Apply Hue/Sat map, if any.
 		
-		if (fLookTable.Get ())
+		if (fLookTable)
 			{
 			
-			DoBaselineHueSatMap (tPtrR,
-								 tPtrG,
-								 tPtrB,
-								 tPtrR,
-								 tPtrG,
-								 tPtrB,
-								 srcCols,
-								 *fLookTable.Get ());
+			DoBaselineHueSatTable (tPtrR,
+								   tPtrG,
+								   tPtrB,
+								   tPtrR,
+								   tPtrG,
+								   tPtrB,
+								   srcCols,
+								   *fLookTable);
 			
 			}
 
@@ -1080,18 +1700,33 @@ void dng_render_task::ProcessArea (uint32 threadIndex,
 					       tPtrG,
 						   tPtrB,
 						   srcCols,
-						   fToneCurve);
+						   *fToneCurve);
 						   
 		// Convert to final color space.
 		
 		int32 dstRow = srcRow + (dstArea.t - srcArea.t);
 		
+		// Integer destinations are built in the work row first.
+		
+		real32 *dPtrA = wPtr;
+		
+		int32 dPlaneStep = srcCols;
+		
+		if (fDstPixelType == ttFloat)
+			{
+			
+			dPtrA = dstBuffer.DirtyPixel_real32 (dstRow,
+												 dstArea.l,
+												 0);
+												 
+			dPlaneStep = dstBuffer.fPlaneStep;
+			
+			}
+		
 		if (fDstPlanes == 1)
 			{
 			
-			real32 *dPtrG = dstBuffer.DirtyPixel_real32 (dstRow,
-														 dstArea.l,
-														 0);
+			real32 *dPtrG = dPtrA;
 
 			DoBaselineRGBtoGray (tPtrR,
 								 tPtrG,
@@ -1110,12 +1745,9 @@ void dng_render_task::ProcessArea (uint32 threadIndex,
 		else
 			{
 			
-			real32 *dPtrR = dstBuffer.DirtyPixel_real32 (dstRow,
-														 dstArea.l,
-														 0);
-		
-			real32 *dPtrG = dPtrR + dstBuffer.fPlaneStep;
-			real32 *dPtrB = dPtrG + dstBuffer.fPlaneStep;
+			real32 *dPtrR = dPtrA;
+			real32 *dPtrG = dPtrR + dPlaneStep;
+			real32 *dPtrB = dPtrG + dPlaneStep;
 			
 			DoBaselineRGBtoRGB (tPtrR,
 								tPtrG,
@@ -1142,6 +1774,46 @@ void dng_render_task::ProcessArea (uint32 threadIndex,
 							   fEncodeGamma);
 							   
 			}
+			
+		if (fDstPixelType == ttByte)
+			{
+			
+			DoCopyAreaR32_8 (dPtrA,
+							 dstBuffer.DirtyPixel_uint8 (dstRow,
+														 dstArea.l,
+														 0),
+							 fDstPlanes,
+							 1,
+							 srcCols,
+							 srcCols,
+							 0,
+							 1,
+							 dstBuffer.fPlaneStep,
+							 0,
+							 dstBuffer.fColStep,
+							 dstBuffer.PixelRange ());
+			
+			}
+			
+		else if (fDstPixelType == ttShort)
+			{
+			
+			DoCopyAreaR32_16 (dPtrA,
+							  dstBuffer.DirtyPixel_uint16 (dstRow,
+														   dstArea.l,
+														   0),
+							  fDstPlanes,
+							  1,
+							  srcCols,
+							  srcCols,
+							  0,
+							  1,
+							  dstBuffer.fPlaneStep,
+							  0,
+							  dstBuffer.fColStep,
+							  dstBuffer.PixelRange ());
+			
+			}
 		
 		}
 	
@@ -1239,20 +1911,66 @@ dng_image * dng_render::Render ()
 		
 	AutoPtr<dng_image> tempImage;
 	
-	if (srcBounds.Size () != dstSize)
+	// For large reductions, first average whole blocks of pixels down to
+	// within 2x of the final size. A bicubic kernel stretched over the
+	// full ratio needs many times more taps per output sample.
+	
+	dng_point factor;
+	
+	factor.v = Pin_int32 (1, ((int32) srcBounds.H () + dstSize.v * 2 - 1) / (dstSize.v * 2), 256);
+	factor.h = Pin_int32 (1, ((int32) srcBounds.W () + dstSize.h * 2 - 1) / (dstSize.h * 2), 256);
+	
+	if (factor != dng_point (1, 1))
 		{
-
-		tempImage.Reset (fHost.Make_dng_image (dstSize,
+		
+		dng_point blockSize;
+		
+		blockSize.v = (srcBounds.H () + factor.v - 1) / factor.v;
+		blockSize.h = (srcBounds.W () + factor.h - 1) / factor.h;
+		
+		// Center the block grid on the crop, so the few pixels of overhang
+		// are split between the two edges.
+		
+		dng_rect blockBounds;
+		
+		blockBounds.t = srcBounds.t - (blockSize.v * factor.v - (int32) srcBounds.H ()) / 2;
+		blockBounds.l = srcBounds.l - (blockSize.h * factor.h - (int32) srcBounds.W ()) / 2;
+		
+		blockBounds.b = blockBounds.t + blockSize.v * factor.v;
+		blockBounds.r = blockBounds.l + blockSize.h * factor.h;
+		
+		tempImage.Reset (fHost.Make_dng_image (blockSize,
 											   srcImage->Planes    (),
 											   srcImage->PixelType ()));
+											   
+		AreaAverageImage (fHost,
+						  *srcImage,
+						  *tempImage.Get (),
+						  blockBounds,
+						  factor);
+						  
+		srcImage = tempImage.Get ();
+		
+		srcBounds = tempImage->Bounds ();
+		
+		}
+	
+	if (srcBounds.Size () != dstSize)
+		{
+
+		AutoPtr<dng_image> resampledImage (fHost.Make_dng_image (dstSize,
+															 srcImage->Planes    (),
+															 srcImage->PixelType ()));
 											 
 		ResampleImage (fHost,
 					   *srcImage,
-					   *tempImage.Get (),
+					   *resampledImage.Get (),
 					   srcBounds,
-					   tempImage->Bounds (),
+					   resampledImage->Bounds (),
 					   dng_resample_bicubic::Get ());
 						   
+		tempImage.Reset (resampledImage.Release ());
+		
 		srcImage = tempImage.Get ();
 		
 		srcBounds = tempImage->Bounds ();
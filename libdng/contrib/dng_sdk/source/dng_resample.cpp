@@ -779,3 +779,289 @@ void ResampleImage (dng_host &host,
 	}
 
 /*****************************************************************************/
+
+class dng_area_average_task: public dng_filter_task
+	{
+	
+	protected:
+	
+		dng_point fSrcOrigin;
+		
+		dng_point fFactor;
+		
+		AutoPtr<dng_memory_block> fTempBuffer [kMaxMPThreads];
+		
+	public:
+	
+		dng_area_average_task (const dng_image &srcImage,
+							   dng_image &dstImage,
+							   const dng_point &srcOrigin,
+							   const dng_point &factor);
+	
+		virtual dng_rect SrcArea (const dng_rect &dstArea);
+			
+		virtual void Start (uint32 threadCount,
+							const dng_point &tileSize,
+							dng_memory_allocator *allocator,
+							dng_abort_sniffer *sniffer);
+							
+		virtual void ProcessArea (uint32 threadIndex,
+								  dng_pixel_buffer &srcBuffer,
+								  dng_pixel_buffer &dstBuffer);
+								  
+	};
+							
+/*****************************************************************************/
+
+dng_area_average_task::dng_area_average_task (const dng_image &srcImage,
+											  dng_image &dstImage,
+											  const dng_point &srcOrigin,
+											  const dng_point &factor)
+						   			  
+	:	dng_filter_task (srcImage,
+						 dstImage)
+						   
+	,	fSrcOrigin (srcOrigin)
+	,	fFactor    (factor   )
+	
+	{
+	
+	if (srcImage.PixelSize  () <= 2 &&
+		dstImage.PixelSize  () <= 2 &&
+		srcImage.PixelRange () == dstImage.PixelRange ())
+		{
+		fSrcPixelType = ttShort;
+		fDstPixelType = ttShort;
+		}
+		
+	else
+		{
+		fSrcPixelType = ttFloat;
+		fDstPixelType = ttFloat;
+		}
+		
+	// Keep the source tiles about the size they would be for a 1:1 filter.
+	
+	fMaxTileSize.v = Max_int32 (1, fMaxTileSize.v / fFactor.v);
+	fMaxTileSize.h = Max_int32 (1, fMaxTileSize.h / fFactor.h);
+	
+	}
+							
+/*****************************************************************************/
+
+dng_rect dng_area_average_task::SrcArea (const dng_rect &dstArea)
+	{
+	
+	return dng_rect (fSrcOrigin.v + dstArea.t * fFactor.v,
+					 fSrcOrigin.h + dstArea.l * fFactor.h,
+					 fSrcOrigin.v + dstArea.b * fFactor.v,
+					 fSrcOrigin.h + dstArea.r * fFactor.h);
+	
+	}
+			
+/*****************************************************************************/
+
+void dng_area_average_task::Start (uint32 threadCount,
+								   const dng_point &tileSize,
+								   dng_memory_allocator *allocator,
+								   dng_abort_sniffer *sniffer)
+	{
+	
+	// One row of column sums per thread.
+	
+	uint32 tempBufferSize = RoundUp8 (tileSize.h * fFactor.h) * sizeof (uint32);
+	
+	for (uint32 threadIndex = 0; threadIndex < threadCount; threadIndex++)
+		{
+		
+		fTempBuffer [threadIndex] . Reset (allocator->Allocate (tempBufferSize));
+		
+		}
+		
+	dng_filter_task::Start (threadCount,
+							tileSize,
+							allocator,
+							sniffer);
+							
+	}
+							
+/*****************************************************************************/
+
+void dng_area_average_task::ProcessArea (uint32 threadIndex,
+								     	 dng_pixel_buffer &srcBuffer,
+								     	 dng_pixel_buffer &dstBuffer)
+	{
+	
+	dng_rect srcArea = srcBuffer.fArea;
+	dng_rect dstArea = dstBuffer.fArea;
+	
+	uint32 srcCols = srcArea.W ();
+	uint32 dstCols = dstArea.W ();
+	
+	uint32 cellRows = fFactor.v;
+	uint32 cellCols = fFactor.h;
+	
+	uint32 cellCount = cellRows * cellCols;
+	
+	// Each destination row first sums its block of source rows column by
+	// column, which streams through contiguous samples, then sums across
+	// each block of columns.
+	
+	if (fSrcPixelType == ttFloat)
+		{
+		
+		real32 *tPtr = fTempBuffer [threadIndex]->Buffer_real32 ();
+		
+		real32 scale = 1.0f / (real32) cellCount;
+	
+		for (uint32 plane = 0; plane < dstBuffer.fPlanes; plane++)
+			{
+			
+			int32 srcRow = srcArea.t;
+		
+			for (int32 dstRow = dstArea.t; dstRow < dstArea.b; dstRow++)
+				{
+				
+				const real32 *sPtr = srcBuffer.ConstPixel_real32 (srcRow,
+																  srcArea.l,
+																  plane);
+				
+				uint32 col;
+				
+				for (col = 0; col < srcCols; col++)
+					{
+					tPtr [col] = sPtr [col];
+					}
+					
+				for (uint32 row = 1; row < cellRows; row++)
+					{
+					
+					sPtr += srcBuffer.fRowStep;
+					
+					for (col = 0; col < srcCols; col++)
+						{
+						tPtr [col] += sPtr [col];
+						}
+						
+					}
+					
+				real32 *dPtr = dstBuffer.DirtyPixel_real32 (dstRow,
+															dstArea.l,
+															plane);
+															
+				const real32 *ttPtr = tPtr;
+				
+				for (col = 0; col < dstCols; col++)
+					{
+					
+					real32 total = 0.0f;
+					
+					for (uint32 k = 0; k < cellCols; k++)
+						{
+						total += ttPtr [k];
+						}
+						
+					dPtr [col] = total * scale;
+					
+					ttPtr += cellCols;
+					
+					}
+					
+				srcRow += cellRows;
+				
+				}
+				
+			}
+		
+		}
+		
+	else
+		{
+		
+		uint32 *tPtr = fTempBuffer [threadIndex]->Buffer_uint32 ();
+		
+		uint32 half = cellCount >> 1;
+	
+		for (uint32 plane = 0; plane < dstBuffer.fPlanes; plane++)
+			{
+			
+			int32 srcRow = srcArea.t;
+		
+			for (int32 dstRow = dstArea.t; dstRow < dstArea.b; dstRow++)
+				{
+				
+				const uint16 *sPtr = srcBuffer.ConstPixel_uint16 (srcRow,
+																  srcArea.l,
+																  plane);
+				
+				uint32 col;
+				
+				for (col = 0; col < srcCols; col++)
+					{
+					tPtr [col] = sPtr [col];
+					}
+					
+				for (uint32 row = 1; row < cellRows; row++)
+					{
+					
+					sPtr += srcBuffer.fRowStep;
+					
+					for (col = 0; col < srcCols; col++)
+						{
+						tPtr [col] += sPtr [col];
+						}
+						
+					}
+					
+				uint16 *dPtr = dstBuffer.DirtyPixel_uint16 (dstRow,
+															dstArea.l,
+															plane);
+															
+				const uint32 *ttPtr = tPtr;
+				
+				for (col = 0; col < dstCols; col++)
+					{
+					
+					uint32 total = half;
+					
+					for (uint32 k = 0; k < cellCols; k++)
+						{
+						total += ttPtr [k];
+						}
+						
+					dPtr [col] = (uint16) (total / cellCount);
+					
+					ttPtr += cellCols;
+					
+					}
+					
+				srcRow += cellRows;
+				
+				}
+				
+			}
+		
+		}
+	
+	}
+		
+/*****************************************************************************/
+
+void AreaAverageImage (dng_host &host,
+					   const dng_image &srcImage,
+					   dng_image &dstImage,
+					   const dng_rect &srcBounds,
+					   const dng_point &factor)
+	{
+	
+	dng_area_average_task task (srcImage,
+								dstImage,
+								srcBounds.TL (),
+								factor);
+							
+	host.PerformAreaTask (task,
+						  dstImage.Bounds ());
+	
+	}
+
+/*****************************************************************************/
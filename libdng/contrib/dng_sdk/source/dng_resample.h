@@ -256,6 +256,19 @@ void ResampleImage (dng_host &host,
 						
 /*****************************************************************************/
 
+// Reduces srcBounds by whole factors, replacing each factor.v by factor.h
+// block of source pixels with their average. The destination image is
+// srcBounds.Size () / factor in size; source pixels outside the image are
+// edge-repeated, as the resampler does.
+
+void AreaAverageImage (dng_host &host,
+					   const dng_image &srcImage,
+					   dng_image &dstImage,
+					   const dng_rect &srcBounds,
+					   const dng_point &factor);
+
+/*****************************************************************************/
+
 #endif
 	
 /*****************************************************************************/
@@ -73,6 +73,8 @@ dng_camera_profile_info::dng_camera_profile_info ()
 	,	fToneCurveCount      (0)
 	
 	,	fUniqueCameraModel ()
+	
+	,	fUnsupportedTag (0)
 
 	{
 	
@@ -775,6 +777,26 @@ bool dng_camera_profile_info::ParseTag (dng_stream &stream,
 			
 			}
 
+		case tcProfileHueSatMapEncoding:
+		case tcProfileLookTableEncoding:
+			{
+			
+			// DNG 1.4. Only the linear encoding (0), which is the default,
+			// is implemented.
+			
+			CheckTagType (parentCode, tagCode, tagType, ttLong);
+			
+			CheckTagCount (parentCode, tagCode, tagCount, 1);
+			
+			if (stream.TagValue_uint32 (tagType) != 0 && !fUnsupportedTag)
+				{
+				fUnsupportedTag = tagCode;
+				}
+				
+			break;
+			
+			}
+
 		case tcUniqueCameraModel:
 			{
 			
@@ -937,7 +959,10 @@ bool dng_camera_profile_info::ParseExtended (dng_stream &stream)
 
 			}
 			
-		return true;
+		// Profiles that need DNG 1.4 features this SDK lacks are skipped,
+		// like other profiles it cannot read.
+			
+		return fUnsupportedTag == 0;
 
 		}
 		
@@ -975,6 +1000,8 @@ dng_shared::dng_shared ()
 	,	fDNGVersion         (0)
 	,	fDNGBackwardVersion (0)
 	
+	,	fUnsupportedTag (0)
+	
 	,	fUniqueCameraModel    ()
 	,	fLocalizedCameraModel ()
 	
@@ -1697,6 +1724,44 @@ bool dng_shared::Parse_ifd0 (dng_stream &stream,
 			
 			}
 			
+		case tcBaselineExposureOffset:
+			{
+			
+			// DNG 1.4, and not applied by this SDK, so only the default of
+			// zero is supported.
+			
+			CheckTagType (parentCode, tagCode, tagType, ttSRational);
+			
+			CheckTagCount (parentCode, tagCode, tagCount, 1);
+			
+			if (stream.TagValue_srational (tagType).As_real64 () != 0.0 && !fUnsupportedTag)
+				{
+				fUnsupportedTag = tagCode;
+				}
+				
+			break;
+			
+			}
+			
+		case tcDefaultBlackRender:
+			{
+			
+			// DNG 1.4. Only the default, automatic black subtraction (0),
+			// is implemented.
+			
+			CheckTagType (parentCode, tagCode, tagType, ttLong);
+			
+			CheckTagCount (parentCode, tagCode, tagCount, 1);
+			
+			if (stream.TagValue_uint32 (tagType) != 0 && !fUnsupportedTag)
+				{
+				fUnsupportedTag = tagCode;
+				}
+				
+			break;
+			
+			}
+			
 		case tcBaselineNoise:
 			{
 			
@@ -2781,7 +2846,9 @@ bool dng_shared::IsValidDNG ()
 		
 	// Check DNGBackwardVersion value.
 	
-	if (fDNGBackwardVersion > dngVersion_Current)
+	// Files needing DNG 1.4 get further checks in dng_info::IsValidDNG.
+	
+	if (fDNGBackwardVersion > dngVersion_MaxPartialBackward)
 		{
 		
 		#if qDNGValidate
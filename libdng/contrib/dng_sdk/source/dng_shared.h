@@ -83,6 +83,10 @@ class dng_camera_profile_info
 		uint32 fToneCurveCount;
 		
 		dng_string fUniqueCameraModel;
+		
+		// First DNG 1.4 tag with a value this SDK cannot apply, or 0.
+		
+		uint32 fUnsupportedTag;
 
 	public:
 	
@@ -127,6 +131,10 @@ class dng_shared
 		uint32 fDNGVersion;
 		uint32 fDNGBackwardVersion;
 		
+		// First DNG 1.4 tag with a value this SDK cannot apply, or 0.
+		
+		uint32 fUnsupportedTag;
+		
 		dng_string fUniqueCameraModel;
 		dng_string fLocalizedCameraModel;
 		
@@ -37,6 +37,10 @@ dng_stream::dng_stream (dng_abort_sniffer *sniffer,
 	,	fMemBlock			  (bufferSize)
 	,	fBuffer				  (fMemBlock.Buffer_uint8 ())
 	,	fBufferSize			  (bufferSize)
+	,	fMinBufferSize		  (bufferSize)
+	,	fMaxBufferSize		  (bufferSize)
+	,	fReadSize			  (bufferSize)
+	,	fReadEnd			  (0)
 	,	fBufferStart		  (0)
 	,	fBufferEnd			  (0)
 	,	fBufferLimit		  (bufferSize)
@@ -61,6 +65,10 @@ dng_stream::dng_stream (const void *data,
 	,	fMemBlock			  ()
 	,	fBuffer				  ((uint8 *) data)
 	,	fBufferSize			  (count)
+	,	fMinBufferSize		  (count)
+	,	fMaxBufferSize		  (count)
+	,	fReadSize			  (count)
+	,	fReadEnd			  (0)
 	,	fBufferStart		  (0)
 	,	fBufferEnd			  (count)
 	,	fBufferLimit		  (count)
@@ -122,6 +130,30 @@ void dng_stream::DoWrite (const void * /* data */,
 		
 /*****************************************************************************/
 
+void dng_stream::SetMaxBufferSize (uint32 maxSize)
+	{
+	
+	if (fMemBlock.Buffer ())
+		{
+		
+		fMaxBufferSize = Max_uint32 (maxSize, fMinBufferSize);
+		
+		fReadSize = Min_uint32 (fReadSize, fMaxBufferSize);
+		
+		}
+	
+	}
+		
+/*****************************************************************************/
+
+void dng_stream::Prefetch (uint64 /* offset */,
+						   uint64 /* count */)
+	{
+	
+	}
+		
+/*****************************************************************************/
+
 bool dng_stream::BigEndian () const
 	{
 	
@@ -268,9 +300,21 @@ void dng_stream::Get (void *data, uint32 count)
 		
 		Flush ();
 		
+		// Grow the read size while the reads continue where the last one
+		// ended, and fall back to the initial size after a seek.
+		
+		if (fPosition == fReadEnd)
+			{
+			fReadSize = Min_uint32 (fReadSize * 2, fMaxBufferSize);
+			}
+		else
+			{
+			fReadSize = fMinBufferSize;
+			}
+		
 		// Do large reads unbuffered.
 		
-		if (count > fBufferSize)
+		if (count > fReadSize)
 			{
 			
 			if (fPosition + count > Length ())
@@ -286,15 +330,30 @@ void dng_stream::Get (void *data, uint32 count)
 					
 			fPosition += count;
 			
+			fReadEnd = fPosition;
+			
 			return;
 			
 			}
 			
+		if (fReadSize > fBufferSize)
+			{
+			
+			fMemBlock.Allocate (fReadSize);
+			
+			fBuffer = fMemBlock.Buffer_uint8 ();
+			
+			fBufferSize = fReadSize;
+			
+			fBufferLimit = fBufferSize;
+			
+			}
+			
 		// Figure out new buffer range.
 		
 		fBufferStart = fPosition;
 		
-		if (fBufferSize >= 4096)
+		if (fReadSize >= 4096)
 			{
 			
 			// Align to a 4K file block.
@@ -303,7 +362,7 @@ void dng_stream::Get (void *data, uint32 count)
 			
 			}
 		
-		fBufferEnd = Min_uint64 (fBufferStart + fBufferSize, Length ());
+		fBufferEnd = Min_uint64 (fBufferStart + fReadSize, Length ());
 		
 		if (fBufferEnd <= fPosition)
 			{
@@ -319,6 +378,8 @@ void dng_stream::Get (void *data, uint32 count)
 		DoRead (fBuffer,
 				(uint32) (fBufferEnd - fBufferStart),
 				fBufferStart);
+				
+		fReadEnd = fBufferEnd;
 		
 		}
 
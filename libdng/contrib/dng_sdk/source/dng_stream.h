@@ -49,6 +49,7 @@ class dng_stream
 			
 			kSmallBufferSize =  4 * 1024,
 			kBigBufferSize   = 64 * 1024,
+			kHugeBufferSize  = 256 * 1024,
 			
 			kDefaultBufferSize = kSmallBufferSize
 			
@@ -72,6 +73,16 @@ class dng_stream
 		
 		uint32 fBufferSize;
 		
+		// Adaptive read buffering: reads are fReadSize bytes, which doubles
+		// up to fMaxBufferSize on sequential reads and drops back to
+		// fMinBufferSize after a seek.
+		
+		uint32 fMinBufferSize;
+		uint32 fMaxBufferSize;
+		uint32 fReadSize;
+		
+		uint64 fReadEnd;
+		
 		uint64 fBufferStart;
 		uint64 fBufferEnd;
 		uint64 fBufferLimit;
@@ -161,6 +172,22 @@ class dng_stream
 			{
 			return fBufferSize;
 			}
+			
+		/// Allows the read buffer to grow while the stream is read
+		/// sequentially, up to maxSize bytes. It shrinks back to the
+		/// initial size after a seek. Has no effect on streams
+		/// constructed on existing data.
+		/// \param maxSize Maximum read buffer size.
+		
+		void SetMaxBufferSize (uint32 maxSize);
+		
+		/// Hint that a range of the stream will be read soon, so it can
+		/// be fetched ahead of time. The default does nothing.
+		/// \param offset Start of the range.
+		/// \param count Number of bytes in the range.
+		
+		virtual void Prefetch (uint64 offset,
+							   uint64 count);
 
 		/// Getter for length of data in stream.
 		/// \retval Length of readable data in stream.
@@ -291,6 +291,10 @@ enum
 	tcOpcodeList2					= 51009,
 	tcOpcodeList3					= 51022,
 	tcNoiseProfile					= 51041,
+	tcProfileHueSatMapEncoding		= 51107,
+	tcProfileLookTableEncoding		= 51108,
+	tcBaselineExposureOffset		= 51109,
+	tcDefaultBlackRender			= 51110,
 	tcKodakKDCPrivateIFD			= 65024
 	};
 
@@ -113,6 +113,7 @@ enum
 	ccOldJPEG					= 6,
 	ccJPEG						= 7,
 	ccDeflate					= 8,
+	ccLossyJPEG					= 34892,
 	ccPackBits					= 32773,
 	ccOldDeflate				= 32946
 	
@@ -126,7 +127,13 @@ enum
 	{
 	
 	cpNullPredictor				= 1,
-	cpHorizontalDifference		= 2
+	cpHorizontalDifference		= 2,
+	cpFloatingPoint				= 3,
+	
+	cpHorizontalDifferenceX2	= 34892,
+	cpHorizontalDifferenceX4	= 34893,
+	cpFloatingPointX2			= 34894,
+	cpFloatingPointX4			= 34895
 	
 	};		
 
@@ -348,10 +355,21 @@ enum
 	dngVersion_1_1_0_0			= 0x01010000,
 	dngVersion_1_2_0_0			= 0x01020000,
 	dngVersion_1_3_0_0			= 0x01030000,
+	dngVersion_1_4_0_0			= 0x01040000,
 	
 	dngVersion_Current			= dngVersion_1_3_0_0,
 	
-	dngVersion_SaveDefault		= dngVersion_Current
+	dngVersion_SaveDefault		= dngVersion_Current,
+	
+	// Highest DNGBackwardVersion that is read without further checks.
+	
+	dngVersion_MaxBackward		= dngVersion_Current,
+	
+	// Files needing DNG 1.4 are read only when the 1.4 features they use
+	// are implemented: deflate compression with its predictors, and 32-bit
+	// floating point raw data. See dng_info::IsValidDNG.
+	
+	dngVersion_MaxPartialBackward	= dngVersion_1_4_0_0
 	
 	};
 
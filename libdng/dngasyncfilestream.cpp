@@ -0,0 +1,434 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "dngasyncfilestream.h"
+#include "dng_exceptions.h"
+#include "dng_utils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if qWinOS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Positioned I/O on the raw file descriptor. Only one thread touches the
+// file at a time: the writer thread while blocks are queued, the caller
+// once the queue has drained.
+
+static bool writeAt(int file, const uint8 *data, uint32 count, uint64 offset)
+{
+#if qWinOS
+    if (_lseeki64(file, (__int64) offset, SEEK_SET) < 0)
+        return false;
+    while (count > 0)
+    {
+        int written = _write(file, data, count);
+        if (written <= 0)
+            return false;
+        data += written;
+        count -= written;
+    }
+#else
+    while (count > 0)
+    {
+        ssize_t written = pwrite(file, data, count, (off_t) offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data += written;
+        count -= (uint32) written;
+        offset += written;
+    }
+#endif
+    return true;
+}
+
+static bool readAt(int file, uint8 *data, uint32 count, uint64 offset)
+{
+#if qWinOS
+    if (_lseeki64(file, (__int64) offset, SEEK_SET) < 0)
+        return false;
+    while (count > 0)
+    {
+        int bytesRead = _read(file, data, count);
+        if (bytesRead <= 0)
+            return false;
+        data += bytesRead;
+        count -= bytesRead;
+    }
+#else
+    while (count > 0)
+    {
+        ssize_t bytesRead = pread(file, data, count, (off_t) offset);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return false;
+        data += bytesRead;
+        count -= (uint32) bytesRead;
+        offset += bytesRead;
+    }
+#endif
+    return true;
+}
+
+static bool truncateFile(int file, uint64 length)
+{
+#if qWinOS
+    return _chsize_s(file, (__int64) length) == 0;
+#else
+    return ftruncate(file, (off_t) length) == 0;
+#endif
+}
+
+DngAsyncFileStream::DngAsyncFileStream(const char* filename,
+                                       uint64 estimatedSize,
+                                       bool syncOnClose,
+                                       uint32 blockSize,
+                                       uint32 blockCount) :
+    dng_stream((dng_abort_sniffer *) NULL),
+    m_File(-1),
+    m_SyncOnClose(syncOnClose),
+    m_Preallocated(false),
+    m_Length(0),
+    m_Written(0),
+    m_Error(0),
+    m_StallTime(0.0),
+    m_SyncTime(0.0),
+    m_FillBlock(-1)
+#if qDNGThreadSafe
+    , m_Mutex("DngAsyncFileStream"),
+    m_ThreadRunning(false),
+    m_Quit(false)
+#endif
+{
+    // Allocate the blocks first: nothing after the open may throw, or the
+    // file would leak with the half constructed stream.
+    blockCount = Max_uint32(blockCount, 1);
+    blockSize = Max_uint32(blockSize, 64 * 1024);
+
+    m_Blocks.resize(blockCount);
+    for (uint32 i = 0; i < blockCount; i++)
+    {
+        m_Blocks[i].m_Data.resize(blockSize);
+        m_Blocks[i].m_Offset = 0;
+        m_Blocks[i].m_Size = 0;
+        m_FreeBlocks.push_back(blockCount - 1 - i);
+    }
+
+#if qWinOS
+    m_File = _open(filename, _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    m_File = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666);
+#endif
+
+    if (m_File < 0)
+        ThrowOpenFile();
+
+#if defined(__linux__)
+    // Reserve the space up front, so the file system can lay the file out
+    // in one piece. File systems without fallocate just skip this.
+    if (estimatedSize > 0)
+        m_Preallocated = fallocate(m_File, 0, 0, (off_t) estimatedSize) == 0;
+#else
+    (void) estimatedSize;
+#endif
+
+#if qDNGThreadSafe
+    if (pthread_create(&m_Thread, NULL, ThreadProc, this) == 0)
+        m_ThreadRunning = true;
+#endif
+}
+
+DngAsyncFileStream::~DngAsyncFileStream()
+{
+    try
+    {
+        Close();
+    }
+    catch (...)
+    {
+    }
+}
+
+void DngAsyncFileStream::Close()
+{
+    if (m_File < 0)
+        return;
+
+    int error = 0;
+
+    try
+    {
+        Flush();
+        Drain();
+    }
+    catch (...)
+    {
+        error = m_Error ? m_Error : EIO;
+    }
+
+#if qDNGThreadSafe
+    if (m_ThreadRunning)
+    {
+        {
+            dng_lock_mutex lock(&m_Mutex);
+            m_Quit = true;
+            m_Changed.Broadcast();
+        }
+        pthread_join(m_Thread, NULL);
+        m_ThreadRunning = false;
+    }
+#endif
+
+    // Give back any preallocated space past the end of the data. After a
+    // failed write, cut the file after the last data that reached it, so
+    // a zero filled preallocated tail does not pass for a whole file.
+    if (!error && m_Preallocated && !truncateFile(m_File, m_Length))
+        error = errno;
+    else if (error && m_Preallocated)
+        truncateFile(m_File, m_Written);
+
+    if (!error && m_SyncOnClose)
+    {
+        real64 start = TickTimeInSeconds();
+#if qWinOS
+        if (_commit(m_File) != 0)
+            error = errno;
+#else
+        if (fsync(m_File) != 0)
+            error = errno;
+#endif
+        m_SyncTime = TickTimeInSeconds() - start;
+    }
+
+#if qWinOS
+    _close(m_File);
+#else
+    close(m_File);
+#endif
+    m_File = -1;
+
+    if (error)
+        ThrowWriteFile();
+}
+
+uint64 DngAsyncFileStream::DoGetLength()
+{
+    return m_Length;
+}
+
+void DngAsyncFileStream::DoRead(void *data, uint32 count, uint64 offset)
+{
+    Drain();
+
+    if (offset + count > m_Length || !readAt(m_File, (uint8 *) data, count, offset))
+        ThrowReadFile();
+}
+
+void DngAsyncFileStream::DoSetLength(uint64 length)
+{
+    Drain();
+
+    if (!truncateFile(m_File, length))
+        ThrowWriteFile();
+
+    m_Length = length;
+}
+
+void DngAsyncFileStream::DoWrite(const void *data, uint32 count, uint64 offset)
+{
+    CheckError();
+
+    const uint8 *sPtr = (const uint8 *) data;
+
+    m_Length = Max_uint64(m_Length, offset + count);
+
+    while (count > 0)
+    {
+        // Blocks hold contiguous data, so a seek starts a new one.
+        if (m_FillBlock >= 0)
+        {
+            const Block &fill = m_Blocks[m_FillBlock];
+            if (offset != fill.m_Offset + fill.m_Size)
+                Submit();
+        }
+
+        if (m_FillBlock < 0)
+            AcquireBlock(offset);
+
+        Block &block = m_Blocks[m_FillBlock];
+
+        uint32 room = (uint32) block.m_Data.size() - block.m_Size;
+        uint32 n = Min_uint32(room, count);
+
+        memcpy(&block.m_Data[block.m_Size], sPtr, n);
+
+        block.m_Size += n;
+        sPtr += n;
+        offset += n;
+        count -= n;
+
+        if (block.m_Size == block.m_Data.size())
+            Submit();
+    }
+}
+
+void DngAsyncFileStream::Submit()
+{
+    if (m_FillBlock < 0)
+        return;
+
+    uint32 index = (uint32) m_FillBlock;
+    m_FillBlock = -1;
+
+#if qDNGThreadSafe
+    if (m_ThreadRunning)
+    {
+        dng_lock_mutex lock(&m_Mutex);
+        m_Queue.push_back(index);
+        m_Changed.Broadcast();
+        return;
+    }
+#endif
+
+    WriteBlock(m_Blocks[index]);
+    m_FreeBlocks.push_back(index);
+    CheckError();
+}
+
+void DngAsyncFileStream::AcquireBlock(uint64 offset)
+{
+#if qDNGThreadSafe
+    dng_lock_mutex lock(&m_Mutex);
+
+    if (m_FreeBlocks.empty())
+    {
+        real64 start = TickTimeInSeconds();
+        while (m_FreeBlocks.empty())
+            m_Changed.Wait(m_Mutex);
+        m_StallTime += TickTimeInSeconds() - start;
+    }
+#endif
+
+    m_FillBlock = (int32) m_FreeBlocks.back();
+    m_FreeBlocks.pop_back();
+
+    m_Blocks[m_FillBlock].m_Offset = offset;
+    m_Blocks[m_FillBlock].m_Size = 0;
+}
+
+void DngAsyncFileStream::Drain()
+{
+    Submit();
+
+#if qDNGThreadSafe
+    {
+        dng_lock_mutex lock(&m_Mutex);
+
+        if (m_FreeBlocks.size() < m_Blocks.size())
+        {
+            real64 start = TickTimeInSeconds();
+            while (m_FreeBlocks.size() < m_Blocks.size())
+                m_Changed.Wait(m_Mutex);
+            m_StallTime += TickTimeInSeconds() - start;
+        }
+    }
+#endif
+
+    CheckError();
+}
+
+void DngAsyncFileStream::CheckError()
+{
+#if qDNGThreadSafe
+    dng_lock_mutex lock(&m_Mutex);
+#endif
+
+    if (m_Error)
+        ThrowWriteFile();
+}
+
+void DngAsyncFileStream::WriteBlock(const Block &block)
+{
+    // Once a write has failed, later blocks are dropped; the caller sees
+    // the error on its next write or on Close().
+    if (m_Error)
+        return;
+
+    if (!writeAt(m_File, &block.m_Data[0], block.m_Size, block.m_Offset))
+        m_Error = errno ? errno : EIO;
+    else
+        m_Written = Max_uint64(m_Written, block.m_Offset + block.m_Size);
+}
+
+#if qDNGThreadSafe
+
+void* DngAsyncFileStream::ThreadProc(void *arg)
+{
+    ((DngAsyncFileStream *) arg)->Run();
+    return NULL;
+}
+
+void DngAsyncFileStream::Run()
+{
+    dng_lock_mutex lock(&m_Mutex);
+
+    for (;;)
+    {
+        while (m_Queue.empty() && !m_Quit)
+            m_Changed.Wait(m_Mutex);
+
+        if (m_Queue.empty())
+            break;
+
+        uint32 index = m_Queue.front();
+        m_Queue.erase(m_Queue.begin());
+
+        Block &block = m_Blocks[index];
+
+        // As in WriteBlock, blocks after a failed write are dropped.
+        if (!m_Error)
+        {
+            int error = 0;
+
+            {
+                dng_unlock_mutex unlock(&m_Mutex);
+
+                if (!writeAt(m_File, &block.m_Data[0], block.m_Size, block.m_Offset))
+                    error = errno ? errno : EIO;
+            }
+
+            if (error)
+                m_Error = error;
+            else
+                m_Written = Max_uint64(m_Written, block.m_Offset + block.m_Size);
+        }
+
+        m_FreeBlocks.push_back(index);
+        m_Changed.Broadcast();
+    }
+}
+
+#endif
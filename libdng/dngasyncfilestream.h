@@ -0,0 +1,111 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "dng_mutex.h"
+#include "dng_stream.h"
+
+// Output file stream for dng_image_writer that writes behind the caller.
+// Data is collected into blocks, and full blocks are handed to a
+// background thread that writes them in order while the caller keeps
+// encoding. At most blockCount blocks are filled or in flight at once;
+// when all of them are busy the caller waits, and that wait is reported
+// by StallTime(). Without thread support the blocks are written
+// synchronously.
+//
+// If estimatedSize is given, the file is preallocated to that size where
+// the platform supports it, and trimmed to the real length on Close().
+class DngAsyncFileStream : public dng_stream
+{
+public:
+    enum
+    {
+        kDefaultBlockSize = 4 * 1024 * 1024,
+        kDefaultBlockCount = 3
+    };
+
+    DngAsyncFileStream(const char* filename,
+                       uint64 estimatedSize = 0,
+                       bool syncOnClose = false,
+                       uint32 blockSize = kDefaultBlockSize,
+                       uint32 blockCount = kDefaultBlockCount);
+    virtual ~DngAsyncFileStream();
+
+    // Write out everything, fsync if requested, and close the file.
+    // Throws if any write failed. The destructor closes the stream too,
+    // but has to ignore errors.
+    void Close();
+
+    // Seconds the caller spent waiting for the background writes.
+    real64 StallTime() const { return m_StallTime; }
+
+    // Seconds spent in fsync by Close().
+    real64 SyncTime() const { return m_SyncTime; }
+
+protected:
+    virtual uint64 DoGetLength();
+    virtual void DoRead(void *data, uint32 count, uint64 offset);
+    virtual void DoSetLength(uint64 length);
+    virtual void DoWrite(const void *data, uint32 count, uint64 offset);
+
+private:
+    struct Block
+    {
+        std::vector<uint8> m_Data;
+        uint64 m_Offset;
+        uint32 m_Size;
+    };
+
+    void Submit();
+    void AcquireBlock(uint64 offset);
+    void Drain();
+    void CheckError();
+    void WriteBlock(const Block &block);
+
+#if qDNGThreadSafe
+    static void* ThreadProc(void *arg);
+    void Run();
+#endif
+
+    int m_File;
+    bool m_SyncOnClose;
+    bool m_Preallocated;
+    uint64 m_Length;
+    uint64 m_Written;       // end of the data that reached the file
+    int m_Error;
+
+    real64 m_StallTime;
+    real64 m_SyncTime;
+
+    std::vector<Block> m_Blocks;
+    std::vector<uint32> m_FreeBlocks;
+    std::vector<uint32> m_Queue;
+    int32 m_FillBlock;
+
+#if qDNGThreadSafe
+    dng_mutex m_Mutex;
+    dng_condition m_Changed;
+    pthread_t m_Thread;
+    bool m_ThreadRunning;
+    bool m_Quit;
+#endif
+};
@@ -40,6 +40,12 @@
 #endif
 #endif
 
+#if qWinOS
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
 enum threadVals 
 {
     kMaxLocalThreads = 16,
@@ -295,6 +301,18 @@ void DngHost::PerformAreaTask(dng_area_task &task,
 
 }
 
+uint32 DngHost::ProcessorCount()
+{
+#if qWinOS
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? static_cast<uint32>(info.dwNumberOfProcessors) : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? static_cast<uint32>(count) : 1;
+#endif
+}
+
 dng_negative* DngHost::Make_dng_negative()
 {
     return DngNegative::Make(Allocator());
@@ -32,4 +32,7 @@ public:
     virtual dng_ifd* Make_dng_ifd();
     virtual dng_negative* Make_dng_negative();
     virtual void PerformAreaTask(dng_area_task &task, const dng_rect &area);
+
+    // The number of processors online, at least 1.
+    static uint32 ProcessorCount();
 };
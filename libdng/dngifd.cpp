@@ -21,6 +21,10 @@
 
 #include "dngreadimage.h"
 
+#include <dng_auto_ptr.h>
+#include <dng_host.h>
+#include <dng_image.h>
+
 DngIfd::DngIfd(void)
 {
 }
@@ -43,3 +47,18 @@ void DngIfd::ReadImage(dng_host &host,
     reader.Read(host, *this, stream, image);
 }
 
+dng_image* DngIfd::ReadScaledImage(dng_host &host,
+                                   dng_stream &stream,
+                                   uint32 minSize) const
+{
+    DngReadImage reader;
+    reader.SetScale(DngReadImage::ScaleForSize(*this, minSize));
+
+    AutoPtr<dng_image> image(host.Make_dng_image(DngReadImage::ScaledBounds(*this, reader.Scale()),
+                                                 fSamplesPerPixel,
+                                                 PixelType()));
+
+    reader.Read(host, *this, stream, *image.Get());
+
+    return image.Release();
+}
@@ -30,4 +30,9 @@ public:
 public:
     virtual bool CanRead() const;
     virtual void ReadImage(dng_host &host, dng_stream &stream, dng_image &image) const;
+
+    // Read the image at a reduced size when its compression allows it. The
+    // result is still at least minSize pixels on its longer side, unless the
+    // whole image is smaller than that.
+    dng_image* ReadScaledImage(dng_host &host, dng_stream &stream, uint32 minSize) const;
 };
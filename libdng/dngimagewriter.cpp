@@ -20,60 +20,480 @@
 #include "dngimagewriter.h"
 
 #include <jpeglib.h>
+#include <stdlib.h>
 
+#include <vector>
+
+#include <dng_area_task.h>
 #include <dng_host.h>
 #include <dng_image.h>
 #include <dng_color_space.h>
+#include <dng_memory.h>
+#include <dng_mutex.h>
+#include <dng_pixel_buffer.h>
+
+// Memory block that takes over the buffer DngBlockDestinationMgr wrote the
+// compressed data into, so it can be used as is.
+class DngJpegBlock : public dng_memory_block
+{
+public:
+    DngJpegBlock(void *memory, void *data, uint32 size) :
+        dng_memory_block(size),
+        m_Memory(memory)
+    {
+        // data is already 16 byte aligned, so SetBuffer keeps it.
+        SetBuffer(data);
+    }
 
-static const int max_buf = 4096;
+    virtual ~DngJpegBlock()
+    {
+        free(m_Memory);
+    }
+
+private:
+    void *m_Memory;
+};
 
-struct DngStreamDestinationMgr 
+// Destination manager that writes the compressed data into one buffer,
+// which is grown by doubling when it fills up.
+struct DngBlockDestinationMgr
         : public jpeg_destination_mgr
 {
-    JOCTET buffer[max_buf];
-    dng_stream* stream;
+    void *memory;
+    uint8 *data;
+    uint32 capacity;
 
-    DngStreamDestinationMgr(dng_stream* s);
+    DngBlockDestinationMgr(uint32 initialSize);
+    ~DngBlockDestinationMgr();
+
+    void Allocate(uint32 size);
+    dng_memory_block* Release();
 
     static void jpeg_init_buffer(jpeg_compress_struct* cinfo);
     static boolean jpeg_empty_buffer(jpeg_compress_struct* cinfo);
     static void jpeg_term_buffer(jpeg_compress_struct* cinfo);
 };
 
-void DngStreamDestinationMgr::jpeg_init_buffer(jpeg_compress_struct* /*cinfo*/)
+void DngBlockDestinationMgr::jpeg_init_buffer(jpeg_compress_struct* /*cinfo*/)
 {
 }
 
-boolean DngStreamDestinationMgr::jpeg_empty_buffer(jpeg_compress_struct* cinfo)
+boolean DngBlockDestinationMgr::jpeg_empty_buffer(jpeg_compress_struct* cinfo)
 {
-    DngStreamDestinationMgr* dest = (DngStreamDestinationMgr*)cinfo->dest;
+    DngBlockDestinationMgr* dest = (DngBlockDestinationMgr*)cinfo->dest;
+
+    uint32 used = dest->capacity;
+
+    if (used > 0x7FFFFFFF - 80)
+    {
+        ThrowMemoryFull();
+    }
 
-    dest->stream->Put(dest->buffer, max_buf);
-    dest->next_output_byte = dest->buffer;
-    dest->free_in_buffer = max_buf;
+    dest->Allocate(used * 2);
+    dest->next_output_byte = dest->data + used;
+    dest->free_in_buffer = dest->capacity - used;
 
     return TRUE;
 }
 
-void DngStreamDestinationMgr::jpeg_term_buffer(jpeg_compress_struct* cinfo)
+void DngBlockDestinationMgr::jpeg_term_buffer(jpeg_compress_struct* /*cinfo*/)
 {
-    DngStreamDestinationMgr* dest = (DngStreamDestinationMgr*)cinfo->dest;
-
-    uint32 n = max_buf - dest->free_in_buffer;
-    dest->stream->Put(dest->buffer, n);
 }
 
-DngStreamDestinationMgr::DngStreamDestinationMgr(dng_stream* s)
+DngBlockDestinationMgr::DngBlockDestinationMgr(uint32 initialSize) :
+    memory(NULL),
+    data(NULL),
+    capacity(0)
 {
     jpeg_destination_mgr::init_destination    = jpeg_init_buffer;
     jpeg_destination_mgr::empty_output_buffer = jpeg_empty_buffer;
     jpeg_destination_mgr::term_destination    = jpeg_term_buffer;
 
-    this->stream = s;
-    next_output_byte = buffer;
-    free_in_buffer = max_buf;
+    Allocate(Max_uint32(initialSize, 4096));
+    next_output_byte = data;
+    free_in_buffer = capacity;
+}
+
+DngBlockDestinationMgr::~DngBlockDestinationMgr()
+{
+    free(memory);
+}
+
+void DngBlockDestinationMgr::Allocate(uint32 size)
+{
+    // Leave room to align the data like dng_memory_block does, and the
+    // usual 64 bytes of slack after the logical size.
+    void *newMemory = malloc(size + 16 + 64);
+    if (!newMemory)
+    {
+        ThrowMemoryFull();
+    }
+
+    uint8 *newData = (uint8 *) ((((uintptr) newMemory) + 15) & ~((uintptr) 15));
+
+    if (memory)
+    {
+        memcpy(newData, data, capacity);
+        free(memory);
+    }
+
+    memory = newMemory;
+    data = newData;
+    capacity = size;
+}
+
+dng_memory_block* DngBlockDestinationMgr::Release()
+{
+    uint32 size = capacity - (uint32) free_in_buffer;
+
+    // If this throws, the destination keeps the memory and frees it.
+    dng_memory_block *block = new DngJpegBlock(memory, data, size);
+
+    memory = NULL;
+    data = NULL;
+    capacity = 0;
+
+    return block;
 }
 
+// Encode one area of an RGB image as a complete baseline JPEG.
+static dng_memory_block* encodeArea(dng_host &host,
+                                    const dng_image &image,
+                                    const dng_rect &area,
+                                    uint8 compression,
+                                    uint8 subsampling)
+{
+    const uint32 width = area.W();
+    const uint32 height = area.H();
+
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr       jerr;
+
+    // Previews usually compress to well under a byte per pixel, so this
+    // rarely has to grow.
+    DngBlockDestinationMgr dmgr(width * height / 2);
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    cinfo.dest = &dmgr;
+    cinfo.image_width      = width;
+    cinfo.image_height     = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space   = JCS_RGB;
+
+    try
+    {
+        jpeg_set_defaults(&cinfo);
+
+#if defined(LIBJPEG_TURBO_VERSION)
+        // libjpeg-turbo has SIMD versions of the fast integer DCT, which is
+        // accurate enough for preview quality settings. Huffman tables are
+        // not optimized, which would need a second pass over the coefficients.
+        cinfo.dct_method = JDCT_IFAST;
+        cinfo.optimize_coding = FALSE;
+#endif
+
+        switch (subsampling)
+        {
+        case 1:  // 2x1, 1x1, 1x1 (4:2:2) : Medium
+        {
+            cinfo.comp_info[0].h_samp_factor = 2;
+            cinfo.comp_info[0].v_samp_factor = 1;
+            cinfo.comp_info[1].h_samp_factor = 1;
+            cinfo.comp_info[1].v_samp_factor = 1;
+            cinfo.comp_info[2].h_samp_factor = 1;
+            cinfo.comp_info[2].v_samp_factor = 1;
+            break;
+        }
+        case 2:  // 2x2, 1x1, 1x1 (4:1:1) : High
+        {
+            cinfo.comp_info[0].h_samp_factor = 2;
+            cinfo.comp_info[0].v_samp_factor = 2;
+            cinfo.comp_info[1].h_samp_factor = 1;
+            cinfo.comp_info[1].v_samp_factor = 1;
+            cinfo.comp_info[2].h_samp_factor = 1;
+            cinfo.comp_info[2].v_samp_factor = 1;
+            break;
+        }
+        default:  // 1x1 1x1 1x1 (4:4:4) : None
+        {
+            cinfo.comp_info[0].h_samp_factor = 1;
+            cinfo.comp_info[0].v_samp_factor = 1;
+            cinfo.comp_info[1].h_samp_factor = 1;
+            cinfo.comp_info[1].v_samp_factor = 1;
+            cinfo.comp_info[2].h_samp_factor = 1;
+            cinfo.comp_info[2].v_samp_factor = 1;
+            break;
+        }
+        }
+
+        jpeg_set_quality (&cinfo, compression, true);
+        jpeg_start_compress(&cinfo, true);
+
+        // Rows are handed over one MCU row at a time. If the image is a single
+        // buffer of interleaved 8-bit RGB, such as the output of dng_render,
+        // libjpeg reads straight from its tile buffer. Otherwise each batch of
+        // rows is converted into a small strip buffer first.
+        const uint32 batchRows = cinfo.max_v_samp_factor * DCTSIZE;
+
+        bool direct = image.PixelType() == ttByte &&
+                      image.RepeatingTile() == image.Bounds();
+
+        AutoPtr<dng_memory_block> stripData;
+
+        dng_pixel_buffer strip;
+
+        strip.fPlane      = 0;
+        strip.fPlanes     = 3;
+        strip.fRowStep    = strip.fPlanes * width;
+        strip.fColStep    = strip.fPlanes;
+        strip.fPlaneStep  = 1;
+        strip.fPixelType  = ttByte;
+        strip.fPixelSize  = TagTypeSize(ttByte);
+
+        std::vector<JSAMPROW> rowPointers(batchRows);
+
+        while (cinfo.next_scanline < cinfo.image_height)
+        {
+            uint32 rows = Min_uint32(batchRows, height - cinfo.next_scanline);
+
+            dng_rect batch(area.t + cinfo.next_scanline, area.l,
+                           area.t + cinfo.next_scanline + rows, area.r);
+
+            AutoPtr<dng_const_tile_buffer> tile;
+
+            if (direct)
+            {
+                tile.Reset(new dng_const_tile_buffer(image, batch));
+
+                if (tile->fPlane != 0 || tile->fColStep != 3 || tile->fPlaneStep != 1)
+                {
+                    tile.Reset();
+                    direct = false;
+                }
+            }
+
+            if (tile.Get())
+            {
+                for (uint32 row = 0; row < rows; row++)
+                    rowPointers[row] = (JSAMPROW) tile->ConstPixel_uint8(batch.t + row, batch.l, 0);
+            }
+            else
+            {
+                if (!stripData.Get())
+                    stripData.Reset(host.Allocate(strip.fRowStep * batchRows));
+
+                strip.fArea = batch;
+                strip.fData = stripData->Buffer();
+
+                image.Get(strip);
+
+                for (uint32 row = 0; row < rows; row++)
+                    rowPointers[row] = (JSAMPROW) strip.ConstPixel_uint8(batch.t + row, batch.l, 0);
+            }
+
+            jpeg_write_scanlines(&cinfo, &rowPointers[0], rows);
+        }
+
+        jpeg_finish_compress(&cinfo);
+    }
+    catch (...)
+    {
+        jpeg_destroy_compress(&cinfo);
+        throw;
+    }
+
+    jpeg_destroy_compress(&cinfo);
+
+    return dmgr.Release();
+}
+
+// Encodes the horizontal bands of an image on the host's threads. Every
+// band is a complete JPEG with the same settings, and so the same
+// quantization and Huffman tables.
+class JpegBandTask : public dng_area_task
+{
+public:
+    JpegBandTask(dng_host &host, const dng_image &image, uint32 bandRows,
+                 uint8 compression, uint8 subsampling)
+        : m_Host(host),
+          m_Image(image),
+          m_BandRows(bandRows),
+          m_Compression(compression),
+          m_Subsampling(subsampling),
+          m_Bands((image.Height() + bandRows - 1) / bandRows),
+          m_Error(dng_error_none),
+          m_Mutex("JpegBandTask")
+    {
+        fMaxThreads = kMaxMPThreads;
+        fMinTaskArea = 1;
+        fUnitCell = dng_point(bandRows, 1);
+        fMaxTileSize = dng_point(bandRows, image.Width());
+    }
+
+    ~JpegBandTask()
+    {
+        for (uint32 i = 0; i < m_Bands.size(); i++)
+            delete m_Bands[i];
+    }
+
+    virtual void Process(uint32 /* threadIndex */,
+                         const dng_rect &tile,
+                         dng_abort_sniffer * /* sniffer */)
+    {
+        // Errors are passed back to the calling thread by Encode.
+        dng_error_code error = dng_error_none;
+
+        try
+        {
+            uint32 band = (tile.t - m_Image.Bounds().t) / m_BandRows;
+
+            m_Bands[band] = encodeArea(m_Host, m_Image, tile, m_Compression, m_Subsampling);
+        }
+        catch (const dng_exception &e)
+        {
+            error = e.ErrorCode();
+        }
+        catch (...)
+        {
+            error = dng_error_unknown;
+        }
+
+        if (error != dng_error_none)
+        {
+            dng_lock_mutex lock(&m_Mutex);
+            if (m_Error == dng_error_none)
+                m_Error = error;
+        }
+    }
+
+    // Encode all bands; the results are in Bands().
+    void Encode()
+    {
+        m_Host.PerformAreaTask(*this, m_Image.Bounds());
+
+        if (m_Error != dng_error_none)
+            Throw_dng_error(m_Error);
+    }
+
+    const std::vector<dng_memory_block *>& Bands() const { return m_Bands; }
+
+private:
+    dng_host &m_Host;
+    const dng_image &m_Image;
+    uint32 m_BandRows;
+    uint8 m_Compression;
+    uint8 m_Subsampling;
+    std::vector<dng_memory_block *> m_Bands;
+    dng_error_code m_Error;
+    dng_mutex m_Mutex;
+};
+
+// Offsets of the SOF and SOS markers and of the entropy-coded data in a
+// JPEG written by encodeArea.
+struct JpegLayout
+{
+    uint32 sof;
+    uint32 sos;
+    uint32 dataStart;
+    uint32 dataEnd;
+};
+
+static JpegLayout parseLayout(const dng_memory_block &block)
+{
+    const uint8 *p = block.Buffer_uint8();
+    uint32 size = block.LogicalSize();
+
+    JpegLayout layout;
+    layout.sof = 0;
+    layout.sos = 0;
+
+    uint32 pos = 2;
+    while (pos + 4 <= size && p[pos] == 0xFF)
+    {
+        uint8 marker = p[pos + 1];
+        uint32 length = (p[pos + 2] << 8) | p[pos + 3];
+
+        if (marker == 0xC0)
+            layout.sof = pos;
+
+        if (marker == 0xDA)
+        {
+            layout.sos = pos;
+            break;
+        }
+
+        pos += 2 + length;
+    }
+
+    if (!layout.sof || !layout.sos || size < 4 || p[size - 2] != 0xFF || p[size - 1] != 0xD9)
+        ThrowProgramError("Unexpected JPEG layout");
+
+    layout.dataStart = layout.sos + 2 + ((p[layout.sos + 2] << 8) | p[layout.sos + 3]);
+    layout.dataEnd = size - 2;
+
+    return layout;
+}
+
+// Join separately encoded bands into one JPEG. The headers come from the
+// first band, with the full image height and a restart interval of one
+// band. Every band starts with fresh DC predictors and ends padded to a
+// byte boundary, which is exactly what a decoder expects at a restart
+// marker, so the entropy-coded data of the bands is copied as is with
+// RSTn markers in between.
+static dng_memory_block* joinBands(dng_host &host,
+                                   const std::vector<dng_memory_block *> &bands,
+                                   uint32 height,
+                                   uint32 restartInterval)
+{
+    std::vector<JpegLayout> layouts(bands.size());
+
+    const JpegLayout &first = layouts[0] = parseLayout(*bands[0]);
+
+    uint32 size = first.dataStart + 6;
+    for (uint32 i = 0; i < bands.size(); i++)
+    {
+        if (i > 0)
+            layouts[i] = parseLayout(*bands[i]);
+
+        size += layouts[i].dataEnd - layouts[i].dataStart + 2;
+    }
+
+    dng_memory_block *result = host.Allocate(size);
+
+    const uint8 *sPtr = bands[0]->Buffer_uint8();
+    uint8 *dPtr = result->Buffer_uint8();
+
+    memcpy(dPtr, sPtr, first.sos);
+    dPtr[first.sof + 5] = (uint8) (height >> 8);
+    dPtr[first.sof + 6] = (uint8) height;
+    dPtr += first.sos;
+
+    // DRI segment.
+    *dPtr++ = 0xFF;
+    *dPtr++ = 0xDD;
+    *dPtr++ = 0x00;
+    *dPtr++ = 0x04;
+    *dPtr++ = (uint8) (restartInterval >> 8);
+    *dPtr++ = (uint8) restartInterval;
+
+    memcpy(dPtr, sPtr + first.sos, first.dataStart - first.sos);
+    dPtr += first.dataStart - first.sos;
+
+    for (uint32 i = 0; i < bands.size(); i++)
+    {
+        uint32 count = layouts[i].dataEnd - layouts[i].dataStart;
+
+        memcpy(dPtr, bands[i]->Buffer_uint8() + layouts[i].dataStart, count);
+        dPtr += count;
+
+        *dPtr++ = 0xFF;
+        *dPtr++ = (i + 1 < bands.size()) ? (uint8) (0xD0 + (i & 7)) : 0xD9;
+    }
+
+    return result;
+}
 DngImageWriter::DngImageWriter(void)
 {
 }
@@ -88,6 +508,18 @@ void DngImageWriter::WriteJPEG(dng_host &host,
                                uint8 compression,
                                uint8 subsampling,
                                const dng_color_space *space)
+{
+    AutoPtr<dng_memory_block> block(EncodeJPEG(host, image, compression, subsampling, space));
+
+    stream.Put(block->Buffer(), block->LogicalSize());
+}
+
+
+dng_memory_block* DngImageWriter::EncodeJPEG(dng_host &host,
+                                             const dng_image &image,
+                                             uint8 compression,
+                                             uint8 subsampling,
+                                             const dng_color_space *space)
 {
     if ((image.Planes() != 3))
     {
@@ -106,82 +538,31 @@ void DngImageWriter::WriteJPEG(dng_host &host,
         profileSize = size;
     }
 
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr       jerr;
-
-    DngStreamDestinationMgr dmgr(&stream);
-
-    AutoPtr<dng_memory_block> srcData(host.Allocate(image.Width() * image.Height() * 3 * sizeof(uint8)));
+    // Large images are encoded in bands on the host's threads, with one
+    // restart interval per band. A band is a whole number of MCU rows, and
+    // the interval, counted in MCUs, has to fit in 16 bits.
+    const uint32 kMinBandPixels = 1024 * 1024;
+    const uint32 kMaxBands = 32;
 
-    dng_pixel_buffer buffer;
+    uint32 mcuRows = (subsampling == 2) ? 16 : 8;
+    uint32 mcuCols = (subsampling == 1 || subsampling == 2) ? 16 : 8;
 
-    buffer.fArea       = dng_rect(image.Height(), image.Width());
-    buffer.fPlane      = 0;
-    buffer.fPlanes     = 3;
-    buffer.fRowStep    = buffer.fPlanes * image.Width();
-    buffer.fColStep    = buffer.fPlanes;
-    buffer.fPlaneStep  = 1;
-    buffer.fPixelType  = ttByte;
-    buffer.fPixelSize  = TagTypeSize(ttByte);
-    buffer.fData       = srcData->Buffer();
+    uint32 mcusPerRow = (image.Width() + mcuCols - 1) / mcuCols;
+    uint32 totalMcuRows = (image.Height() + mcuRows - 1) / mcuRows;
 
-    image.Get(buffer);
+    uint32 bandMcuRows = Max_uint32((totalMcuRows + kMaxBands - 1) / kMaxBands,
+                                    (kMinBandPixels / mcuRows + image.Width() - 1) / image.Width());
 
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
-
-    cinfo.dest = &dmgr;
-    cinfo.image_width      = image.Width();
-    cinfo.image_height     = image.Height();
-    cinfo.input_components = 3;
-    cinfo.in_color_space   = JCS_RGB;
+    bandMcuRows = Min_uint32(bandMcuRows, 0xFFFF / mcusPerRow);
 
-    jpeg_set_defaults(&cinfo);
-
-    switch (subsampling)
-    {
-    case 1:  // 2x1, 1x1, 1x1 (4:2:2) : Medium
+    if (bandMcuRows == 0 || bandMcuRows >= totalMcuRows)
     {
-        cinfo.comp_info[0].h_samp_factor = 2;
-        cinfo.comp_info[0].v_samp_factor = 1;
-        cinfo.comp_info[1].h_samp_factor = 1;
-        cinfo.comp_info[1].v_samp_factor = 1;
-        cinfo.comp_info[2].h_samp_factor = 1;
-        cinfo.comp_info[2].v_samp_factor = 1;
-        break;
-    }
-    case 2:  // 2x2, 1x1, 1x1 (4:1:1) : High
-    {
-        cinfo.comp_info[0].h_samp_factor = 2;
-        cinfo.comp_info[0].v_samp_factor = 2;
-        cinfo.comp_info[1].h_samp_factor = 1;
-        cinfo.comp_info[1].v_samp_factor = 1;
-        cinfo.comp_info[2].h_samp_factor = 1;
-        cinfo.comp_info[2].v_samp_factor = 1;
-        break;
-    }
-    default:  // 1x1 1x1 1x1 (4:4:4) : None
-    {
-        cinfo.comp_info[0].h_samp_factor = 1;
-        cinfo.comp_info[0].v_samp_factor = 1;
-        cinfo.comp_info[1].h_samp_factor = 1;
-        cinfo.comp_info[1].v_samp_factor = 1;
-        cinfo.comp_info[2].h_samp_factor = 1;
-        cinfo.comp_info[2].v_samp_factor = 1;
-        break;
-    }
+        return encodeArea(host, image, image.Bounds(), compression, subsampling);
     }
 
-    jpeg_set_quality (&cinfo, compression, true);
-    jpeg_start_compress(&cinfo, true);
+    JpegBandTask task(host, image, bandMcuRows * mcuRows, compression, subsampling);
 
-    JSAMPROW row_pointer;
-    while (cinfo.next_scanline < cinfo.image_height)
-    {
-        row_pointer = (JSAMPROW)buffer.ConstPixel_uint8(cinfo.next_scanline, 0);
-        jpeg_write_scanlines(&cinfo, &row_pointer, 1);
-    }
+    task.Encode();
 
-    jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
+    return joinBands(host, task.Bands(), image.Height(), bandMcuRows * mcusPerRow);
 }
@@ -30,4 +30,10 @@ public:
 public:
     virtual void WriteJPEG(dng_host &host, dng_stream &stream, const dng_image &image,
                            uint8 compression = 75, uint8 subsampling = 1, const dng_color_space *space = NULL);
+
+    // Encode an RGB image as a baseline JPEG into a new memory block, which
+    // can be used directly as dng_jpeg_preview::fCompressedData.
+    virtual dng_memory_block* EncodeJPEG(dng_host &host, const dng_image &image,
+                                         uint8 compression = 75, uint8 subsampling = 1,
+                                         const dng_color_space *space = NULL);
 };
@@ -0,0 +1,189 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "dngpreviewextractor.h"
+#include "dngtiffwalker.h"
+
+#include "dng_exceptions.h"
+#include "dng_tag_codes.h"
+#include "dng_tag_types.h"
+#include "dng_tag_values.h"
+#include "dng_utils.h"
+
+// The entries of one IFD that matter for finding previews.
+struct PreviewIfd
+{
+    uint32 subFileType;
+    uint32 width;
+    uint32 height;
+    uint32 compression;
+    uint32 bitsPerSample;
+    uint32 samplesPerPixel;
+    uint32 photometric;
+    uint32 dataCount;
+    uint64 dataOffset;
+    uint64 dataLength;
+    uint64 jpegOffset;
+    uint64 jpegLength;
+    bool jpegTables;
+};
+
+static void readPreviewIfd(dng_stream &stream, const DngTiffIfd &entries, PreviewIfd &ifd)
+{
+    const DngTiffEntry *data = entries.Find(tcTileOffsets);
+    if (data == NULL)
+        data = entries.Find(tcStripOffsets);
+
+    const DngTiffEntry *dataLength = entries.Find(tcTileByteCounts);
+    if (dataLength == NULL)
+        dataLength = entries.Find(tcStripByteCounts);
+
+    ifd.subFileType = entries.Value(stream, tcNewSubFileType);
+    ifd.width = entries.Value(stream, tcImageWidth);
+    ifd.height = entries.Value(stream, tcImageLength);
+    ifd.compression = entries.Find(tcCompression) ? entries.Value(stream, tcCompression) : (uint32) ccUncompressed;
+    ifd.bitsPerSample = entries.Value(stream, tcBitsPerSample);
+    ifd.samplesPerPixel = entries.Find(tcSamplesPerPixel) ? entries.Value(stream, tcSamplesPerPixel) : 1;
+    ifd.photometric = entries.Value(stream, tcPhotometricInterpretation);
+    ifd.dataCount = data ? data->count : 0;
+    ifd.dataOffset = DngTiffIfd::Value(stream, data);
+    ifd.dataLength = DngTiffIfd::Value(stream, dataLength);
+    ifd.jpegOffset = entries.Value(stream, tcJPEGInterchangeFormat);
+    ifd.jpegLength = entries.Value(stream, tcJPEGInterchangeFormatLength);
+    ifd.jpegTables = entries.Find(tcJPEGTables) != NULL;
+}
+
+// Where the complete JPEG stream of a preview IFD is, if it has one.
+static bool findJpegData(const PreviewIfd &ifd, uint64 &offset, uint64 &length)
+{
+    if (ifd.subFileType != sfPreviewImage && ifd.subFileType != sfAltPreviewImage)
+        return false;
+
+    if (ifd.compression == ccJPEG)
+    {
+        // Baseline JPEG in a single strip or tile, as DNG writers store it.
+        bool baseline = ifd.bitsPerSample == 8 &&
+                        ((ifd.samplesPerPixel == 3 && ifd.photometric == piYCbCr) ||
+                         (ifd.samplesPerPixel == 1 && ifd.photometric == piBlackIsZero));
+
+        // With JPEGTables the strip is an abbreviated stream without its
+        // quantization and Huffman tables, which no JPEG reader can open
+        // on its own.
+        if (!baseline || ifd.dataCount != 1 || ifd.jpegTables)
+            return false;
+
+        offset = ifd.dataOffset;
+        length = ifd.dataLength;
+    }
+    else if (ifd.compression == ccOldJPEG)
+    {
+        offset = ifd.jpegOffset;
+        length = ifd.jpegLength;
+    }
+    else
+    {
+        return false;
+    }
+
+    return offset != 0 && length != 0;
+}
+
+DngPreviewExtractor::DngPreviewExtractor(dng_stream &stream) :
+    m_Stream(stream)
+{
+}
+
+DngPreviewExtractor::~DngPreviewExtractor()
+{
+}
+
+void DngPreviewExtractor::Parse()
+{
+    m_Previews.clear();
+
+    uint64 fileLength = m_Stream.Length();
+
+    DngTiffWalker walker(m_Stream);
+    walker.Start();
+
+    DngTiffIfd entries;
+    uint32 index;
+    while (walker.Next(entries, index))
+    {
+        PreviewIfd ifd;
+        readPreviewIfd(m_Stream, entries, ifd);
+
+        DngJpegPreview preview;
+        if (findJpegData(ifd, preview.offset, preview.length) &&
+            preview.offset + preview.length <= fileLength)
+        {
+            preview.ifdIndex = index;
+            preview.subFileType = ifd.subFileType;
+            preview.width = ifd.width;
+            preview.height = ifd.height;
+            m_Previews.push_back(preview);
+        }
+    }
+}
+
+// Whether preview a is a better pick than b, when looking for the smallest
+// or for the largest preview. Primary previews win over alternate ones of
+// the same size.
+static bool betterPreview(const DngJpegPreview *a, const DngJpegPreview *b, bool smallest)
+{
+    uint64 areaA = (uint64) a->width * a->height;
+    uint64 areaB = (uint64) b->width * b->height;
+
+    if (areaA != areaB)
+        return smallest ? areaA < areaB : areaA > areaB;
+
+    return a->subFileType != sfAltPreviewImage && b->subFileType == sfAltPreviewImage;
+}
+
+const DngJpegPreview* DngPreviewExtractor::Select(uint32 targetSize) const
+{
+    const DngJpegPreview *largest = NULL;
+    const DngJpegPreview *closest = NULL;
+
+    for (size_t i = 0; i < m_Previews.size(); i++)
+    {
+        const DngJpegPreview *preview = &m_Previews[i];
+
+        if (!largest || betterPreview(preview, largest, false))
+            largest = preview;
+
+        if (targetSize != 0 && Max_uint32(preview->width, preview->height) >= targetSize &&
+            (!closest || betterPreview(preview, closest, true)))
+            closest = preview;
+    }
+
+    return closest ? closest : largest;
+}
+
+void DngPreviewExtractor::Extract(const DngJpegPreview &preview, dng_stream &dstStream)
+{
+    m_Stream.SetReadPosition(preview.offset);
+
+    // Check for the SOI marker before copying anything.
+    if (preview.length < 2 || m_Stream.Get_uint8() != 0xFF || m_Stream.Get_uint8() != 0xD8)
+        ThrowBadFormat();
+
+    m_Stream.SetReadPosition(preview.offset);
+    m_Stream.CopyToStream(dstStream, preview.length);
+}
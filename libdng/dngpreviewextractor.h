@@ -0,0 +1,67 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "dng_stream.h"
+#include "dng_types.h"
+
+// A JPEG preview stored in one piece in a TIFF or DNG file.
+struct DngJpegPreview
+{
+    uint32 ifdIndex;        // in DngTiffWalker order, as dnganalyze -catalogue lists IFDs
+    uint32 subFileType;
+    uint32 width;
+    uint32 height;
+    uint64 offset;
+    uint64 length;
+};
+
+// Finds the JPEG previews of a DNG without dng_info or dng_negative. Only
+// the IFD chain and SubIFDs are walked, with DngTiffWalker, and only the
+// entries that describe a preview are read; the preview bytes are copied
+// out without decoding.
+// Each extractor works on its own stream, so separate files can be handled
+// on separate threads.
+class DngPreviewExtractor
+{
+public:
+    DngPreviewExtractor(dng_stream &stream);
+    ~DngPreviewExtractor();
+
+    // Walk the IFDs and collect the previews. Throws on a malformed file.
+    void Parse();
+
+    const std::vector<DngJpegPreview>& Previews() const { return m_Previews; }
+
+    // The largest preview or, if targetSize is not 0, the smallest preview
+    // that is at least targetSize pixels on its longer side, falling back to
+    // the largest. Primary previews win over alternate ones of equal size.
+    // Returns NULL if the file has no JPEG preview.
+    const DngJpegPreview* Select(uint32 targetSize = 0) const;
+
+    // Copy the preview's JPEG data unchanged to dstStream.
+    void Extract(const DngJpegPreview &preview, dng_stream &dstStream);
+
+private:
+    dng_stream &m_Stream;
+    std::vector<DngJpegPreview> m_Previews;
+};
@@ -0,0 +1,98 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#include "dngprofilecache.h"
+#include "dng_auto_ptr.h"
+#include "dng_file_stream.h"
+
+DngProfileCache::DngProfileCache() :
+    m_Mutex("DngProfileCache")
+{
+}
+
+DngProfileCache::~DngProfileCache()
+{
+    Clear();
+}
+
+DngProfileCache& DngProfileCache::Get()
+{
+    static DngProfileCache cache;
+    return cache;
+}
+
+dng_camera_profile* DngProfileCache::ProfileFromStream(dng_stream &stream)
+{
+    dng_md5_printer printer;
+
+    uint64 length = stream.Length();
+    stream.SetReadPosition(0);
+
+    uint8 buffer[65536];
+    while (length > 0)
+    {
+        uint32 count = (uint32) Min_uint64(length, sizeof(buffer));
+        stream.Get(buffer, count);
+        printer.Process(buffer, count);
+        length -= count;
+    }
+
+    const dng_fingerprint &key = printer.Result();
+
+    {
+        dng_lock_mutex lock(&m_Mutex);
+
+        ProfileMap::const_iterator it = m_Profiles.find(key);
+        if (it != m_Profiles.end())
+            return new dng_camera_profile(*it->second);
+    }
+
+    // Parse outside the lock, so other threads can still use the cache.
+    // If two threads miss on the same profile, the first to finish wins.
+    AutoPtr<dng_camera_profile> profile(new dng_camera_profile);
+
+    stream.SetReadPosition(0);
+    if (!profile->ParseExtended(stream))
+        return NULL;
+
+    AutoPtr<dng_camera_profile> result(new dng_camera_profile(*profile.Get()));
+
+    dng_lock_mutex lock(&m_Mutex);
+
+    if (m_Profiles.find(key) == m_Profiles.end())
+        m_Profiles[key] = profile.Release();
+
+    return result.Release();
+}
+
+dng_camera_profile* DngProfileCache::ProfileFromFile(const char* filename)
+{
+    dng_file_stream stream(filename);
+    return ProfileFromStream(stream);
+}
+
+void DngProfileCache::Clear()
+{
+    dng_lock_mutex lock(&m_Mutex);
+
+    for (ProfileMap::iterator it = m_Profiles.begin(); it != m_Profiles.end(); ++it)
+        delete it->second;
+
+    m_Profiles.clear();
+}
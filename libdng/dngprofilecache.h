@@ -0,0 +1,64 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#pragma once
+
+#include <cstring>
+#include <map>
+
+#include "dng_camera_profile.h"
+#include "dng_fingerprint.h"
+#include "dng_mutex.h"
+#include "dng_stream.h"
+
+// Process-wide cache of parsed camera profiles (.dcp files), keyed by the
+// MD5 fingerprint of the profile file contents. Batch conversions of many
+// frames from one camera then parse the profile only once. The cached
+// profiles are never modified; each caller gets its own copy to hand to
+// a negative.
+class DngProfileCache
+{
+public:
+    static DngProfileCache& Get();
+
+    // Fingerprint the stream and return a new copy of the profile parsed
+    // from it, parsing only on a cache miss. The caller owns the result.
+    // Returns NULL if the stream does not hold a valid extended profile.
+    dng_camera_profile* ProfileFromStream(dng_stream &stream);
+    dng_camera_profile* ProfileFromFile(const char* filename);
+
+    void Clear();
+
+private:
+    DngProfileCache();
+    ~DngProfileCache();
+
+    struct FingerprintLess
+    {
+        bool operator()(const dng_fingerprint &a, const dng_fingerprint &b) const
+        {
+            return memcmp(a.data, b.data, sizeof(a.data)) < 0;
+        }
+    };
+
+    typedef std::map<dng_fingerprint, dng_camera_profile*, FingerprintLess> ProfileMap;
+
+    dng_mutex m_Mutex;
+    ProfileMap m_Profiles;
+};
@@ -19,82 +19,78 @@
 
 #include "dngreadimage.h"
 
+#include <dng_exceptions.h>
 #include <dng_host.h>
+#include <dng_ifd.h>
+#include <dng_image.h>
+#include <dng_memory.h>
+#include <dng_pixel_buffer.h>
 #include <dng_stream.h>
+#include <dng_tag_types.h>
 
 #include <jpeglib.h>
 
-#include <iostream>
+#include <vector>
 
-static const int max_buf = 4096;
-
-struct DngStreamSourceMgr 
+// Feeds libjpeg from a buffer holding the whole compressed tile.
+struct DngMemorySourceMgr
         : public jpeg_source_mgr
 {
-    JOCTET buffer[max_buf];
-    dng_stream* stream;
-    uint32 bytes;
-
-    DngStreamSourceMgr(dng_stream* s, uint32 b);
+    DngMemorySourceMgr(const uint8* data, uint32 size);
 
-    static void jpeg_init_buffer(jpeg_decompress_struct* cinfo);
+    static void jpeg_init_source(jpeg_decompress_struct* cinfo);
     static boolean jpeg_fill_input_buffer(jpeg_decompress_struct* cinfo);
     static void jpeg_skip_input_data(jpeg_decompress_struct* cinfo, long num_bytes);
-    static boolean jpeg_resync_to_restart(jpeg_decompress_struct* cinfo, int desired);
     static void jpeg_term_source(jpeg_decompress_struct* cinfo);
 };
 
-void DngStreamSourceMgr::jpeg_init_buffer(jpeg_decompress_struct* /*cinfo*/)
+void DngMemorySourceMgr::jpeg_init_source(jpeg_decompress_struct* /*cinfo*/)
 {
 }
 
-boolean DngStreamSourceMgr::jpeg_fill_input_buffer(jpeg_decompress_struct* cinfo)
+boolean DngMemorySourceMgr::jpeg_fill_input_buffer(jpeg_decompress_struct* cinfo)
 {
-    DngStreamSourceMgr* src = (DngStreamSourceMgr*)cinfo->src;
-    src->stream->Get(src->buffer, max_buf);
-    src->next_input_byte = src->buffer;
-    src->bytes_in_buffer = max_buf;
-    return true;
+    // The data is all there already, so running out means it is truncated.
+    // Like libjpeg's own memory source, end the image with a fake EOI.
+    static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = 2;
+
+    return TRUE;
 }
 
-void DngStreamSourceMgr::jpeg_skip_input_data(jpeg_decompress_struct* cinfo, long num_bytes)
+void DngMemorySourceMgr::jpeg_skip_input_data(jpeg_decompress_struct* cinfo, long num_bytes)
 {
-    DngStreamSourceMgr* src = (DngStreamSourceMgr*)cinfo->src;
+    jpeg_source_mgr* src = cinfo->src;
 
-    if (num_bytes > 0)
+    if (num_bytes <= 0)
+        return;
+
+    if (static_cast<size_t>(num_bytes) > src->bytes_in_buffer)
     {
-        while (num_bytes > static_cast<long>(src->bytes_in_buffer))
-        {
-            num_bytes -= static_cast<long>(src->bytes_in_buffer);
-            (void)jpeg_fill_input_buffer(cinfo);
-        }
+        jpeg_fill_input_buffer(cinfo);
+        return;
     }
+
     src->next_input_byte += static_cast<size_t>(num_bytes);
     src->bytes_in_buffer -= static_cast<size_t>(num_bytes);
 }
 
-boolean DngStreamSourceMgr::jpeg_resync_to_restart(jpeg_decompress_struct* /*cinfo*/, int /*desired*/)
+void DngMemorySourceMgr::jpeg_term_source(jpeg_decompress_struct* /*cinfo*/)
 {
-    return false;
 }
 
-void DngStreamSourceMgr::jpeg_term_source(jpeg_decompress_struct* /*cinfo*/)
+DngMemorySourceMgr::DngMemorySourceMgr(const uint8* data, uint32 size)
 {
-}
-
-DngStreamSourceMgr::DngStreamSourceMgr(dng_stream* s, uint32 b)
-{
-    jpeg_source_mgr::init_source       = jpeg_init_buffer;
+    jpeg_source_mgr::init_source       = jpeg_init_source;
     jpeg_source_mgr::fill_input_buffer = jpeg_fill_input_buffer;
     jpeg_source_mgr::skip_input_data   = jpeg_skip_input_data;
     jpeg_source_mgr::resync_to_restart = jpeg_resync_to_restart;
     jpeg_source_mgr::term_source       = jpeg_term_source;
 
-    this->stream = s;
-    this->bytes = b;
-
-    bytes_in_buffer = 0;
-    next_input_byte = buffer;
+    bytes_in_buffer = size;
+    next_input_byte = data;
 }
 
 struct DngStreamErrorMgr
@@ -115,7 +111,8 @@ DngStreamErrorMgr::DngStreamErrorMgr(dng_host* h)
     this->host = h;
 }
 
-DngReadImage::DngReadImage(void)
+DngReadImage::DngReadImage(void) :
+    m_Scale(1)
 {
 }
 
@@ -123,67 +120,213 @@ DngReadImage::~DngReadImage(void)
 {
 }
 
+void DngReadImage::SetScale(uint32 scale)
+{
+    if (scale != 1 && scale != 2 && scale != 4 && scale != 8)
+    {
+        ThrowProgramError("Bad JPEG decode scale");
+    }
+
+    m_Scale = scale;
+}
+
+uint32 DngReadImage::ScaleForSize(const dng_ifd &ifd, uint32 minSize)
+{
+    if (!ifd.IsBaselineJPEG())
+        return 1;
+
+    uint32 size = Max_uint32(ifd.fImageWidth, ifd.fImageLength);
+
+    for (uint32 scale = 8; scale > 1; scale >>= 1)
+    {
+        // Tiles and strips have to start on whole scaled pixels.
+        if (ifd.TilesAcross() > 1 && ifd.fTileWidth % scale != 0)
+            continue;
+
+        if (ifd.TilesDown() > 1 && ifd.fTileLength % scale != 0)
+            continue;
+
+        if ((size + scale - 1) / scale >= minSize)
+            return scale;
+    }
+
+    return 1;
+}
+
+dng_rect DngReadImage::ScaledBounds(const dng_ifd &ifd, uint32 scale)
+{
+    // libjpeg rounds scaled sizes up.
+    return dng_rect((ifd.fImageLength + scale - 1) / scale,
+                    (ifd.fImageWidth + scale - 1) / scale);
+}
+
 bool DngReadImage::ReadBaselineJPEG(dng_host& host,
                                     const dng_ifd& /*ifd*/,
                                     dng_stream& stream,
                                     dng_image& image,
-                                    const dng_rect& /*tileArea*/,
-                                    uint32 /*plane*/,
-                                    uint32 /*planes*/,
+                                    const dng_rect& tileArea,
+                                    uint32 plane,
+                                    uint32 planes,
                                     uint32 tileByteCount)
 {
     uint64 startPos = stream.Position();
-    uint8 header[2];
-    header[0] = stream.Get_uint8();
-    header[1] = stream.Get_uint8();
 
-    unsigned char jpegID[] = { 0xFF, 0xD8 };
-    if (memcmp(header, jpegID, 2) != 0)
+    if (tileByteCount < 2 || startPos + tileByteCount > stream.Length())
     {
         return false;
     }
-    stream.SetReadPosition(startPos);
 
-    DngStreamSourceMgr smgr(&stream, tileByteCount);
-    DngStreamErrorMgr jerr(&host);
+    // Decode straight from the stream's buffer if it holds the whole file,
+    // as it does for files read into memory, and from a copy of the tile's
+    // data otherwise.
+    const uint8* data = (const uint8*) stream.Data();
+
+    AutoPtr<dng_memory_block> tileData;
+
+    if (data)
+    {
+        data += startPos;
+    }
+    else
+    {
+        tileData.Reset(host.Allocate(tileByteCount));
+        stream.Get(tileData->Buffer(), tileByteCount);
+        data = tileData->Buffer_uint8();
+    }
 
-    AutoPtr<dng_memory_block> dstData(host.Allocate(image.Width() * image.Height() * 3 * sizeof(uint8)));
-    
-    dng_pixel_buffer buffer;
+    if (data[0] != 0xFF || data[1] != 0xD8)
+    {
+        return false;
+    }
 
-    buffer.fArea       = dng_rect(image.Height(), image.Width());
-    buffer.fPlane      = 0;
-    buffer.fPlanes     = 3;
-    buffer.fRowStep    = buffer.fPlanes * image.Width();
-    buffer.fColStep    = buffer.fPlanes;
-    buffer.fPlaneStep  = 1;
-    buffer.fPixelType  = ttByte;
-    buffer.fPixelSize  = TagTypeSize(ttByte);
-    buffer.fData       = dstData->Buffer();
+    DngMemorySourceMgr smgr(data, tileByteCount);
+    DngStreamErrorMgr jerr(&host);
 
     struct jpeg_decompress_struct cinfo;
+
+    cinfo.err = jpeg_std_error(&jerr);
     jpeg_create_decompress(&cinfo);
 
     cinfo.src = &smgr;
-    cinfo.err = jpeg_std_error(&jerr);
-    
-    jpeg_read_header(&cinfo, true);
 
-    jpeg_start_decompress(&cinfo);
+    try
+    {
+        jpeg_read_header(&cinfo, TRUE);
+
+        cinfo.scale_num   = 1;
+        cinfo.scale_denom = m_Scale;
+
+        jpeg_start_decompress(&cinfo);
+
+        const uint32 width = cinfo.output_width;
+        const uint32 components = cinfo.output_components;
+
+        // Tiles start on whole scaled pixels (see ScaleForSize), and the
+        // last row and column of tiles can extend past the image.
+        dng_rect dstArea((tileArea.t + m_Scale - 1) / m_Scale,
+                         (tileArea.l + m_Scale - 1) / m_Scale,
+                         (tileArea.t + m_Scale - 1) / m_Scale + cinfo.output_height,
+                         (tileArea.l + m_Scale - 1) / m_Scale + width);
+
+        dstArea = dstArea & image.Bounds();
+
+        uint32 copyPlanes = Min_uint32(components, planes);
 
-    JSAMPROW row_pointer;
-    while (cinfo.output_scanline < cinfo.output_height)
+        if (plane >= image.Planes() || dstArea.IsEmpty())
+        {
+            ThrowBadFormat();
+        }
+
+        copyPlanes = Min_uint32(copyPlanes, image.Planes() - plane);
+
+        // Rows go directly into the image's memory when its layout matches
+        // libjpeg's output. Otherwise they are decoded into a strip buffer
+        // and copied with Put.
+        const uint32 batchRows = 16;
+
+        bool direct = image.PixelType() == ttByte &&
+                      image.RepeatingTile() == image.Bounds() &&
+                      plane == 0 &&
+                      components == image.Planes() &&
+                      dstArea.W() == width;
+
+        AutoPtr<dng_memory_block> stripData;
+
+        dng_pixel_buffer strip;
+
+        strip.fPlane      = plane;
+        strip.fPlanes     = copyPlanes;
+        strip.fRowStep    = components * width;
+        strip.fColStep    = components;
+        strip.fPlaneStep  = 1;
+        strip.fPixelType  = ttByte;
+        strip.fPixelSize  = TagTypeSize(ttByte);
+
+        std::vector<JSAMPROW> rowPointers(batchRows);
+
+        while (cinfo.output_scanline < cinfo.output_height)
+        {
+            uint32 first = cinfo.output_scanline;
+            uint32 rows = Min_uint32(batchRows, cinfo.output_height - first);
+
+            dng_rect batch(dstArea.t + first, dstArea.l,
+                           dstArea.t + first + rows, dstArea.l + width);
+
+            AutoPtr<dng_dirty_tile_buffer> tile;
+
+            if (direct && batch.b <= dstArea.b)
+            {
+                tile.Reset(new dng_dirty_tile_buffer(image, batch));
+
+                if (tile->fPlane != 0 || tile->fColStep != (int32) components || tile->fPlaneStep != 1)
+                {
+                    tile.Reset();
+                    direct = false;
+                }
+            }
+
+            if (tile.Get())
+            {
+                for (uint32 row = 0; row < rows; row++)
+                    rowPointers[row] = (JSAMPROW) tile->DirtyPixel_uint8(batch.t + row, batch.l, 0);
+            }
+            else
+            {
+                if (!stripData.Get())
+                    stripData.Reset(host.Allocate(strip.fRowStep * batchRows));
+
+                strip.fArea = batch;
+                strip.fData = stripData->Buffer();
+
+                for (uint32 row = 0; row < rows; row++)
+                    rowPointers[row] = (JSAMPROW) strip.DirtyPixel_uint8(batch.t + row, batch.l, plane);
+            }
+
+            uint32 done = 0;
+
+            while (done < rows)
+            {
+                done += jpeg_read_scanlines(&cinfo, &rowPointers[done], rows - done);
+            }
+
+            if (!tile.Get())
+            {
+                strip.fArea = batch & dstArea;
+
+                if (strip.fArea.NotEmpty())
+                    image.Put(strip);
+            }
+        }
+
+        jpeg_finish_decompress(&cinfo);
+    }
+    catch (...)
     {
-        row_pointer = (JSAMPROW)buffer.ConstPixel_uint8(cinfo.output_scanline, 0);
-        jpeg_read_scanlines(&cinfo, &row_pointer, 1);
+        jpeg_destroy_decompress(&cinfo);
+        throw;
     }
 
-    jpeg_finish_decompress(&cinfo);
     jpeg_destroy_decompress(&cinfo);
 
-    image.Put(buffer);
-
     return true;
 }
-
-
@@ -27,7 +27,22 @@ public:
     DngReadImage(void);
     ~DngReadImage(void);
 
+    // Baseline JPEG data is decoded at 1/scale of its size, where the scale
+    // is 1, 2, 4 or 8, using libjpeg's scaled IDCT. The image passed to Read
+    // must then have the bounds returned by ScaledBounds.
+    void SetScale(uint32 scale);
+    uint32 Scale() const { return m_Scale; }
+
+    // Largest scale at which the IFD's image is still at least minSize
+    // pixels on its longer side. Always 1 unless the IFD is baseline JPEG.
+    static uint32 ScaleForSize(const dng_ifd &ifd, uint32 minSize);
+
+    static dng_rect ScaledBounds(const dng_ifd &ifd, uint32 scale);
+
 protected:
     virtual bool ReadBaselineJPEG(dng_host &host, const dng_ifd &ifd, dng_stream &stream,
                                   dng_image &image, const dng_rect &tileArea, uint32 plane, uint32 planes, uint32 tileByteCount);
+
+private:
+    uint32 m_Scale;
 };
@@ -0,0 +1,132 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+
+#include "dngtiffwalker.h"
+
+#include <algorithm>
+
+#include "dng_exceptions.h"
+#include "dng_tag_codes.h"
+#include "dng_tag_types.h"
+#include "dng_tag_values.h"
+
+uint64 DngTiffIfd::Read(dng_stream &stream, uint64 offset)
+{
+    stream.SetReadPosition(offset);
+
+    uint32 count = stream.Get_uint16();
+    if (count > kMaxEntries)
+        ThrowBadFormat();
+
+    m_Entries.resize(count);
+    for (uint32 i = 0; i < count; i++)
+    {
+        DngTiffEntry &entry = m_Entries[i];
+        entry.tag = stream.Get_uint16();
+        entry.type = stream.Get_uint16();
+        entry.count = stream.Get_uint32();
+
+        uint64 size = (uint64) TagTypeSize(entry.type) * entry.count;
+        entry.valueOffset = size <= 4 ? stream.Position() : stream.Get_uint32();
+        stream.SetReadPosition(offset + 2 + (i + 1) * 12);
+    }
+
+    return stream.Get_uint32();
+}
+
+const DngTiffEntry* DngTiffIfd::Find(uint16 tag) const
+{
+    for (size_t i = 0; i < m_Entries.size(); i++)
+    {
+        if (m_Entries[i].tag == tag)
+            return &m_Entries[i];
+    }
+    return NULL;
+}
+
+uint32 DngTiffIfd::Value(dng_stream &stream, const DngTiffEntry *entry, uint32 index)
+{
+    if (entry == NULL || index >= entry->count)
+        return 0;
+
+    stream.SetReadPosition(entry->valueOffset + index * TagTypeSize(entry->type));
+    return stream.TagValue_uint32(entry->type);
+}
+
+DngTiffWalker::DngTiffWalker(dng_stream &stream) :
+    m_Stream(stream)
+{
+}
+
+DngTiffWalker::~DngTiffWalker()
+{
+}
+
+void DngTiffWalker::Start()
+{
+    m_Pending.clear();
+    m_Visited.clear();
+
+    m_Stream.SetReadPosition(0);
+
+    uint16 byteOrder = m_Stream.Get_uint16();
+    if (byteOrder == byteOrderII)
+        m_Stream.SetLittleEndian();
+    else if (byteOrder == byteOrderMM)
+        m_Stream.SetBigEndian();
+    else
+        ThrowBadFormat();
+
+    if (m_Stream.Get_uint16() != 42)
+        ThrowBadFormat();
+
+    m_Pending.push_back(m_Stream.Get_uint32());
+}
+
+bool DngTiffWalker::Next(DngTiffIfd &ifd, uint32 &index)
+{
+    uint64 fileLength = m_Stream.Length();
+
+    while (!m_Pending.empty() && m_Visited.size() < kMaxIfds)
+    {
+        uint64 offset = m_Pending.front();
+        m_Pending.erase(m_Pending.begin());
+
+        if (offset == 0 || offset >= fileLength ||
+            std::find(m_Visited.begin(), m_Visited.end(), offset) != m_Visited.end())
+            continue;
+
+        index = (uint32) m_Visited.size();
+        m_Visited.push_back(offset);
+
+        uint64 next = ifd.Read(m_Stream, offset);
+
+        std::vector<uint64> children;
+        const DngTiffEntry *subIfds = ifd.Find(tcSubIFDs);
+        for (uint32 i = 0; subIfds && i < subIfds->count && i < kMaxIfds; i++)
+            children.push_back(DngTiffIfd::Value(m_Stream, subIfds, i));
+        children.push_back(next);
+        m_Pending.insert(m_Pending.begin(), children.begin(), children.end());
+
+        return true;
+    }
+
+    return false;
+}
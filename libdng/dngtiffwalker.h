@@ -0,0 +1,96 @@
+/* This file is part of the dngconvert project
+   Copyright (C) 2011 Jens Mueller <tschensensinger at gmx dot de>
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Library General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this library; see the file COPYING.  If not, write to
+   the Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+
+#pragma once
+
+#include <vector>
+
+#include "dng_stream.h"
+#include "dng_types.h"
+
+// One IFD entry. Its values stay in the file and are read on demand.
+struct DngTiffEntry
+{
+    uint16 tag;
+    uint16 type;
+    uint32 count;
+    uint64 valueOffset;
+};
+
+// The entries of one IFD, read without interpreting any of them.
+class DngTiffIfd
+{
+public:
+    enum
+    {
+        kMaxEntries = 1024
+    };
+
+    // Read the entries of the IFD at offset and return the offset of the
+    // next IFD in the chain. Throws on a malformed IFD.
+    uint64 Read(dng_stream &stream, uint64 offset);
+
+    const std::vector<DngTiffEntry>& Entries() const { return m_Entries; }
+
+    // The entry for tag, or NULL if the IFD has none.
+    const DngTiffEntry* Find(uint16 tag) const;
+
+    // Value index of the entry as uint32, or 0 if entry is NULL or has
+    // fewer values.
+    static uint32 Value(dng_stream &stream, const DngTiffEntry *entry, uint32 index = 0);
+
+    uint32 Value(dng_stream &stream, uint16 tag, uint32 index = 0) const
+    {
+        return Value(stream, Find(tag), index);
+    }
+
+private:
+    std::vector<DngTiffEntry> m_Entries;
+};
+
+// Walks the IFDs of a TIFF or DNG file in a fixed order: IFD 0, its
+// SubIFDs, then the rest of the chain with their SubIFDs. Offsets that
+// are 0, outside the file or already visited are skipped, and at most
+// kMaxIfds IFDs are read. Tools that report IFD indices use this walker
+// so that the indices mean the same thing everywhere.
+class DngTiffWalker
+{
+public:
+    enum
+    {
+        kMaxIfds = 64
+    };
+
+    DngTiffWalker(dng_stream &stream);
+    ~DngTiffWalker();
+
+    // Read the TIFF header and set the stream's byte order. Throws if the
+    // stream is not a TIFF file.
+    void Start();
+
+    // Read the next IFD. index is its position in the walk order. Returns
+    // false once every IFD was read.
+    bool Next(DngTiffIfd &ifd, uint32 &index);
+
+private:
+    dng_stream &m_Stream;
+    std::vector<uint64> m_Pending;
+    std::vector<uint64> m_Visited;
+};